@@ -11,6 +11,8 @@
 #include "vdl-config.h"
 #include "vdl-mem.h"
 #include "vdl-file.h"
+#include "vdl-uffd.h"
+#include "vdl-bind-worker.h"
 #include "futex.h"
 #include "macros.h"
 #include <elf.h>
@@ -95,16 +97,23 @@ struct tls_index
   unsigned long int ti_module;
   unsigned long int ti_offset;
 };
-EXPORT void *
-__tls_get_addr (struct tls_index *ti)
+// __tls_get_addr (and ___tls_get_addr on i386) are implemented in
+// resolv.S: they look up the dtv of the calling thread inline and
+// call this function only when the dtv is not uptodate or when the
+// tls block of the module has not been allocated yet.
+// On i386, the argument is passed in %eax.
+#if defined (__i386__)
+# define tls_get_addr_function __attribute__ ((__regparm__ (1)))
+#else
+# define tls_get_addr_function
+#endif
+tls_get_addr_function void *glibc_tls_get_addr_slow (struct tls_index *ti);
+tls_get_addr_function void *
+glibc_tls_get_addr_slow (struct tls_index *ti)
 {
-  void *retval = (void*) vdl_tls_get_addr_fast (ti->ti_module, ti->ti_offset);
-  if (retval == 0)
-    {
-      futex_lock (g_vdl.futex);      
-      retval = (void*) vdl_tls_get_addr_slow (ti->ti_module, ti->ti_offset);
-      futex_unlock (g_vdl.futex);
-    }
+  futex_lock (g_vdl.futex);
+  void *retval = (void*) vdl_tls_get_addr_slow (ti->ti_module, ti->ti_offset);
+  futex_unlock (g_vdl.futex);
   return retval;
 }
 
@@ -114,21 +123,6 @@ __tls_get_addr (struct tls_index *ti)
 // the same to be compatible.
 # if defined (__i386__)
 #  define internal_function   __attribute ((regparm (3), stdcall))
-// this is the prototype for the GNU version of the i386 TLS ABI
-// note the extra leading underscore used here to identify this optimized
-// version of _get_addr
-EXPORT void *
-__attribute__ ((__regparm__ (1))) ___tls_get_addr (struct tls_index *ti)
-{
-  void *retval = (void*) vdl_tls_get_addr_fast (ti->ti_module, ti->ti_offset);
-  if (retval == 0)
-    {
-      futex_lock (g_vdl.futex);      
-      retval = (void*) vdl_tls_get_addr_slow (ti->ti_module, ti->ti_offset);
-      futex_unlock (g_vdl.futex);
-    }
-  return retval;
-}
 # else
 #  define internal_function
 # endif
@@ -163,6 +157,12 @@ _dl_allocate_tls_init (void *tcb)
     {
       return 0;
     }
+  // the common case: no file was loaded or unloaded since the
+  // last thread was created.
+  if (vdl_tls_dtv_initialize_fast ((unsigned long)tcb))
+    {
+      return tcb;
+    }
   futex_lock (g_vdl.futex);
 
   vdl_tls_dtv_initialize ((unsigned long)tcb);
@@ -216,12 +216,81 @@ _dl_make_stack_executable (void **stack_endp)
   return 0;
 }
 
+// The threads owned by the loader (see vdl-thread.h) are not
+// duplicated by fork and might hold g_vdl.futex when it happens so,
+// we hold it ourselves around fork and reset the loader state
+// which belongs to these threads in the child.
+static void
+glibc_fork_prepare (void)
+{
+  futex_lock (g_vdl.futex);
+  vdl_uffd_fork_prepare ();
+}
+static void
+glibc_fork_parent (void)
+{
+  vdl_uffd_fork_parent ();
+  futex_unlock (g_vdl.futex);
+}
+static void
+glibc_fork_child (void)
+{
+  vdl_uffd_fork_child ();
+  vdl_bind_worker_fork_child ();
+  futex_construct (g_vdl.futex);
+}
+
+// set by glibc_fork_handlers_enable.
+static bool g_fork_handlers = false;
+
+// __register_atfork is what pthread_atfork calls. Each libc, one
+// per namespace, runs only the handlers registered with it so, we
+// register ours with all of them but only once the libc of the
+// main namespace has been initialized.
+static void
+glibc_register_fork_handlers (struct VdlFile *file)
+{
+  if (!g_fork_handlers || !__dl_starting_up || file->fork_handlers_registered)
+    {
+      return;
+    }
+  struct VdlLookupResult result = vdl_lookup_local (file, "__register_atfork");
+  if (!result.found || result.symbol->st_value == 0)
+    {
+      return;
+    }
+  file->fork_handlers_registered = 1;
+  int (*register_atfork) (void (*) (void), void (*) (void),
+			  void (*) (void), void *);
+  register_atfork = (void*)(file->load_base + result.symbol->st_value);
+  register_atfork (glibc_fork_prepare, glibc_fork_parent,
+		   glibc_fork_child, 0);
+}
+
+void glibc_fork_handlers_enable (void)
+{
+  if (g_fork_handlers)
+    {
+      return;
+    }
+  g_fork_handlers = true;
+  struct VdlFile *cur;
+  for (cur = g_vdl.link_map; cur != 0; cur = cur->next)
+    {
+      glibc_register_fork_handlers (cur);
+    }
+}
+
 void glibc_startup_finished (void) 
 {
   __dl_starting_up = 1;
+  struct VdlFile *cur;
+  for (cur = g_vdl.link_map; cur != 0; cur = cur->next)
+    {
+      glibc_register_fork_handlers (cur);
+    }
 }
 
-
 void glibc_initialize (void)
 {
 //  void **(*fn) (void) = vdl_dl_error_catch_tsd;
@@ -261,6 +330,7 @@ do_glibc_patch (struct VdlFile *file)
     }
   // mark the file as patched
   file->patched = 1;
+  glibc_register_fork_handlers (file);
 
   struct VdlLookupResult result;
   result = vdl_lookup_local (file, "_dl_addr");
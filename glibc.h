@@ -6,10 +6,16 @@ struct VdlList;
 // Interfaces needed to make glibc be able to work when
 // loaded with this loader.
 
-// set _dl_starting_up to 1. Must be called
-// just before calling the executable's entry point.
+// set _dl_starting_up to 1 and register our fork handlers if
+// glibc_fork_handlers_enable was called.
+// Must be called just before calling the executable's entry point.
 void glibc_startup_finished (void);
 
+// The threads owned by the loader need fork handlers: once this is
+// called, they are registered with the libc of every namespace,
+// including the ones loaded later. The caller must hold g_vdl.futex.
+void glibc_fork_handlers_enable (void);
+
 void glibc_initialize (void);
 
 void glibc_patch (struct VdlList *files);
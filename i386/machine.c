@@ -7,10 +7,15 @@
 #include "vdl-config.h"
 #include "vdl-file.h"
 #include "vdl-mem.h"
+#include <stddef.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <asm/ldt.h>
 
+// resolv.S (___tls_get_addr) hardcodes these.
+_Static_assert (offsetof (struct Vdl, tls_gen) == 36, "update VDL_TLS_GEN_OFFSET in resolv.S");
+_Static_assert (CONFIG_TCB_DTV_OFFSET == 4, "update TCB_DTV_OFFSET in resolv.S");
+
 bool machine_reloc_is_relative (unsigned long reloc_type)
 {
   return reloc_type == R_386_RELATIVE;
@@ -19,6 +24,99 @@ bool machine_reloc_is_copy (unsigned long reloc_type)
 {
   return reloc_type == R_386_COPY;
 }
+bool machine_reloc_is_jump_slot (unsigned long reloc_type)
+{
+  return reloc_type == R_386_JMP_SLOT;
+}
+bool machine_reloc_is_tlsdesc (unsigned long reloc_type)
+{
+  // R_386_TLS_DESC is not supported.
+  return false;
+}
+void machine_reloc_relative_rel (unsigned long load_base,
+				 const ElfW(Rel) *rel, unsigned long n)
+{
+  // the addend is stored in place: B + A
+  unsigned long i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      *(unsigned long *)(load_base + rel[i].r_offset) += load_base;
+      *(unsigned long *)(load_base + rel[i+1].r_offset) += load_base;
+      *(unsigned long *)(load_base + rel[i+2].r_offset) += load_base;
+      *(unsigned long *)(load_base + rel[i+3].r_offset) += load_base;
+    }
+  for (; i < n; i++)
+    {
+      *(unsigned long *)(load_base + rel[i].r_offset) += load_base;
+    }
+}
+void machine_reloc_relative_rela (unsigned long load_base,
+				  const ElfW(Rela) *rela, unsigned long n)
+{
+  // B + A
+  unsigned long i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      *(unsigned long *)(load_base + rela[i].r_offset) = load_base + rela[i].r_addend;
+      *(unsigned long *)(load_base + rela[i+1].r_offset) = load_base + rela[i+1].r_addend;
+      *(unsigned long *)(load_base + rela[i+2].r_offset) = load_base + rela[i+2].r_addend;
+      *(unsigned long *)(load_base + rela[i+3].r_offset) = load_base + rela[i+3].r_addend;
+    }
+  for (; i < n; i++)
+    {
+      *(unsigned long *)(load_base + rela[i].r_offset) = load_base + rela[i].r_addend;
+    }
+}
+static void
+reloc_glob_dat (const struct VdlFile *file, unsigned long *reloc_addr,
+		unsigned long reloc_addend, unsigned long symbol_value)
+{
+  // i386 ABI formula: S
+  *reloc_addr = file->load_base + symbol_value;
+}
+static void
+reloc_32 (const struct VdlFile *file, unsigned long *reloc_addr,
+	  unsigned long reloc_addend, unsigned long symbol_value)
+{
+  // i386 ABI formula: S + A
+  *reloc_addr = file->load_base + symbol_value + reloc_addend;
+}
+static void
+reloc_tls_tpoff (const struct VdlFile *file, unsigned long *reloc_addr,
+		 unsigned long reloc_addend, unsigned long symbol_value)
+{
+  VDL_LOG_ASSERT (file->has_tls,
+		  "Module which contains target symbol does "
+		  "not have a TLS block ??");
+  *reloc_addr = file->tls_offset + symbol_value + reloc_addend;
+}
+static void
+reloc_tls_dtpmod32 (const struct VdlFile *file, unsigned long *reloc_addr,
+		    unsigned long reloc_addend, unsigned long symbol_value)
+{
+  VDL_LOG_ASSERT (file->has_tls,
+		  "Module which contains target symbol does "
+		  "not have a TLS block ??");
+  VDL_LOG_ASSERT (reloc_addend == 0, "i386 does not use addends for this reloc");
+  *reloc_addr = file->tls_index;
+}
+MachineRelocFunction machine_reloc_group (unsigned long reloc_type)
+{
+  switch (reloc_type)
+    {
+    case R_386_GLOB_DAT:
+    case R_386_JMP_SLOT:
+      return reloc_glob_dat;
+    case R_386_32:
+      return reloc_32;
+    case R_386_TLS_TPOFF:
+      return reloc_tls_tpoff;
+    case R_386_TLS_DTPMOD32:
+      return reloc_tls_dtpmod32;
+    default:
+      return 0;
+    }
+}
 void machine_reloc (const struct VdlFile *file,
 		    unsigned long *reloc_addr,
 		    unsigned long reloc_type,
@@ -33,17 +131,10 @@ void machine_reloc (const struct VdlFile *file,
 	*reloc_addr = file->load_base + reloc_addend;
 	break;
     case R_386_TLS_TPOFF:
-      VDL_LOG_ASSERT (file->has_tls,
-		      "Module which contains target symbol does "
-		      "not have a TLS block ??");
-      *reloc_addr = file->tls_offset + symbol_value + reloc_addend;
+      reloc_tls_tpoff (file, reloc_addr, reloc_addend, symbol_value);
       break;
     case R_386_TLS_DTPMOD32:
-      VDL_LOG_ASSERT (file->has_tls,
-		      "Module which contains target symbol does "
-		      "not have a TLS block ??");
-      VDL_LOG_ASSERT (reloc_addend == 0, "i386 does not use addends for this reloc");
-      *reloc_addr = file->tls_index;
+      reloc_tls_dtpmod32 (file, reloc_addr, reloc_addend, symbol_value);
       break;
     case R_386_TLS_DTPOFF32:
       VDL_LOG_ASSERT (file->has_tls,
@@ -53,12 +144,10 @@ void machine_reloc (const struct VdlFile *file,
       break;
     case R_386_GLOB_DAT:
     case R_386_JMP_SLOT:
-      // i386 ABI formula: S
-      *reloc_addr = file->load_base + symbol_value;
+      reloc_glob_dat (file, reloc_addr, reloc_addend, symbol_value);
       break;
     case R_386_32:
-      // i386 ABI formula: S + A
-      *reloc_addr = file->load_base + symbol_value + reloc_addend;
+      reloc_32 (file, reloc_addr, reloc_addend, symbol_value);
       break;
     default:
       VDL_LOG_ASSERT (0, "unhandled reloc type: %s", 
@@ -259,6 +348,14 @@ unsigned long machine_thread_pointer_get (void)
   return value;
 }
 
+int machine_thread_create (unsigned long stack_top, unsigned long tp,
+			   void (*fn) (void *), void *arg)
+{
+  // XXX: setting up the thread pointer of the new thread requires
+  // a user_desc for CLONE_SETTLS. Not implemented.
+  return -1;
+}
+
 uint32_t machine_atomic_compare_and_exchange (uint32_t *ptr, uint32_t old, uint32_t new)
 {
   uint32_t prev;
@@ -279,6 +376,12 @@ uint32_t machine_atomic_dec (uint32_t *ptr)
   return prev;
 }
 
+void machine_memory_barrier (void)
+{
+  // mfence requires sse2.
+  asm volatile ("lock; addl $0,(%%esp)" : : : "memory", "cc");
+}
+
 const char *
 machine_get_system_search_dirs (void)
 {
@@ -0,0 +1,91 @@
+#include "vdl-hashmap.h"
+#include "internal-test.h"
+#include <vector>
+
+static std::vector<long> get_values (struct VdlHashMap *map, uint32_t hash)
+{
+  std::vector<long> values;
+  void **i;
+  for (i = vdl_hashmap_find (map, hash); i != 0; i = vdl_hashmap_find_next (i))
+    {
+      values.push_back ((long)(*i));
+    }
+  return values;
+}
+
+static long g_sum = 0;
+static void sum (void *data)
+{
+  g_sum += (long)data;
+}
+
+bool test_hashmap (void)
+{
+  struct VdlHashMap *map = vdl_hashmap_new ();
+  INTERNAL_TEST_ASSERT (vdl_hashmap_empty (map));
+  INTERNAL_TEST_ASSERT (vdl_hashmap_find (map, 1) == 0);
+
+  // 16 and 32 collide in the initial table but are different keys.
+  vdl_hashmap_insert (map, 16, (void*)1);
+  vdl_hashmap_insert (map, 32, (void*)2);
+  vdl_hashmap_insert (map, 16, (void*)3);
+  vdl_hashmap_insert (map, 16, (void*)4);
+  INTERNAL_TEST_ASSERT_EQ (vdl_hashmap_size (map), 4);
+  std::vector<long> values = get_values (map, 16);
+  INTERNAL_TEST_ASSERT_EQ (values.size (), 3);
+  INTERNAL_TEST_ASSERT_EQ (values[0], 1);
+  INTERNAL_TEST_ASSERT_EQ (values[1], 3);
+  INTERNAL_TEST_ASSERT_EQ (values[2], 4);
+  values = get_values (map, 32);
+  INTERNAL_TEST_ASSERT_EQ (values.size (), 1);
+  INTERNAL_TEST_ASSERT_EQ (values[0], 2);
+
+  // force the table to grow a couple of times: order must be kept.
+  for (long j = 100; j < 1100; j++)
+    {
+      vdl_hashmap_insert (map, j % 37, (void*)j);
+    }
+  INTERNAL_TEST_ASSERT_EQ (vdl_hashmap_size (map), 1004);
+  values = get_values (map, 16);
+  INTERNAL_TEST_ASSERT_EQ (values[0], 1);
+  INTERNAL_TEST_ASSERT_EQ (values[1], 3);
+  INTERNAL_TEST_ASSERT_EQ (values[2], 4);
+  for (uint32_t k = 3; k < values.size (); k++)
+    {
+      INTERNAL_TEST_ASSERT (values[k] > values[k-1]);
+      INTERNAL_TEST_ASSERT_EQ (values[k] % 37, 16);
+    }
+
+  // remove from the head, the middle and the tail of a chain.
+  vdl_hashmap_remove (map, 16, (void*)1);
+  vdl_hashmap_remove (map, 16, (void*)4);
+  vdl_hashmap_remove (map, 16, (void*)(long)values.back ());
+  // removing something which is not there is a nop.
+  vdl_hashmap_remove (map, 17, (void*)3);
+  INTERNAL_TEST_ASSERT_EQ (vdl_hashmap_size (map), 1001);
+  std::vector<long> after = get_values (map, 16);
+  INTERNAL_TEST_ASSERT_EQ (after.size (), values.size () - 3);
+  INTERNAL_TEST_ASSERT_EQ (after[0], 3);
+  // appending after a tail removal must still work.
+  vdl_hashmap_insert (map, 16, (void*)5);
+  after = get_values (map, 16);
+  INTERNAL_TEST_ASSERT_EQ (after.back (), 5);
+
+  g_sum = 0;
+  vdl_hashmap_iterate (map, sum);
+  long expected = 2 + 3 + 5;
+  for (long j = 100; j < 1100; j++)
+    {
+      expected += j;
+    }
+  expected -= values.back ();
+  INTERNAL_TEST_ASSERT_EQ (g_sum, expected);
+
+  vdl_hashmap_clear (map);
+  INTERNAL_TEST_ASSERT (vdl_hashmap_empty (map));
+  INTERNAL_TEST_ASSERT (vdl_hashmap_find (map, 16) == 0);
+
+  vdl_hashmap_delete (map);
+
+  return true;
+}
@@ -4,6 +4,7 @@
 bool test_alloc (void);
 bool test_futex (void);
 bool test_list (void);
+bool test_hashmap (void);
 
 #define RUN_TEST(name)					\
   do {							\
@@ -19,6 +20,7 @@ int main (int argc, char *argv[])
   RUN_TEST (alloc);
   RUN_TEST (futex);
   RUN_TEST (list);
+  RUN_TEST (hashmap);
   return ok?0:1;
 }
 
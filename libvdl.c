@@ -53,6 +53,14 @@ EXPORT void dl_lmid_delete (Lmid_t lmid)
 {
   return vdl_dl_lmid_delete_public (lmid);
 }
+EXPORT Lmid_t dl_lmid_clone (Lmid_t lmid)
+{
+  return vdl_dl_lmid_clone_public (lmid);
+}
+EXPORT int dl_lmid_set_bind_policy (Lmid_t lmid, int policy)
+{
+  return vdl_dl_lmid_set_bind_policy_public (lmid, policy);
+}
 EXPORT int dl_lmid_add_callback (Lmid_t lmid, 
 				 void (*cb) (void *handle, int event, void *context),
 				 void *cb_context)
@@ -15,12 +15,34 @@ bool machine_reloc_is_relative (unsigned long reloc_type);
 // returns whether the type of reloc is a R_XXX_COPY relocation entry
 // the input to this function is the output of the ELFXX_TYPE macro.
 bool machine_reloc_is_copy (unsigned long reloc_type);
+// returns whether the type of reloc is a R_XXX_JUMP_SLOT relocation entry
+// the input to this function is the output of the ELFXX_TYPE macro.
+bool machine_reloc_is_jump_slot (unsigned long reloc_type);
+// returns whether the type of reloc is a TLS descriptor relocation 
+// entry, which writes two words: the function and its argument.
+bool machine_reloc_is_tlsdesc (unsigned long reloc_type);
 void machine_reloc (const struct VdlFile *file,
 		    unsigned long *reloc_addr,
 		    unsigned long reloc_type,
 		    unsigned long reloc_addend,
 		    unsigned long symbol_value,
 		    unsigned long symbol_type);
+// apply n relocations which are all of type R_XXX_RELATIVE, 
+// typically the leading DT_RELCOUNT/DT_RELACOUNT entries of 
+// dt_rel/dt_rela.
+void machine_reloc_relative_rel (unsigned long load_base,
+				 const ElfW(Rel) *rel, unsigned long n);
+void machine_reloc_relative_rela (unsigned long load_base,
+				  const ElfW(Rela) *rela, unsigned long n);
+// applies one relocation whose symbol is defined in file.
+typedef void (*MachineRelocFunction) (const struct VdlFile *file,
+				      unsigned long *reloc_addr,
+				      unsigned long reloc_addend,
+				      unsigned long symbol_value);
+// returns the function which applies the symbol relocations of
+// type reloc_type without going through machine_reloc or zero if
+// relocations of this type must go through machine_reloc.
+MachineRelocFunction machine_reloc_group (unsigned long reloc_type);
 const char *machine_reloc_type_to_str (unsigned long reloc_type);
 void machine_reloc_dynamic (ElfW(Dyn) *dyn, unsigned long load_base);
 bool machine_insert_trampoline (unsigned long from, unsigned long to, unsigned long from_size);
@@ -30,11 +52,18 @@ void machine_lazy_reloc (struct VdlFile *file);
 uint32_t machine_atomic_compare_and_exchange (uint32_t *val, uint32_t old, uint32_t new_value);
 // return old value
 uint32_t machine_atomic_dec (uint32_t *val);
+// order the memory accesses before and after the call.
+void machine_memory_barrier (void);
 const char *machine_get_system_search_dirs (void);
 const char *machine_get_lib (void);
 void *machine_system_mmap(void *start, size_t length, int prot, int flags, int fd, off_t offset);
 void machine_thread_pointer_set (unsigned long tp);
 unsigned long machine_thread_pointer_get (void);
+// start a thread which shares everything with the caller, runs 
+// fn(arg) on the stack which ends at stack_top with tp as thread 
+// pointer and exits when fn returns. Returns -1 on failure.
+int machine_thread_create (unsigned long stack_top, unsigned long tp,
+			   void (*fn) (void *), void *arg);
 
 long int machine_syscall1 (int name,
 			   unsigned long int a1);
@@ -6,7 +6,10 @@
 #include "futex.h"
 #include "vdl-alloc.h"
 #include "vdl-list.h"
+#include "vdl-hashmap.h"
 #include "vdl-utils.h"
+#include "vdl-reloc.h"
+#include "vdl-tls.h"
 #include "machine.h"
 #include <elf.h>
 #include <link.h>
@@ -88,10 +91,26 @@ static void global_initialize (unsigned long interpreter_load_base)
   vdl->tls_static_align = 0;
   vdl->tls_n_dtv = 0;
   vdl->tls_next_index = 1;
+  vdl->tls_free_indexes = 0;
+  vdl->tls_n_free_indexes = 0;
+  vdl->tls_free_indexes_size = 0;
+  vdl->tls_modules = 0;
+  vdl->tls_modules_size = 0;
+  vdl->tls_changes = 0;
+  vdl->tls_image = 0;
   vdl->futex = futex_new ();
   vdl->errors = vdl_list_new ();
   vdl->n_added = 0;
   vdl->n_removed = 0;
+  vdl->lookup_cache_size = 1024;
+  vdl->synth_hash = 0;
+  vdl->images = vdl_hashmap_new ();
+  vdl->ifunc_cache = 1;
+  vdl->bind_profile = 0;
+  vdl->uffd_reloc = 0;
+  vdl->direct_bind = 0;
+  vdl->resolve_cache = 0;
+  vdl->resolve_cache_only = 0;
 }
 
 
@@ -107,10 +126,14 @@ relocate_dt_rel (ElfW(Dyn) *dynamic, unsigned long load_base)
   ElfW(Rela) *dt_rela = 0;
   unsigned long dt_relasz = 0;
   unsigned long dt_relaent = 0;
-  // search DT_REL, DT_RELSZ, DT_RELENT, DT_RELA, DT_RELASZ, DT_RELAENT
+  ElfW(Addr) *dt_relr = 0;
+  unsigned long dt_relrsz = 0;
+  // search DT_REL, DT_RELSZ, DT_RELENT, DT_RELA, DT_RELASZ, DT_RELAENT,
+  // DT_RELR, DT_RELRSZ
   while (tmp->d_tag != DT_NULL && 
 	 (dt_rel == 0 || dt_relsz == 0 || dt_relent == 0 ||
-	  dt_rela == 0 || dt_relasz == 0 || dt_relaent == 0))
+	  dt_rela == 0 || dt_relasz == 0 || dt_relaent == 0 ||
+	  dt_relr == 0 || dt_relrsz == 0))
     {
       //DEBUG_HEX(tmp->d_tag);
       if (tmp->d_tag == DT_REL)
@@ -137,11 +160,25 @@ relocate_dt_rel (ElfW(Dyn) *dynamic, unsigned long load_base)
 	{
 	  dt_relaent = tmp->d_un.d_val;
 	}
+      else if (tmp->d_tag == DT_RELR)
+	{
+	  dt_relr = (ElfW(Addr) *)(load_base + tmp->d_un.d_ptr);
+	}
+      else if (tmp->d_tag == DT_RELRSZ)
+	{
+	  dt_relrsz = tmp->d_un.d_val;
+	}
       tmp++;
     }
   DPRINTF ("dt_rel=0x%x, dt_relsz=%d, dt_relent=%d, dt_rela=0x%x, dt_relasz=%d, dt_relaent=%d\n", 
 	   dt_rel, dt_relsz, dt_relent, dt_rela, dt_relasz, dt_relaent);
 
+  // relocate the packed entries of dt_relr. These are all relative.
+  if (dt_relr != 0)
+    {
+      vdl_reloc_relr (load_base, dt_relr, dt_relrsz);
+    }
+
   // relocate entries in dt_rel and dt_rela. 
   // since we are relocating the dynamic loader itself here,
   // the entries will always be of type R_XXX_RELATIVE.
@@ -201,6 +238,19 @@ void stage1_freeres (void)
   stage2_freeres ();
   vdl_utils_str_list_delete (g_vdl.search_dirs);
   vdl_list_delete (g_vdl.contexts);
+  vdl_hashmap_delete (g_vdl.images);
+  if (g_vdl.bind_profile != 0)
+    {
+      vdl_alloc_free (g_vdl.bind_profile);
+    }
+  if (g_vdl.resolve_cache != 0)
+    {
+      vdl_alloc_free (g_vdl.resolve_cache);
+    }
+  vdl_alloc_free (g_vdl.tls_free_indexes);
+  vdl_alloc_free (g_vdl.tls_modules);
+  vdl_alloc_free (g_vdl.tls_changes);
+  vdl_tls_image_delete ();
   futex_delete (g_vdl.futex);
   {
     void **i;
@@ -221,6 +271,9 @@ void stage1_freeres (void)
 
   g_vdl.search_dirs = 0;
   g_vdl.contexts = 0;
+  g_vdl.images = 0;
+  g_vdl.bind_profile = 0;
+  g_vdl.resolve_cache = 0;
   g_vdl.futex = 0;
   g_vdl.errors = 0;
 }
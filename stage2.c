@@ -22,6 +22,8 @@
 #include "vdl-unmap.h"
 #include "vdl-init.h"
 #include "vdl-fini.h"
+#include "vdl-lookup.h"
+#include "vdl-bind-profile.h"
 
 
 static unsigned long 
@@ -155,6 +157,57 @@ setup_env_vars (const char **envp)
     {
       g_vdl.bind_now = 1;
     }
+
+  // setup synth_hash from LD_SYNTH_HASH
+  const char *synth_hash = vdl_utils_getenv (envp, "LD_SYNTH_HASH");
+  if (synth_hash != 0)
+    {
+      g_vdl.synth_hash = 1;
+    }
+
+  // setup the size of the symbol lookup caches from LD_LOOKUP_CACHE_SIZE
+  const char *lookup_cache_size = vdl_utils_getenv (envp, "LD_LOOKUP_CACHE_SIZE");
+  if (lookup_cache_size != 0)
+    {
+      g_vdl.lookup_cache_size = vdl_utils_strtoul (lookup_cache_size);
+    }
+
+  // disable the IFUNC resolver cache if LD_NO_IFUNC_CACHE is set
+  const char *no_ifunc_cache = vdl_utils_getenv (envp, "LD_NO_IFUNC_CACHE");
+  if (no_ifunc_cache != 0)
+    {
+      g_vdl.ifunc_cache = 0;
+    }
+
+  // record and replay the PLT slots bound lazily in LD_BIND_PROFILE
+  const char *bind_profile = vdl_utils_getenv (envp, "LD_BIND_PROFILE");
+  if (bind_profile != 0 && *bind_profile != 0)
+    {
+      g_vdl.bind_profile = vdl_utils_strdup (bind_profile);
+    }
+
+  // relocate the writable pages on first touch if LD_UFFD_RELOC is set
+  const char *uffd_reloc = vdl_utils_getenv (envp, "LD_UFFD_RELOC");
+  if (uffd_reloc != 0)
+    {
+      g_vdl.uffd_reloc = 1;
+    }
+
+  // bind versioned references directly if LD_DIRECT_BIND is set
+  const char *direct_bind = vdl_utils_getenv (envp, "LD_DIRECT_BIND");
+  if (direct_bind != 0)
+    {
+      g_vdl.direct_bind = 1;
+    }
+
+  // read and write the relocation plans in LD_RESOLVE_CACHE
+  const char *resolve_cache = vdl_utils_getenv (envp, "LD_RESOLVE_CACHE");
+  if (resolve_cache != 0 && *resolve_cache != 0)
+    {
+      g_vdl.resolve_cache = vdl_utils_strdup (resolve_cache);
+      // set by vdl-prelink
+      g_vdl.resolve_cache_only = vdl_utils_getenv (envp, "LD_RESOLVE_CACHE_ONLY") != 0;
+    }
 }
 
 struct Stage2Output
@@ -191,6 +244,11 @@ stage2_initialize (struct Stage2Input input)
   // let's make sure that LD_PRELOAD binaries and their dependencies are loaded.
   struct VdlList *ld_preload;
   ld_preload = ld_preload_list_new (context, (const char **)input.program_envp);
+  if (vdl_list_size (ld_preload) != 0)
+    {
+      // direct binding would bypass the interposers.
+      g_vdl.direct_bind = 0;
+    }
 
   // Now, Let's do the main binary.
   struct VdlMapResult main_result;
@@ -228,19 +286,23 @@ stage2_initialize (struct Stage2Input input)
   // it does not contain the interpreter (unless, of course, it
   // is a dependency of the main binary or one of the ld_preloaded
   // binaries.
-  vdl_list_push_back (context->global_scope, main_file);
+  struct VdlList *global_scope = vdl_list_new ();
+  vdl_list_push_back (global_scope, main_file);
   // of course, the ld_preload binaries must be in there if needed.
-  vdl_list_insert_range (context->global_scope,
-			 vdl_list_end (context->global_scope),
+  vdl_list_insert_range (global_scope,
+			 vdl_list_end (global_scope),
 			 vdl_list_begin (ld_preload),
 			 vdl_list_end (ld_preload));
   struct VdlList *all_deps = vdl_sort_deps_breadth_first (main_file);
-  vdl_list_insert_range (context->global_scope,
-			 vdl_list_end (context->global_scope),
+  vdl_list_insert_range (global_scope,
+			 vdl_list_end (global_scope),
 			 vdl_list_begin (all_deps),
 			 vdl_list_end (all_deps));
   vdl_list_delete (all_deps);
-  vdl_list_unicize (context->global_scope);
+  vdl_context_global_scope_append (context,
+				   vdl_list_begin (global_scope),
+				   vdl_list_end (global_scope));
+  vdl_list_delete (global_scope);
 
   vdl_list_delete (ld_preload);
 
@@ -254,6 +316,11 @@ stage2_initialize (struct Stage2Input input)
   // We either setup the GOT for lazy symbol resolution
   // or we perform binding for all symbols now if LD_BIND_NOW is set
   vdl_reloc (context->loaded, g_vdl.bind_now);
+  if (g_vdl.resolve_cache_only)
+    {
+      // the plans were saved by vdl_reloc: we are done.
+      system_exit (0);
+    }
 
   // Once relocations are done, we can initialize the tls blocks
   // and the dtv. We need to wait post-reloc because the tls
@@ -351,6 +418,15 @@ stage2_finalize (void)
   futex_lock (g_vdl.futex);
 
   vdl_list_delete (locked);
+
+  void **cur;
+  for (cur = vdl_list_begin (g_vdl.contexts); 
+       cur != vdl_list_end (g_vdl.contexts); 
+       cur = vdl_list_next (cur))
+    {
+      vdl_lookup_cache_print_stats (*cur);
+    }
+  vdl_bind_profile_save_all ();
   futex_unlock (g_vdl.futex);
 
 }
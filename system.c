@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <sys/param.h> // for EXEC_PAGESIZE
 #include <linux/futex.h>
+#include <signal.h> // for SIG_SETMASK
 
 /* The magic checks below for -256 are probably misterious to non-kernel programmers:
  * they come from the fact that we call the raw system calls, not the libc wrappers
@@ -37,9 +38,42 @@ int system_mprotect (const void *addr, size_t len, int prot)
     }
   return status;
 }
-void system_write (int fd, const void *buf, size_t size)
+void *system_mremap_fixed (void *old_address, size_t size, void *new_address)
 {
-  MACHINE_SYSCALL3(write,fd,buf,size);
+  long int status = MACHINE_SYSCALL6 (mremap, old_address, size, size,
+				      MREMAP_MAYMOVE | MREMAP_FIXED, new_address, 0);
+  if (status < 0 && status > -4095)
+    {
+      return MAP_FAILED;
+    }
+  return (void*)status;
+}
+int system_ioctl (int fd, unsigned long request, void *arg)
+{
+  int status = MACHINE_SYSCALL3 (ioctl, fd, request, arg);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
+}
+int system_userfaultfd (int flags)
+{
+  int status = MACHINE_SYSCALL1 (userfaultfd, flags);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
+}
+int system_write (int fd, const void *buf, size_t size)
+{
+  int status = MACHINE_SYSCALL3(write,fd,buf,size);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
 }
 int system_open_ro (const char *file)
 {
@@ -50,6 +84,15 @@ int system_open_ro (const char *file)
     }
   return status;
 }
+int system_open (const char *file, int flags, mode_t mode)
+{
+  int status = MACHINE_SYSCALL3 (open,file,flags,mode);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
+}
 int system_read (int fd, void *buffer, size_t to_read)
 {
   int status = MACHINE_SYSCALL3 (read, fd, buffer, to_read);
@@ -81,6 +124,29 @@ void system_close (int fd)
 {
   MACHINE_SYSCALL1 (close,fd);
 }
+int system_rename (const char *oldpath, const char *newpath)
+{
+  int status = MACHINE_SYSCALL2 (rename,oldpath,newpath);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
+}
+int system_unlink (const char *file)
+{
+  int status = MACHINE_SYSCALL1 (unlink,file);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
+}
+int system_getpid (void)
+{
+  // getpid takes no argument: the kernel ignores this one.
+  return MACHINE_SYSCALL1 (getpid, 0);
+}
 void system_exit (int status)
 {
   MACHINE_SYSCALL1 (exit, status);
@@ -100,3 +166,16 @@ void system_futex_wait (uint32_t *uaddr, uint32_t val)
 {
   MACHINE_SYSCALL6 (futex, uaddr, FUTEX_WAIT, val, 0, 0, 0);
 }
+int system_gettimeofday (struct timeval *tv)
+{
+  int status = MACHINE_SYSCALL2 (gettimeofday, tv, 0);
+  if (status < 0 && status > -256)
+    {
+      return -1;
+    }
+  return status;
+}
+void system_sigprocmask (const uint64_t *set, uint64_t *oldset)
+{
+  MACHINE_SYSCALL6 (rt_sigprocmask, SIG_SETMASK, set, oldset, sizeof (*set), 0, 0);
+}
@@ -11,15 +11,27 @@
 void *system_mmap(void *start, size_t length, int prot, int flags, int fd, off_t offset);
 int system_munmap (uint8_t *start, size_t size);
 int system_mprotect (const void *addr, size_t len, int prot);
-void system_write (int fd, const void *buf, size_t size);
+// move the pages of [old_address,old_address+size) at new_address
+void *system_mremap_fixed (void *old_address, size_t size, void *new_address);
+int system_ioctl (int fd, unsigned long request, void *arg);
+int system_userfaultfd (int flags);
+int system_write (int fd, const void *buf, size_t size);
 int system_open_ro (const char *file);
+int system_open (const char *file, int flags, mode_t mode);
 int system_read (int fd, void *buffer, size_t to_read);
 int system_lseek (int fd, off_t offset, int whence);
 int system_fstat (const char *file, struct stat *buf);
 void system_close (int fd);
+int system_rename (const char *oldpath, const char *newpath);
+int system_unlink (const char *file);
+int system_getpid (void);
 void system_exit (int status);
 int system_getpagesize (void);
 void system_futex_wake (uint32_t *uaddr, uint32_t val);
 void system_futex_wait (uint32_t *uaddr, uint32_t val);
+int system_gettimeofday (struct timeval *tv);
+// set the signal mask of the calling thread to *set and store the old
+// one in *oldset if it is not zero.
+void system_sigprocmask (const uint64_t *set, uint64_t *oldset);
 
 #endif /* SYSTEM_H */
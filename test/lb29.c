@@ -0,0 +1,14 @@
+#include "test.h"
+
+LIB(lb29);
+
+// built with -mtls-dialect=gnu2: accessed through TLS descriptors.
+__thread int g_lb29_counter = 5;
+static __thread int g_lb29_local[4];
+
+int lb29_increment (void)
+{
+  g_lb29_local[1] += 2;
+  g_lb29_counter++;
+  return g_lb29_counter + g_lb29_local[1];
+}
@@ -0,0 +1,28 @@
+#include <string.h>
+
+#define PAGE_SIZE 4096
+
+// each element is on its own page and holds pointers which are
+// the target of relocations.
+struct UPage
+{
+  const char *str;
+  int *value;
+  size_t (*len) (const char *);
+  char pad[PAGE_SIZE - 3 * sizeof (void*)];
+};
+
+static int g_values[4] = {1, 2, 3, 4};
+
+struct UPage g_libu_pages[4] __attribute__ ((aligned (PAGE_SIZE))) = {
+  {"page0", &g_values[0], strlen},
+  {"page1", &g_values[1], strlen},
+  {"page2", &g_values[2], strlen},
+  {"page3", &g_values[3], strlen},
+};
+
+int libu_check (int i)
+{
+  return *g_libu_pages[i].value == i + 1 &&
+    g_libu_pages[i].len (g_libu_pages[i].str) == 5;
+}
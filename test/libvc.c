@@ -0,0 +1,13 @@
+int libv_who (void);
+int libv_main (void);
+
+// both references require VERS_1 from libvt.so
+int libvc_who (void)
+{
+  return libv_who ();
+}
+
+int libvc_main (void)
+{
+  return libv_main ();
+}
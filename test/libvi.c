@@ -0,0 +1,6 @@
+// comes before libvt.so in the global scope of test37
+
+int libv_who (void)
+{
+  return 2;
+}
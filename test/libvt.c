@@ -0,0 +1,11 @@
+// the definitions named by the version requirements of libvc.so
+
+int libv_who (void)
+{
+  return 1;
+}
+
+int libv_main (void)
+{
+  return 1;
+}
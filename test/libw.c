@@ -0,0 +1,7 @@
+int libq_set_global (int new_value);
+
+// calls libq.so through the PLT.
+int libw_swap (int new_value)
+{
+  return libq_set_global (new_value);
+}
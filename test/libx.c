@@ -0,0 +1,34 @@
+// built with -z pack-relative-relocs: the relative relocations of
+// this file are stored in DT_RELR.
+
+static int g_targets[128];
+
+#define P1(i) &g_targets[i]
+#define P4(i) P1 (i), P1 (i + 1), P1 (i + 2), P1 (i + 3)
+#define P16(i) P4 (i), P4 (i + 4), P4 (i + 8), P4 (i + 12)
+#define P64(i) P16 (i), P16 (i + 16), P16 (i + 32), P16 (i + 48)
+
+// consecutive pointers: an address entry followed by bitmap entries.
+int *libx_dense[100] = {P64 (0), P16 (64), P16 (80), P4 (96)};
+
+// every other word: bitmap entries with holes.
+int *libx_holes[40] = {
+  P1 (0), 0, P1 (1), 0, P1 (2), 0, P1 (3), 0, P1 (4), 0,
+  P1 (5), 0, P1 (6), 0, P1 (7), 0, P1 (8), 0, P1 (9), 0,
+  P1 (10), 0, P1 (11), 0, P1 (12), 0, P1 (13), 0, P1 (14), 0,
+  P1 (15), 0, P1 (16), 0, P1 (17), 0, P1 (18), 0, P1 (19), 0,
+};
+
+// pointers too far apart to share a bitmap: one address entry each.
+struct XSparse
+{
+  int *ptr;
+  long pad[80];
+};
+struct XSparse libx_sparse[4] = {{P1 (0)}, {P1 (1)}, {P1 (2)}, {P1 (3)}};
+
+// computed without relocation
+int *libx_target (int i)
+{
+  return &g_targets[i];
+}
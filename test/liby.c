@@ -0,0 +1,8 @@
+// linked with --hash-style=sysv: this file has no DT_GNU_HASH.
+
+int liby_value = 7;
+
+int liby_get (void)
+{
+  return liby_value;
+}
@@ -0,0 +1,81 @@
+#define _GNU_SOURCE 1
+#include "test.h"
+#include <dlfcn.h>
+#include <stdio.h>
+LIB(test27)
+
+typedef int (*Fn) (int);
+typedef Lmid_t (*LmidClone) (Lmid_t);
+typedef int (*LmidAddCallback) (Lmid_t, void (*) (void *, int, void *), void *);
+
+static int g_destroyed = 0;
+static void
+callback (void *handle, int event, void *context)
+{
+  if (event == 3)
+    {
+      g_destroyed++;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+  void *vdl = dlopen ("libvdl.so", RTLD_LAZY);
+  LmidClone clone = (LmidClone) dlsym (vdl, "dl_lmid_clone");
+  LmidAddCallback add_callback = (LmidAddCallback) dlsym (vdl, "dl_lmid_add_callback");
+  if (clone == 0 || add_callback == 0)
+    {
+      printf ("could not find dl_lmid_clone\n");
+      return 0;
+    }
+  void *h1 = dlmopen (LM_ID_NEWLM, "libp.so", RTLD_LAZY);
+  Fn fp1 = dlsym (h1, "libp_set_global");
+  Fn fq1 = dlsym (h1, "libq_set_global");
+  // the value of global variables is not cloned.
+  fp1 (5);
+  Lmid_t lmid1;
+  dlinfo (h1, RTLD_DI_LMID, &lmid1);
+  // the second reference of the source namespace is not cloned.
+  void *h1_again = dlmopen (lmid1, "libp.so", RTLD_LAZY);
+  Lmid_t lmid2 = clone (lmid1);
+  if (lmid2 != 0 && lmid2 != lmid1)
+    {
+      printf ("cloned lmid\n");
+    }
+  add_callback (lmid2, callback, 0);
+  void *h2 = dlmopen (lmid2, "libp.so", RTLD_LAZY);
+  if (h2 != 0 && h2 != h1)
+    {
+      printf ("found libp.so in clone\n");
+    }
+  Fn fp2 = dlsym (h2, "libp_set_global");
+  Fn fq2 = dlsym (h2, "libq_set_global");
+  if (fp2 != fp1 && fq2 != fq1 &&
+      fp2 (-1) == 0 &&
+      fp1 (1) == 5 &&
+      fq2 (-2) == 0 &&
+      fq1 (3) == 0 &&
+      fq2 (0) == -2)
+    {
+      printf ("clone has separate symbols and global variables\n");
+    }
+  if (clone (LM_ID_BASE) == 0)
+    {
+      printf ("can't clone main namespace\n");
+    }
+
+  // the clone holds one reference to libp.so and
+  // our dlmopen added another one.
+  dlclose (h2);
+  int destroyed = g_destroyed;
+  dlclose (h2);
+  if (destroyed == 0 && g_destroyed != 0)
+    {
+      printf ("clone released libp.so\n");
+    }
+  dlclose (h1_again);
+  dlclose (h1);
+  dlclose (vdl);
+
+  return 0;
+}
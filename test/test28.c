@@ -0,0 +1,44 @@
+#define _GNU_SOURCE 1
+#include "test.h"
+#include <dlfcn.h>
+#include <stdio.h>
+LIB(test28)
+
+typedef int (*Fn) (int);
+typedef Lmid_t (*LmidNew) (int, char **, char **);
+typedef int (*LmidSetBindPolicy) (Lmid_t, int);
+
+int main (int argc, char *argv[], char *envp[])
+{
+  void *vdl = dlopen ("libvdl.so", RTLD_LAZY);
+  LmidNew lmid_new = (LmidNew) dlsym (vdl, "dl_lmid_new");
+  LmidSetBindPolicy set_bind_policy = (LmidSetBindPolicy) dlsym (vdl, "dl_lmid_set_bind_policy");
+  if (lmid_new == 0 || set_bind_policy == 0)
+    {
+      printf ("could not find dl_lmid_set_bind_policy\n");
+      return 0;
+    }
+  Lmid_t lmid = lmid_new (argc, argv, envp);
+  if (set_bind_policy (lmid, 1) == 0)
+    {
+      printf ("set bind now policy\n");
+    }
+  if (set_bind_policy (lmid, 42) == -1)
+    {
+      printf ("invalid policy rejected\n");
+    }
+  // the PLT slots of libp.so are bound before dlmopen returns
+  void *h = dlmopen (lmid, "libp.so", RTLD_LAZY);
+  Fn fp = dlsym (h, "libp_set_global");
+  Fn fq = dlsym (h, "libq_set_global");
+  if (fp != 0 && fq != 0 &&
+      fp (2) == 0 && fp (0) == 2 &&
+      fq (3) == 0 && fq (0) == 3)
+    {
+      printf ("libp.so works in bind now namespace\n");
+    }
+  dlclose (h);
+  dlclose (vdl);
+
+  return 0;
+}
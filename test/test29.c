@@ -0,0 +1,28 @@
+#include "test.h"
+#include <dlfcn.h>
+#include <pthread.h>
+LIB(test29);
+
+typedef int (*Increment) (void);
+static Increment g_increment;
+
+static void *thread (void *ctx)
+{
+  printf ("thread %d\n", g_increment ());
+  printf ("thread %d\n", g_increment ());
+  return 0;
+}
+
+int main (int argc, char *argv[])
+{
+  void *h = dlopen ("lb29.so", RTLD_LAZY);
+  g_increment = (Increment) dlsym (h, "lb29_increment");
+  printf ("main %d\n", g_increment ());
+  printf ("main %d\n", g_increment ());
+  pthread_t th;
+  pthread_create (&th, 0, thread, 0);
+  pthread_join (th, 0);
+  printf ("main %d\n", g_increment ());
+  dlclose (h);
+  return 0;
+}
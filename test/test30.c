@@ -0,0 +1,36 @@
+#include "test.h"
+#include <dlfcn.h>
+#include <pthread.h>
+LIB(test30);
+
+// each dlopen of libi.so reuses the tls module index released
+// by the previous dlclose.
+static void *thread (void *ctx)
+{
+  int i;
+  for (i = 0; i < 100; i++)
+    {
+      void *h = dlopen ("libi.so", RTLD_LAZY);
+      int *(*get_i) (void) = (int *(*) (void)) dlsym (h, "get_i");
+      int *p = get_i ();
+      if (p[0] != 1 || p[1] != 1 || p[2] != 0)
+	{
+	  printf ("bad tls block %d\n", i);
+	}
+      p[0] = 3;
+      p[2] = 4;
+      dlclose (h);
+    }
+  return 0;
+}
+
+int main (int argc, char *argv[])
+{
+  thread (0);
+  printf ("main done\n");
+  pthread_t th;
+  pthread_create (&th, 0, thread, 0);
+  pthread_join (th, 0);
+  printf ("thread done\n");
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "test.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+LIB(test31)
+
+typedef int (*Check) (int);
+
+int main (int argc, char *argv[])
+{
+  if (getenv ("LD_UFFD_RELOC") == 0)
+    {
+      // the loader reads LD_UFFD_RELOC only at startup.
+      setenv ("LD_UFFD_RELOC", "1", 1);
+      execv ("/proc/self/exe", argv);
+      return 1;
+    }
+  void *h = dlopen ("libu.so", RTLD_LAZY);
+  char *pages = dlsym (h, "g_libu_pages");
+  Check check = (Check) dlsym (h, "libu_check");
+
+  // the first access to page 3 is done by the kernel.
+  int fds[2];
+  char buffer[2 * sizeof (void*)];
+  if (pipe (fds) == 0 &&
+      write (fds[1], pages + 3 * 4096, sizeof (buffer)) == sizeof (buffer) &&
+      read (fds[0], buffer, sizeof (buffer)) == sizeof (buffer) &&
+      memcmp (buffer, pages + 3 * 4096, sizeof (buffer)) == 0 &&
+      check (3))
+    {
+      printf ("kernel access ok\n");
+    }
+  if (check (0))
+    {
+      printf ("page 0 ok\n");
+    }
+  // pages 1 and 2 are first touched after fork.
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      _exit ((check (1) && check (2))?0:1);
+    }
+  int status;
+  if (waitpid (pid, &status, 0) == pid &&
+      WIFEXITED (status) && WEXITSTATUS (status) == 0)
+    {
+      printf ("child ok\n");
+    }
+  if (check (1) && check (2))
+    {
+      printf ("parent ok\n");
+    }
+  dlclose (h);
+  return 0;
+}
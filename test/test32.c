@@ -0,0 +1,136 @@
+#define _GNU_SOURCE 1
+#include "test.h"
+#include <dlfcn.h>
+#include <link.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+LIB(test32)
+
+#if __ELF_NATIVE_CLASS == 64
+#define REL_SYM(info) ELF64_R_SYM (info)
+#else
+#define REL_SYM(info) ELF32_R_SYM (info)
+#endif
+
+typedef int (*Fn) (int);
+typedef Lmid_t (*LmidNew) (int, char **, char **);
+typedef int (*LmidSetBindPolicy) (Lmid_t, int);
+
+static unsigned long
+dyn_ptr (struct link_map *map, ElfW(Addr) ptr)
+{
+  // some loaders relocate the pointers of the dynamic section.
+  return (ptr >= map->l_addr)?ptr:ptr + map->l_addr;
+}
+
+// the PLT slot of the object of handle which holds the address of name
+static unsigned long *
+plt_slot (void *handle, const char *name)
+{
+  struct link_map *map;
+  if (handle == 0 || dlinfo (handle, RTLD_DI_LINKMAP, &map) != 0)
+    {
+      return 0;
+    }
+  const ElfW(Sym) *symtab = 0;
+  const char *strtab = 0;
+  unsigned long jmprel = 0, pltrelsz = 0, pltrel = 0;
+  ElfW(Dyn) *dyn;
+  for (dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++)
+    {
+      switch (dyn->d_tag)
+	{
+	case DT_SYMTAB:
+	  symtab = (const ElfW(Sym) *)dyn_ptr (map, dyn->d_un.d_ptr);
+	  break;
+	case DT_STRTAB:
+	  strtab = (const char *)dyn_ptr (map, dyn->d_un.d_ptr);
+	  break;
+	case DT_JMPREL:
+	  jmprel = dyn_ptr (map, dyn->d_un.d_ptr);
+	  break;
+	case DT_PLTRELSZ:
+	  pltrelsz = dyn->d_un.d_val;
+	  break;
+	case DT_PLTREL:
+	  pltrel = dyn->d_un.d_val;
+	  break;
+	}
+    }
+  unsigned long entsize = (pltrel == DT_RELA)?sizeof (ElfW(Rela)):sizeof (ElfW(Rel));
+  unsigned long i;
+  for (i = 0; symtab != 0 && strtab != 0 && jmprel != 0 && i < pltrelsz / entsize; i++)
+    {
+      // r_offset and r_info come first in both Rel and Rela.
+      const ElfW(Rel) *rel = (const ElfW(Rel) *)(jmprel + i * entsize);
+      if (strcmp (strtab + symtab[REL_SYM (rel->r_info)].st_name, name) == 0)
+	{
+	  return (unsigned long *)(map->l_addr + rel->r_offset);
+	}
+    }
+  return 0;
+}
+
+int main (int argc, char *argv[], char *envp[])
+{
+  void *vdl = dlopen ("libvdl.so", RTLD_LAZY);
+  LmidNew lmid_new = (LmidNew) dlsym (vdl, "dl_lmid_new");
+  LmidSetBindPolicy set_bind_policy = (LmidSetBindPolicy) dlsym (vdl, "dl_lmid_set_bind_policy");
+  if (lmid_new == 0 || set_bind_policy == 0)
+    {
+      printf ("could not find dl_lmid_set_bind_policy\n");
+      return 0;
+    }
+  Lmid_t lmid = lmid_new (argc, argv, envp);
+  if (set_bind_policy (lmid, 2) == 0)
+    {
+      printf ("set background bind policy\n");
+    }
+  // the PLT slots of libw.so are bound by the loader thread while
+  // we call through them.
+  void *h = dlmopen (lmid, "libw.so", RTLD_LAZY);
+  Fn swap = dlsym (h, "libw_swap");
+  // nothing called libq_set_global yet: with lazy binding, its slot
+  // in libw.so would stay unbound. Give the loader thread 10s to
+  // bind it.
+  unsigned long *slot = plt_slot (h, "libq_set_global");
+  void *target = dlsym (h, "libq_set_global");
+  int wait;
+  for (wait = 0; slot != 0 && *slot != (unsigned long)target && wait < 1000; wait++)
+    {
+      usleep (10000);
+    }
+  if (slot != 0 && target != 0 && *slot == (unsigned long)target)
+    {
+      printf ("libw.so bound by the loader thread\n");
+    }
+  if (swap != 0 && swap (2) == 0 && swap (3) == 2)
+    {
+      printf ("libw.so works in background bind namespace\n");
+    }
+  // the loader thread might hold the loader lock when we fork:
+  // the children must still be able to load files.
+  int i, ok = 1;
+  for (i = 0; i < 20; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+	{
+	  void *r = dlopen ("libr.so", RTLD_NOW);
+	  _exit ((r != 0 && dlclose (r) == 0 && swap (4) == 3)?0:1);
+	}
+      int status;
+      ok = ok && waitpid (pid, &status, 0) == pid &&
+	WIFEXITED (status) && WEXITSTATUS (status) == 0;
+    }
+  if (ok)
+    {
+      printf ("fork ok\n");
+    }
+  dlclose (h);
+  dlclose (vdl);
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "test.h"
+#include <dlfcn.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+LIB(test33)
+
+typedef int (*Swap) (int);
+
+static char g_dir[] = "/tmp/vdl-test33-XXXXXX";
+static char g_cache[sizeof (g_dir) + 16];
+static char g_exe[4096];
+
+static int
+copy (const char *from, const char *to)
+{
+  char buffer[4096];
+  int in = open (from, O_RDONLY);
+  int out = open (to, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+  int ok = in != -1 && out != -1;
+  ssize_t n;
+  while (ok && (n = read (in, buffer, sizeof (buffer))) > 0)
+    {
+      ok = write (out, buffer, n) == n;
+    }
+  close (in);
+  close (out);
+  return ok;
+}
+
+// return the number of cache files of the file path, one per
+// lookup scope, and the inode of one of them in *ino.
+static int
+cache_files (const char *path, ino_t *ino)
+{
+  struct stat st;
+  if (stat (path, &st) == -1)
+    {
+      return 0;
+    }
+  const char *basename = strrchr (path, '/');
+  basename = (basename == 0)?path:basename + 1;
+  char prefix[4096];
+  snprintf (prefix, sizeof (prefix), "%s-%lx-", basename, (unsigned long)st.st_ino);
+  DIR *dir = opendir (g_cache);
+  if (dir == 0)
+    {
+      return 0;
+    }
+  int n = 0;
+  struct dirent *entry;
+  while ((entry = readdir (dir)) != 0)
+    {
+      const char *suffix = strrchr (entry->d_name, '.');
+      if (strncmp (entry->d_name, prefix, strlen (prefix)) == 0 &&
+	  suffix != 0 && strcmp (suffix, ".resolve") == 0)
+	{
+	  *ino = entry->d_ino;
+	  n++;
+	}
+    }
+  closedir (dir);
+  return n;
+}
+
+// run argv with the output of the child discarded and
+// return true if it succeeded.
+static int
+run (char *argv[])
+{
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      int null = open ("/dev/null", O_WRONLY);
+      dup2 (null, 1);
+      execv (argv[0], argv);
+      _exit (1);
+    }
+  int status;
+  return waitpid (pid, &status, 0) == pid &&
+    WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+static int
+run_child (void)
+{
+  char *argv[] = {g_exe, "child", 0};
+  return run (argv);
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc > 1 && strcmp (argv[1], "child") == 0)
+    {
+      // libw.so and libq.so are found in the temporary directory.
+      void *h = dlopen ("libw.so", RTLD_LAZY);
+      if (h == 0)
+	{
+	  return 1;
+	}
+      Swap swap = (Swap) dlsym (h, "libw_swap");
+      swap (5);
+      int ok = swap (6) == 5;
+      dlclose (h);
+      return ok?0:1;
+    }
+  ssize_t len = readlink ("/proc/self/exe", g_exe, sizeof (g_exe) - 1);
+  if (len <= 0 || mkdtemp (g_dir) == 0)
+    {
+      return 1;
+    }
+  g_exe[len] = 0;
+  snprintf (g_cache, sizeof (g_cache), "%s/cache", g_dir);
+  char libw[sizeof (g_dir) + 16], libq[sizeof (g_dir) + 16];
+  snprintf (libw, sizeof (libw), "%s/libw.so", g_dir);
+  snprintf (libq, sizeof (libq), "%s/libq.so", g_dir);
+  mkdir (g_cache, 0755);
+  copy ("libw.so", libw);
+  copy ("libq.so", libq);
+  const char *path = getenv ("LD_LIBRARY_PATH");
+  char *library_path = malloc (strlen (g_dir) + (path?strlen (path):0) + 2);
+  sprintf (library_path, "%s:%s", g_dir, path?path:"");
+  // the loader reads these only at startup: they are used by the
+  // children we run below.
+  setenv ("LD_LIBRARY_PATH", library_path, 1);
+  setenv ("LD_RESOLVE_CACHE", g_cache, 1);
+
+  char *prelink[] = {"../vdl-prelink", g_cache, g_exe, "child", 0};
+  ino_t exe = 0, first = 0, cur = 0;
+  if (run (prelink) && cache_files (g_exe, &exe) == 1)
+    {
+      printf ("prelink ok\n");
+    }
+  if (run_child () && cache_files (g_exe, &cur) == 1 && cur == exe &&
+      cache_files (libw, &first) == 1)
+    {
+      // the plan of the program was replayed, the one of
+      // libw.so was recorded.
+      printf ("record ok\n");
+    }
+  if (run_child () && cache_files (libw, &cur) == 1 && cur == first)
+    {
+      printf ("replay ok\n");
+    }
+  // change the mtime of a dependency of libw.so
+  struct stat st;
+  struct timeval times[2];
+  if (stat (libq, &st) == 0)
+    {
+      times[0].tv_sec = times[1].tv_sec = st.st_mtime - 100;
+      times[0].tv_usec = times[1].tv_usec = 0;
+      utimes (libq, times);
+    }
+  // the scope of libw.so changed: a new plan is recorded
+  // next to the old one.
+  if (run_child () && cache_files (libw, &cur) == 2)
+    {
+      printf ("reject ok\n");
+    }
+
+  char cmd[sizeof (g_dir) + 16];
+  snprintf (cmd, sizeof (cmd), "rm -rf %s", g_dir);
+  free (library_path);
+  return system (cmd);
+}
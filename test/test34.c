@@ -0,0 +1,155 @@
+#define _GNU_SOURCE 1
+#include "test.h"
+#include <dlfcn.h>
+#include <link.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+LIB(test34)
+
+#if __ELF_NATIVE_CLASS == 64
+#define REL_SYM(info) ELF64_R_SYM (info)
+#else
+#define REL_SYM(info) ELF32_R_SYM (info)
+#endif
+
+int libw_swap (int new_value);
+
+static char g_dir[] = "/tmp/vdl-test34-XXXXXX";
+static char g_exe[4096];
+
+static unsigned long
+dyn_ptr (struct link_map *map, ElfW(Addr) ptr)
+{
+  // some loaders relocate the pointers of the dynamic section.
+  return (ptr >= map->l_addr)?ptr:ptr + map->l_addr;
+}
+
+// the PLT slot of the main binary which holds the address of name
+static unsigned long *
+plt_slot (const char *name)
+{
+  void *self = dlopen (0, RTLD_LAZY);
+  struct link_map *map;
+  if (self == 0 || dlinfo (self, RTLD_DI_LINKMAP, &map) != 0)
+    {
+      return 0;
+    }
+  const ElfW(Sym) *symtab = 0;
+  const char *strtab = 0;
+  unsigned long jmprel = 0, pltrelsz = 0, pltrel = 0;
+  ElfW(Dyn) *dyn;
+  for (dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++)
+    {
+      switch (dyn->d_tag)
+	{
+	case DT_SYMTAB:
+	  symtab = (const ElfW(Sym) *)dyn_ptr (map, dyn->d_un.d_ptr);
+	  break;
+	case DT_STRTAB:
+	  strtab = (const char *)dyn_ptr (map, dyn->d_un.d_ptr);
+	  break;
+	case DT_JMPREL:
+	  jmprel = dyn_ptr (map, dyn->d_un.d_ptr);
+	  break;
+	case DT_PLTRELSZ:
+	  pltrelsz = dyn->d_un.d_val;
+	  break;
+	case DT_PLTREL:
+	  pltrel = dyn->d_un.d_val;
+	  break;
+	}
+    }
+  unsigned long entsize = (pltrel == DT_RELA)?sizeof (ElfW(Rela)):sizeof (ElfW(Rel));
+  unsigned long i;
+  for (i = 0; symtab != 0 && strtab != 0 && jmprel != 0 && i < pltrelsz / entsize; i++)
+    {
+      // r_offset and r_info come first in both Rel and Rela.
+      const ElfW(Rel) *rel = (const ElfW(Rel) *)(jmprel + i * entsize);
+      if (strcmp (strtab + symtab[REL_SYM (rel->r_info)].st_name, name) == 0)
+	{
+	  return (unsigned long *)(map->l_addr + rel->r_offset);
+	}
+    }
+  return 0;
+}
+
+// return 0 if the slot of libw_swap is bound before its first call
+// and bound is true or if it is not and bound is false.
+static int
+child (int bound)
+{
+  unsigned long *slot = plt_slot ("libw_swap");
+  void *h = dlopen ("libw.so", RTLD_LAZY | RTLD_NOLOAD);
+  if (h == 0)
+    {
+      h = dlopen ("libw.so", RTLD_LAZY);
+    }
+  void *target = dlsym (h, "libw_swap");
+  if (slot == 0 || target == 0 || (*slot == (unsigned long)target) != bound)
+    {
+      return 1;
+    }
+  libw_swap (1);
+  return (*slot == (unsigned long)target)?0:1;
+}
+
+static int
+run (const char *mode)
+{
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      int null = open ("/dev/null", O_WRONLY);
+      dup2 (null, 1);
+      execl (g_exe, g_exe, mode, (char *)0);
+      _exit (1);
+    }
+  int status;
+  return waitpid (pid, &status, 0) == pid &&
+    WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc > 1)
+    {
+      return child (strcmp (argv[1], "bound") == 0);
+    }
+  ssize_t len = readlink ("/proc/self/exe", g_exe, sizeof (g_exe) - 1);
+  if (len <= 0 || mkdtemp (g_dir) == 0)
+    {
+      return 1;
+    }
+  g_exe[len] = 0;
+  // the loader reads LD_BIND_PROFILE only at startup.
+  setenv ("LD_BIND_PROFILE", g_dir, 1);
+  if (run ("lazy"))
+    {
+      printf ("first run binds lazily\n");
+    }
+  struct stat st;
+  char profile[8192];
+  const char *basename = strrchr (g_exe, '/');
+  basename = (basename == 0)?g_exe:basename + 1;
+  if (stat (g_exe, &st) == 0)
+    {
+      snprintf (profile, sizeof (profile), "%s/%s-%lx.bind", g_dir,
+		basename, (unsigned long)st.st_ino);
+      if (stat (profile, &st) == 0)
+	{
+	  printf ("profile of the main binary saved\n");
+	}
+    }
+  if (run ("bound"))
+    {
+      printf ("second run binds hot slot\n");
+    }
+
+  char cmd[sizeof (g_dir) + 16];
+  snprintf (cmd, sizeof (cmd), "rm -rf %s", g_dir);
+  return system (cmd);
+}
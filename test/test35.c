@@ -0,0 +1,54 @@
+#include "test.h"
+#include <dlfcn.h>
+LIB(test35)
+
+struct XSparse
+{
+  int *ptr;
+  long pad[80];
+};
+typedef int *(*Target) (int);
+
+int main (int argc, char *argv[])
+{
+  // the relative relocations of libx.so are all in DT_RELR.
+  void *h = dlopen ("libx.so", RTLD_LAZY);
+  if (h == 0)
+    {
+      printf ("could not load libx.so\n");
+      return 1;
+    }
+  Target target = (Target) dlsym (h, "libx_target");
+  int **dense = dlsym (h, "libx_dense");
+  int **holes = dlsym (h, "libx_holes");
+  struct XSparse *sparse = dlsym (h, "libx_sparse");
+  int i, ok = 1;
+  for (i = 0; i < 100; i++)
+    {
+      ok = ok && dense[i] == target (i);
+    }
+  if (ok)
+    {
+      printf ("consecutive pointers relocated\n");
+    }
+  ok = 1;
+  for (i = 0; i < 40; i++)
+    {
+      ok = ok && holes[i] == ((i % 2 == 0)?target (i / 2):0);
+    }
+  if (ok)
+    {
+      printf ("pointers with holes relocated\n");
+    }
+  ok = 1;
+  for (i = 0; i < 4; i++)
+    {
+      ok = ok && sparse[i].ptr == target (i);
+    }
+  if (ok)
+    {
+      printf ("sparse pointers relocated\n");
+    }
+  dlclose (h);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#define _GNU_SOURCE 1
+#include "test.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+LIB(test36)
+
+typedef int (*Get) (void);
+
+extern int liby_value;
+int liby_get (void);
+
+// return true if the symbols of liby.so, which has only a sysv
+// hash table, can be found by relocation, dlsym and dladdr.
+static int
+check (void)
+{
+  void *h = dlopen ("liby.so", RTLD_LAZY | RTLD_NOLOAD);
+  if (h == 0)
+    {
+      return 0;
+    }
+  Get get = (Get) dlsym (h, "liby_get");
+  int *value = dlsym (h, "liby_value");
+  Dl_info info;
+  // liby_value was copied in the main binary: value points
+  // to the original.
+  int ok = get == liby_get && value != 0 && *value == 7 &&
+    liby_get () == 7 && get () == 7 &&
+    dladdr ((void*)get, &info) != 0 &&
+    info.dli_sname != 0 && strcmp (info.dli_sname, "liby_get") == 0 &&
+    strstr (info.dli_fname, "liby.so") != 0 &&
+    dlsym (h, "liby_missing") == 0;
+  dlclose (h);
+  return ok;
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc > 1)
+    {
+      return check ()?0:1;
+    }
+  if (check ())
+    {
+      printf ("sysv hash lookups ok\n");
+    }
+  fflush (stdout);
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      // the loader reads LD_SYNTH_HASH only at startup.
+      int null = open ("/dev/null", O_WRONLY);
+      dup2 (null, 1);
+      setenv ("LD_SYNTH_HASH", "1", 1);
+      execl ("/proc/self/exe", argv[0], "synth", (char *)0);
+      _exit (1);
+    }
+  int status;
+  if (waitpid (pid, &status, 0) == pid &&
+      WIFEXITED (status) && WEXITSTATUS (status) == 0)
+    {
+      printf ("synthesized gnu hash lookups ok\n");
+    }
+  return 0;
+}
@@ -0,0 +1,129 @@
+#define _GNU_SOURCE 1
+#include "test.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+LIB(test37)
+
+typedef int (*Who) (void);
+typedef Lmid_t (*LmidNew) (int, char **, char **);
+typedef int (*LmidAddSymbolRemap) (Lmid_t, const char *, const char *, const char *,
+				   const char *, const char *, const char *);
+
+int libvc_who (void);
+int libvc_main (void);
+
+// exported as libv_main@@VERS_1 too: interposes on libvt.so
+int libv_main (void)
+{
+  return 3;
+}
+
+// return what libv_who resolves to in libvc.so loaded in a new
+// namespace after libvi.so, with or without a remap of libv_who.
+static int
+who_in_namespace (int argc, char *argv[], char *envp[], int remap)
+{
+  void *vdl = dlopen ("libvdl.so", RTLD_LAZY);
+  LmidNew lmid_new = (LmidNew) dlsym (vdl, "dl_lmid_new");
+  LmidAddSymbolRemap add_symbol_remap = 
+    (LmidAddSymbolRemap) dlsym (vdl, "dl_lmid_add_symbol_remap");
+  if (lmid_new == 0 || add_symbol_remap == 0)
+    {
+      return 0;
+    }
+  Lmid_t lmid = lmid_new (argc, argv, envp);
+  if (remap)
+    {
+      // maps the symbol to itself: only the lookup path changes.
+      add_symbol_remap (lmid, "libv_who", "VERS_1", "libvt.so",
+			"libv_who", "VERS_1", "libvt.so");
+    }
+  dlmopen (lmid, "libvi.so", RTLD_LAZY | RTLD_GLOBAL);
+  void *h = dlmopen (lmid, "libvc.so", RTLD_NOW);
+  Who who = (Who) dlsym (h, "libvc_who");
+  return (who == 0)?0:who ();
+}
+
+static int
+child (const char *mode, int argc, char *argv[], char *envp[])
+{
+  if (strcmp (mode, "scope") == 0 || strcmp (mode, "preload") == 0)
+    {
+      // libvi.so comes first.
+      return libvc_who () == 2;
+    }
+  else if (strcmp (mode, "direct") == 0)
+    {
+      return libvc_who () == 1;
+    }
+  else if (strcmp (mode, "main") == 0)
+    {
+      return libvc_main () == 3;
+    }
+  else if (strcmp (mode, "remap") == 0)
+    {
+      return who_in_namespace (argc, argv, envp, 0) == 1 &&
+	who_in_namespace (argc, argv, envp, 1) == 2;
+    }
+  return 0;
+}
+
+// run the check mode in a child with LD_DIRECT_BIND set if direct
+// is true and LD_PRELOAD set to preload if it is not zero.
+static int
+run (const char *mode, int direct, const char *preload)
+{
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      // the loader reads these only at startup.
+      int null = open ("/dev/null", O_WRONLY);
+      dup2 (null, 1);
+      if (direct)
+	{
+	  setenv ("LD_DIRECT_BIND", "1", 1);
+	}
+      if (preload != 0)
+	{
+	  setenv ("LD_PRELOAD", preload, 1);
+	}
+      execl ("/proc/self/exe", "test37", mode, (char *)0);
+      _exit (1);
+    }
+  int status;
+  return waitpid (pid, &status, 0) == pid &&
+    WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+int main (int argc, char *argv[], char *envp[])
+{
+  if (argc > 1)
+    {
+      return child (argv[1], argc, argv, envp)?0:1;
+    }
+  if (run ("scope", 0, 0))
+    {
+      printf ("the scope order picks libvi.so\n");
+    }
+  if (run ("direct", 1, 0))
+    {
+      printf ("direct binding picks libvt.so\n");
+    }
+  if (run ("main", 1, 0))
+    {
+      printf ("the main binary still interposes\n");
+    }
+  if (run ("preload", 1, "libvi.so"))
+    {
+      printf ("LD_PRELOAD disables direct binding\n");
+    }
+  if (run ("remap", 1, 0))
+    {
+      printf ("remapped symbols are not bound directly\n");
+    }
+  return 0;
+}
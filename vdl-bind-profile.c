@@ -0,0 +1,219 @@
+#include "vdl-bind-profile.h"
+#include "vdl.h"
+#include "vdl-file.h"
+#include "vdl-image.h"
+#include "vdl-log.h"
+#include "vdl-utils.h"
+#include "vdl-alloc.h"
+#include "vdl-mem.h"
+#include "system.h"
+#include <fcntl.h>
+
+#define VDL_BIND_PROFILE_MAGIC 0x42444c56 // "VLDB"
+
+// the header of a profile file. It is followed by the bitmap
+// of bind_profile_n bits, one per dt_jmprel entry.
+struct VdlBindProfileHeader
+{
+  uint32_t magic;
+  uint32_t n_slots;
+  uint64_t size;
+  uint64_t mtime;
+};
+
+static uint32_t
+bind_profile_n_slots (struct VdlFile *file)
+{
+  if (file->dt_jmprel == 0)
+    {
+      return 0;
+    }
+  if (file->dt_pltrel == DT_REL)
+    {
+      return file->dt_pltrelsz / sizeof (ElfW(Rel));
+    }
+  else if (file->dt_pltrel == DT_RELA)
+    {
+      return file->dt_pltrelsz / sizeof (ElfW(Rela));
+    }
+  return 0;
+}
+
+static uint32_t
+bind_profile_words (uint32_t n_slots)
+{
+  return (n_slots + 31) / 32;
+}
+
+static void
+bind_profile_read (struct VdlImage *image)
+{
+  int fd = system_open_ro (image->bind_profile_path);
+  if (fd == -1)
+    {
+      return;
+    }
+  struct VdlBindProfileHeader header;
+  uint32_t bytes = bind_profile_words (image->bind_profile_n) * sizeof (uint32_t);
+  if (system_read (fd, &header, sizeof (header)) != sizeof (header) ||
+      header.magic != VDL_BIND_PROFILE_MAGIC ||
+      header.n_slots != image->bind_profile_n ||
+      header.size != (uint64_t)image->bind_profile_size ||
+      header.mtime != (uint64_t)image->bind_profile_mtime ||
+      system_read (fd, image->bind_profile, bytes) != bytes)
+    {
+      // a stale or truncated profile: start from scratch.
+      VDL_LOG_DEBUG ("ignore bind profile %s\n", image->bind_profile_path);
+      vdl_memset (image->bind_profile, 0, bytes);
+      image->bind_profile_dirty = 1;
+    }
+  system_close (fd);
+}
+
+// initialize the profile of the image of this file the first
+// time it is needed. Return false if there is no profile for
+// this image.
+static bool
+bind_profile_initialize (struct VdlFile *file)
+{
+  struct VdlImage *image = file->image;
+  if (image->bind_profile_initialized)
+    {
+      return image->bind_profile != 0;
+    }
+  image->bind_profile_initialized = 1;
+  uint32_t n_slots = bind_profile_n_slots (file);
+  if (g_vdl.bind_profile == 0 || n_slots == 0)
+    {
+      return false;
+    }
+  // The images which were mapped by someone else, such as the main
+  // binary, are not identified by a st_dev/st_ino pair so, we ask
+  // the filesystem.
+  struct stat st_buf;
+  if (image->registered)
+    {
+      st_buf.st_ino = image->st_ino;
+      st_buf.st_size = image->size;
+      st_buf.st_mtime = image->mtime;
+    }
+  else if (system_fstat (file->filename, &st_buf) == -1)
+    {
+      return false;
+    }
+  const char *basename = file->filename;
+  const char *cur;
+  for (cur = file->filename; *cur != 0; cur++)
+    {
+      if (*cur == '/')
+	{
+	  basename = cur + 1;
+	}
+    }
+  image->bind_profile_path = vdl_utils_sprintf ("%s/%s-%lx.bind", g_vdl.bind_profile,
+						basename, (unsigned long)st_buf.st_ino);
+  image->bind_profile_size = st_buf.st_size;
+  image->bind_profile_mtime = st_buf.st_mtime;
+  image->bind_profile_n = n_slots;
+  uint32_t bytes = bind_profile_words (n_slots) * sizeof (uint32_t);
+  image->bind_profile = vdl_alloc_malloc (bytes);
+  vdl_memset (image->bind_profile, 0, bytes);
+  bind_profile_read (image);
+  return true;
+}
+
+bool
+vdl_bind_profile_is_hot (struct VdlFile *file, unsigned long index)
+{
+  if (!bind_profile_initialize (file))
+    {
+      return false;
+    }
+  struct VdlImage *image = file->image;
+  return index < image->bind_profile_n &&
+    (image->bind_profile[index / 32] & (1U << (index % 32))) != 0;
+}
+
+void
+vdl_bind_profile_record (struct VdlFile *file, unsigned long index)
+{
+  if (!bind_profile_initialize (file))
+    {
+      return;
+    }
+  struct VdlImage *image = file->image;
+  if (index >= image->bind_profile_n ||
+      (image->bind_profile[index / 32] & (1U << (index % 32))) != 0)
+    {
+      return;
+    }
+  image->bind_profile[index / 32] |= 1U << (index % 32);
+  image->bind_profile_dirty = 1;
+}
+
+void
+vdl_bind_profile_save (struct VdlImage *image)
+{
+  if (image->bind_profile == 0 || !image->bind_profile_dirty)
+    {
+      return;
+    }
+  VDL_LOG_FUNCTION ("path=%s", image->bind_profile_path);
+  // the profile might be read by other processes while we write
+  // it so, we write a new file and rename it over the old one.
+  char *tmp = vdl_utils_sprintf ("%s.%d.tmp", image->bind_profile_path,
+				 system_getpid ());
+  int fd = system_open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd != -1;
+  if (ok)
+    {
+      struct VdlBindProfileHeader header;
+      header.magic = VDL_BIND_PROFILE_MAGIC;
+      header.n_slots = image->bind_profile_n;
+      header.size = image->bind_profile_size;
+      header.mtime = image->bind_profile_mtime;
+      ok = vdl_utils_write_all (fd, &header, sizeof (header)) &&
+	vdl_utils_write_all (fd, image->bind_profile,
+			     bind_profile_words (image->bind_profile_n) * sizeof (uint32_t));
+      system_close (fd);
+      ok = ok && system_rename (tmp, image->bind_profile_path) != -1;
+      if (!ok)
+	{
+	  system_unlink (tmp);
+	}
+    }
+  vdl_alloc_free (tmp);
+  if (!ok)
+    {
+      VDL_LOG_ERROR ("Could not write bind profile %s\n", image->bind_profile_path);
+      return;
+    }
+  image->bind_profile_dirty = 0;
+
+  uint32_t hot = 0;
+  uint32_t i;
+  for (i = 0; i < image->bind_profile_n; i++)
+    {
+      hot += (image->bind_profile[i / 32] >> (i % 32)) & 1;
+    }
+  VDL_LOG_STATS ("bind-profile path=%s slots=%u hot=%u\n",
+		 image->bind_profile_path, image->bind_profile_n, hot);
+}
+
+void
+vdl_bind_profile_save_all (void)
+{
+  if (g_vdl.bind_profile == 0)
+    {
+      return;
+    }
+  // g_vdl.images does not hold the images which were mapped by
+  // someone else, such as the one of the main binary so, we walk 
+  // the files which are still loaded instead. The images which
+  // were released before were saved by vdl_image_unref.
+  struct VdlFile *cur;
+  for (cur = g_vdl.link_map; cur != 0; cur = cur->next)
+    {
+      vdl_bind_profile_save (cur->image);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef VDL_BIND_PROFILE_H
+#define VDL_BIND_PROFILE_H
+
+#include <stdbool.h>
+
+struct VdlFile;
+struct VdlImage;
+
+/* When LD_BIND_PROFILE is set to a directory, we record there, for
+ * each image, the set of JUMP_SLOT relocations which were resolved
+ * lazily during the run. The next runs bind these slots eagerly
+ * from vdl_reloc and leave the other slots lazy.
+ */
+
+// return true if the slot at index in dt_jmprel was resolved
+// during an earlier run.
+bool vdl_bind_profile_is_hot (struct VdlFile *file, unsigned long index);
+// record that the slot at index in dt_jmprel was resolved lazily.
+void vdl_bind_profile_record (struct VdlFile *file, unsigned long index);
+// write the profile of this image if it was modified.
+void vdl_bind_profile_save (struct VdlImage *image);
+// write the profiles of all the images which are still loaded.
+void vdl_bind_profile_save_all (void);
+
+#endif /* VDL_BIND_PROFILE_H */
@@ -0,0 +1,110 @@
+#include "vdl-bind-worker.h"
+#include "vdl.h"
+#include "vdl-file.h"
+#include "vdl-reloc.h"
+#include "vdl-list.h"
+#include "vdl-log.h"
+#include "vdl-thread.h"
+#include "futex.h"
+#include "system.h"
+
+// the number of slots bound each time the thread takes g_vdl.futex.
+#define VDL_BIND_WORKER_BATCH 32
+
+struct VdlBindWorker
+{
+  // the files whose slots are not yet all bound, in queue order.
+  struct VdlList *queue;
+  // the index of the next slot to bind in the first file of queue.
+  unsigned long next;
+  // incremented whenever a file is queued. The thread waits
+  // on it when the queue is empty.
+  uint32_t seq;
+  uint32_t started : 1;
+  uint32_t failed : 1;
+};
+
+static struct VdlBindWorker g_worker = {0, 0, 0, 0, 0};
+
+static void
+bind_worker_run (void *unused)
+{
+  while (true)
+    {
+      uint32_t seq = g_worker.seq;
+      futex_lock (g_vdl.futex);
+      if (vdl_list_empty (g_worker.queue))
+	{
+	  futex_unlock (g_vdl.futex);
+	  system_futex_wait (&g_worker.seq, seq);
+	  continue;
+	}
+      struct VdlFile *file = vdl_list_front (g_worker.queue);
+      unsigned long end = g_worker.next + VDL_BIND_WORKER_BATCH;
+      unsigned long next = vdl_reloc_jmprel_range (file, g_worker.next, end);
+      if (next < end)
+	{
+	  VDL_LOG_DEBUG ("bound file=%s\n", file->name);
+	  vdl_list_pop_front (g_worker.queue);
+	  next = 0;
+	}
+      g_worker.next = next;
+      futex_unlock (g_vdl.futex);
+    }
+}
+
+void
+vdl_bind_worker_add (struct VdlFile *file)
+{
+  VDL_LOG_FUNCTION ("file=%s", file->name);
+  if (g_worker.failed)
+    {
+      return;
+    }
+  if (!g_worker.started)
+    {
+      g_worker.queue = vdl_list_new ();
+      if (!vdl_thread_create (bind_worker_run, 0))
+	{
+	  VDL_LOG_ERROR ("Could not start bind thread: using lazy binding\n");
+	  vdl_list_delete (g_worker.queue);
+	  g_worker.queue = 0;
+	  g_worker.failed = 1;
+	  return;
+	}
+      g_worker.started = 1;
+    }
+  vdl_list_push_back (g_worker.queue, file);
+  g_worker.seq++;
+  system_futex_wake (&g_worker.seq, 1);
+}
+
+void
+vdl_bind_worker_remove (struct VdlFile *file)
+{
+  if (!g_worker.started || vdl_list_empty (g_worker.queue))
+    {
+      return;
+    }
+  if (vdl_list_front (g_worker.queue) == file)
+    {
+      g_worker.next = 0;
+    }
+  vdl_list_remove (g_worker.queue, file);
+}
+
+void
+vdl_bind_worker_fork_child (void)
+{
+  if (!g_worker.started)
+    {
+      return;
+    }
+  // the thread does not exist in the child: the queued files
+  // stay lazily bound and the next file queued starts a new one.
+  vdl_list_delete (g_worker.queue);
+  g_worker.queue = 0;
+  g_worker.next = 0;
+  g_worker.seq = 0;
+  g_worker.started = 0;
+}
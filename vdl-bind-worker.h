@@ -0,0 +1,23 @@
+#ifndef VDL_BIND_WORKER_H
+#define VDL_BIND_WORKER_H
+
+struct VdlFile;
+
+/* The files loaded in a namespace whose bind policy is
+ * VDL_BIND_BACKGROUND are relocated lazily and then queued here:
+ * a thread owned by the loader binds their PLT slots, a few at a time,
+ * with g_vdl.futex held, just like vdl_reloc_index_jmprel does
+ * from the lazy binding trampoline. Both thus compute and write the
+ * same value for a given slot.
+ * The caller of these functions must hold g_vdl.futex.
+ */
+
+// queue this file and start the thread if needed. If the thread
+// cannot be started, the file stays lazily bound.
+void vdl_bind_worker_add (struct VdlFile *file);
+// make sure the thread does not touch this file anymore.
+void vdl_bind_worker_remove (struct VdlFile *file);
+// called in the child of a fork, with g_vdl.futex held.
+void vdl_bind_worker_fork_child (void);
+
+#endif /* VDL_BIND_WORKER_H */
@@ -4,6 +4,9 @@
 #include "vdl-alloc.h"
 #include "vdl-log.h"
 #include "vdl-unmap.h"
+#include "vdl-list.h"
+#include "vdl-hashmap.h"
+#include "vdl-lookup.h"
 
 bool
 vdl_context_empty (const struct VdlContext *context)
@@ -17,7 +20,7 @@ void vdl_context_add_lib_remap (struct VdlContext *context,
   struct VdlContextLibRemapEntry *entry = vdl_alloc_new (struct VdlContextLibRemapEntry);
   entry->src = vdl_utils_strdup (src);
   entry->dst = vdl_utils_strdup (dst);
-  vdl_list_push_back (context->lib_remaps, entry);
+  vdl_hashmap_insert (context->lib_remaps, vdl_gnu_hash (src), entry);
 }
 
 void vdl_context_add_symbol_remap (struct VdlContext *context, 
@@ -35,7 +38,15 @@ void vdl_context_add_symbol_remap (struct VdlContext *context,
   entry->dst_name = vdl_utils_strdup (dst_name);
   entry->dst_ver_name = vdl_utils_strdup (dst_ver_name);
   entry->dst_ver_filename = vdl_utils_strdup (dst_ver_filename);
-  vdl_list_push_back (context->symbol_remaps, entry);
+  vdl_hashmap_insert (context->symbol_remaps, vdl_gnu_hash (src_name), entry);
+  const char *strings[] = {src_name, src_ver_name, src_ver_filename,
+			   dst_name, dst_ver_name, dst_ver_filename};
+  uint32_t i;
+  for (i = 0; i < sizeof (strings) / sizeof (strings[0]); i++)
+    {
+      uint32_t h = (strings[i] == 0)?0:vdl_gnu_hash (strings[i]);
+      context->symbol_remaps_signature = context->symbol_remaps_signature * 31 + h;
+    }
 }
 void vdl_context_add_callback (struct VdlContext *context,
 			       void (*cb) (void *handle, enum VdlEvent event, void *context),
@@ -65,10 +76,14 @@ const char *
 vdl_context_lib_remap (const struct VdlContext *context, const char *name)
 {
   VDL_LOG_FUNCTION ("name=%s", name);
+  if (vdl_hashmap_empty (context->lib_remaps))
+    {
+      return name;
+    }
   void **i;
-  for (i = vdl_list_begin (context->lib_remaps);
-       i != vdl_list_end (context->lib_remaps);
-       i = vdl_list_next (i))
+  for (i = vdl_hashmap_find (context->lib_remaps, vdl_gnu_hash (name));
+       i != 0;
+       i = vdl_hashmap_find_next (i))
     {
       struct VdlContextLibRemapEntry *item = *i;
       if (vdl_utils_strisequal (item->src, name))
@@ -78,18 +93,23 @@ vdl_context_lib_remap (const struct VdlContext *context, const char *name)
     }
   return name;
 }
-void
+bool
 vdl_context_symbol_remap (const struct VdlContext *context, 
+			  uint32_t gnu_hash,
 			  const char **name, const char **ver_name, const char **ver_filename)
 {
   VDL_LOG_FUNCTION ("name=%s, ver_name=%s, ver_filename=%s", *name, 
 		    (ver_name != 0 && *ver_name != 0)?*ver_name:"", 
 		    (ver_filename != 0 && *ver_filename != 0)?*ver_filename:"");
+  const char *requested_ver_name = (ver_name != 0)?*ver_name:0;
+  const char *requested_ver_filename = (ver_filename != 0)?*ver_filename:0;
   void **i;
   struct VdlContextSymbolRemapEntry *item;
-  for (i = vdl_list_begin (context->symbol_remaps); 
-       i != vdl_list_end (context->symbol_remaps);
-       i = vdl_list_next (i))
+  // entries which share the same hash are kept in insertion order
+  // so the first match is the one which was added first.
+  for (i = vdl_hashmap_find (context->symbol_remaps, gnu_hash);
+       i != 0;
+       i = vdl_hashmap_find_next (i))
     {
       item = *i;
       if (!vdl_utils_strisequal (item->src_name, *name))
@@ -100,11 +120,11 @@ vdl_context_symbol_remap (const struct VdlContext *context,
 	{
 	  goto match;
 	}
-      else if (*ver_name == 0)
+      else if (requested_ver_name == 0)
 	{
 	  continue;
 	}
-      else if (!vdl_utils_strisequal (item->src_ver_name, *ver_name))
+      else if (!vdl_utils_strisequal (item->src_ver_name, requested_ver_name))
 	{
 	  continue;
 	}
@@ -112,16 +132,16 @@ vdl_context_symbol_remap (const struct VdlContext *context,
 	{
 	  goto match;
 	}
-      else if (*ver_filename == 0)
+      else if (requested_ver_filename == 0)
 	{
 	  continue;
 	}
-      else if (vdl_utils_strisequal (item->src_ver_filename, *ver_filename))
+      else if (vdl_utils_strisequal (item->src_ver_filename, requested_ver_filename))
 	{
 	  goto match;
 	}
     }
-  return;
+  return false;
  match:
   *name = item->dst_name;
   if (ver_name != 0)
@@ -132,7 +152,7 @@ vdl_context_symbol_remap (const struct VdlContext *context,
     {
       *ver_filename = item->dst_ver_filename;
     }
-  return;
+  return true;
 }
 
 struct VdlContext *vdl_context_new (int argc, char **argv, char **envp)
@@ -141,13 +161,17 @@ struct VdlContext *vdl_context_new (int argc, char **argv, char **envp)
 
   struct VdlContext *context = vdl_alloc_new (struct VdlContext);
   context->global_scope = vdl_list_new ();
+  context->global_index = vdl_hashmap_new ();
+  context->lookup_cache = 0;
 
   vdl_list_push_back (g_vdl.contexts, context);
 
   context->loaded = vdl_list_new ();
-  context->lib_remaps = vdl_list_new ();
-  context->symbol_remaps = vdl_list_new ();
+  context->lib_remaps = vdl_hashmap_new ();
+  context->symbol_remaps = vdl_hashmap_new ();
+  context->symbol_remaps_signature = 0;
   context->event_callbacks = vdl_list_new ();
+  context->bind_policy = VDL_BIND_LAZY;
   // keep a reference to argc, argv and envp.
   context->argc = argc;
   context->argv = argv;
@@ -166,6 +190,92 @@ struct VdlContext *vdl_context_new (int argc, char **argv, char **envp)
 
   return context;
 }
+struct VdlContext *vdl_context_clone (const struct VdlContext *src)
+{
+  VDL_LOG_FUNCTION ("src=%p", src);
+
+  struct VdlContext *context = vdl_alloc_new (struct VdlContext);
+  context->global_scope = vdl_list_new ();
+  context->global_index = vdl_hashmap_new ();
+  context->lookup_cache = 0;
+
+  vdl_list_push_back (g_vdl.contexts, context);
+
+  context->loaded = vdl_list_new ();
+  context->lib_remaps = vdl_hashmap_new ();
+  context->symbol_remaps = vdl_hashmap_new ();
+  context->event_callbacks = vdl_list_new ();
+  context->argc = src->argc;
+  context->argv = src->argv;
+  context->envp = src->envp;
+
+  // copy the remaps bucket by bucket to keep the entries 
+  // which share the same hash in the same order.
+  uint32_t i;
+  struct VdlHashMapItem *item;
+  for (i = 0; i < src->lib_remaps->n_buckets; i++)
+    {
+      for (item = src->lib_remaps->buckets[i].head; item != 0; item = item->next)
+	{
+	  struct VdlContextLibRemapEntry *entry = item->data;
+	  struct VdlContextLibRemapEntry *copy = vdl_alloc_new (struct VdlContextLibRemapEntry);
+	  copy->src = vdl_utils_strdup (entry->src);
+	  copy->dst = vdl_utils_strdup (entry->dst);
+	  vdl_hashmap_insert (context->lib_remaps, item->hash, copy);
+	}
+    }
+  for (i = 0; i < src->symbol_remaps->n_buckets; i++)
+    {
+      for (item = src->symbol_remaps->buckets[i].head; item != 0; item = item->next)
+	{
+	  struct VdlContextSymbolRemapEntry *entry = item->data;
+	  struct VdlContextSymbolRemapEntry *copy = vdl_alloc_new (struct VdlContextSymbolRemapEntry);
+	  copy->src_name = vdl_utils_strdup (entry->src_name);
+	  copy->src_ver_name = vdl_utils_strdup (entry->src_ver_name);
+	  copy->src_ver_filename = vdl_utils_strdup (entry->src_ver_filename);
+	  copy->dst_name = vdl_utils_strdup (entry->dst_name);
+	  copy->dst_ver_name = vdl_utils_strdup (entry->dst_ver_name);
+	  copy->dst_ver_filename = vdl_utils_strdup (entry->dst_ver_filename);
+	  vdl_hashmap_insert (context->symbol_remaps, item->hash, copy);
+	}
+    }
+  context->symbol_remaps_signature = src->symbol_remaps_signature;
+  context->bind_policy = src->bind_policy;
+
+  void **j;
+  for (j = vdl_list_begin (src->event_callbacks);
+       j != vdl_list_end (src->event_callbacks);
+       j = vdl_list_next (j))
+    {
+      struct VdlContextEventCallbackEntry *entry = *j;
+      vdl_context_add_callback (context, entry->fn, entry->context);
+    }
+
+  return context;
+}
+
+static void
+lib_remap_entry_delete (void *data)
+{
+  struct VdlContextLibRemapEntry *item = data;
+  vdl_alloc_free (item->src);
+  vdl_alloc_free (item->dst);
+  vdl_alloc_free (item);
+}
+
+static void
+symbol_remap_entry_delete (void *data)
+{
+  struct VdlContextSymbolRemapEntry *item = data;
+  vdl_alloc_free (item->src_name);
+  vdl_alloc_free (item->src_ver_name);
+  vdl_alloc_free (item->src_ver_filename);
+  vdl_alloc_free (item->dst_name);
+  vdl_alloc_free (item->dst_ver_name);
+  vdl_alloc_free (item->dst_ver_filename);
+  vdl_alloc_free (item);
+}
+
 void 
 vdl_context_delete (struct VdlContext *context)
 {
@@ -173,6 +283,9 @@ vdl_context_delete (struct VdlContext *context)
   // get rid of associated global scope
   vdl_list_delete (context->global_scope);
   context->global_scope = 0;
+  vdl_hashmap_delete (context->global_index);
+  context->global_index = 0;
+  vdl_lookup_cache_delete (context);
 
   vdl_list_delete (context->loaded);
   context->loaded = 0;
@@ -182,37 +295,11 @@ vdl_context_delete (struct VdlContext *context)
   context->argv = 0;
   context->envp = 0;
 
-  {
-    void **i;
-    for (i = vdl_list_begin (context->lib_remaps); 
-	 i != vdl_list_end (context->lib_remaps);
-	 i = vdl_list_next (i))
-      {
-	struct VdlContextLibRemapEntry *item = *i;
-	vdl_alloc_free (item->src);
-	vdl_alloc_free (item->dst);
-	vdl_alloc_free (item);
-      }
-    vdl_list_delete (context->lib_remaps);
-  }
+  vdl_hashmap_iterate (context->lib_remaps, lib_remap_entry_delete);
+  vdl_hashmap_delete (context->lib_remaps);
 
-  {
-    void **i;
-    for (i = vdl_list_begin (context->symbol_remaps); 
-	 i != vdl_list_end (context->symbol_remaps); 
-	 i = vdl_list_next (i))
-      {
-	struct VdlContextSymbolRemapEntry *item = *i;
-	vdl_alloc_free (item->src_name);
-	vdl_alloc_free (item->src_ver_name);
-	vdl_alloc_free (item->src_ver_filename);
-	vdl_alloc_free (item->dst_name);
-	vdl_alloc_free (item->dst_ver_name);
-	vdl_alloc_free (item->dst_ver_filename);
-	vdl_alloc_free (item);
-      }
-    vdl_list_delete (context->symbol_remaps);
-  }
+  vdl_hashmap_iterate (context->symbol_remaps, symbol_remap_entry_delete);
+  vdl_hashmap_delete (context->symbol_remaps);
 
   {
     void **i;
@@ -243,4 +330,31 @@ void vdl_context_remove_file (struct VdlContext *context,
 			      struct VdlFile *file)
 {
   vdl_list_remove (context->loaded, file);
+  // the cache might reference this file or its scope.
+  vdl_lookup_cache_flush (context);
+}
+void vdl_context_global_scope_append (struct VdlContext *context,
+				      void **begin, void **end)
+{
+  void **i;
+  for (i = begin; i != end; i = vdl_list_next (i))
+    {
+      struct VdlFile *file = *i;
+      if (vdl_list_find (context->global_scope, file) != 
+	  vdl_list_end (context->global_scope))
+	{
+	  // already there.
+	  continue;
+	}
+      vdl_list_push_back (context->global_scope, file);
+      vdl_lookup_global_index_add (context, file);
+      vdl_lookup_cache_flush (context);
+    }
+}
+void vdl_context_global_scope_remove (struct VdlContext *context,
+				      struct VdlFile *file)
+{
+  vdl_list_remove (context->global_scope, file);
+  vdl_lookup_global_index_remove (context, file);
+  vdl_lookup_cache_flush (context);
 }
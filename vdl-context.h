@@ -6,6 +6,8 @@
 
 struct VdlList;
 struct VdlFile;
+struct VdlHashMap;
+struct VdlLookupCache;
 
 struct VdlContextSymbolRemapEntry
 {
@@ -28,6 +30,17 @@ enum VdlEvent {
   VDL_EVENT_CONSTRUCTED,
   VDL_EVENT_DESTROYED
 };
+// the numbers below are part of the dl_lmid_set_bind_policy API.
+enum VdlBindPolicy {
+  // PLT slots are bound on first call unless RTLD_NOW, LD_BIND_NOW
+  // or the DT_FLAGS of the binary say otherwise.
+  VDL_BIND_LAZY = 0,
+  // PLT slots are bound when the binary is relocated.
+  VDL_BIND_NOW = 1,
+  // PLT slots are bound by a background thread after the binary 
+  // is relocated. See vdl-bind-worker.h
+  VDL_BIND_BACKGROUND = 2
+};
 struct VdlContextEventCallbackEntry
 {
   void (*fn) (void *handle, enum VdlEvent event, void *context);
@@ -41,14 +54,27 @@ struct VdlContext
   // the list of files which are part of the global scope of this context
   // this set is necessarily a subset of the set of loaded files
   struct VdlList *global_scope;
+  // an index of all the symbols defined by the files of the global
+  // scope, keyed by symbol name hash. Entries with the same hash are 
+  // stored in global scope order. Maintained by vdl_context_global_scope_*
+  struct VdlHashMap *global_index;
+  // memoizes the result of symbol lookups within the scopes of 
+  // this context. Flushed whenever one of these scopes changes.
+  struct VdlLookupCache *lookup_cache;
   // describe which symbols should be remapped to which 
-  // other symbols during symbol resolution
-  struct VdlList *symbol_remaps;
+  // other symbols during symbol resolution. Keyed by the
+  // gnu hash of the source symbol name.
+  struct VdlHashMap *symbol_remaps;
+  // a hash of the content of symbol_remaps: two contexts with
+  // the same signature are very likely to remap symbols the same way.
+  uint32_t symbol_remaps_signature;
   // describe which libraries should be remapped to which 
-  // other libraries during loading
-  struct VdlList *lib_remaps;
+  // other libraries during loading. Keyed by the gnu hash
+  // of the source library name.
+  struct VdlHashMap *lib_remaps;
   // report events within this context
   struct VdlList *event_callbacks;
+  enum VdlBindPolicy bind_policy;
   // These variables are used by all .init functions
   // _some_ libc .init functions make use of these
   // 3 arguments so, even though no one else uses them, 
@@ -59,11 +85,20 @@ struct VdlContext
 };
 
 struct VdlContext *vdl_context_new (int argc, char **argv, char **envp);
+// create a new context with the same remaps, event callbacks 
+// and arguments as src.
+struct VdlContext *vdl_context_clone (const struct VdlContext *src);
 void vdl_context_delete (struct VdlContext *context);
 void vdl_context_add_file (struct VdlContext *context,
 			   struct VdlFile *file);
 void vdl_context_remove_file (struct VdlContext *context,
 			      struct VdlFile *file);
+// append to the global scope the files in [begin,end) which are
+// not yet part of it and add their symbols to the global index.
+void vdl_context_global_scope_append (struct VdlContext *context,
+				      void **begin, void **end);
+void vdl_context_global_scope_remove (struct VdlContext *context,
+				      struct VdlFile *file);
 void vdl_context_add_lib_remap (struct VdlContext *context, const char *src, const char *dst);
 void vdl_context_add_symbol_remap (struct VdlContext *context, 
 				   const char *src_name, 
@@ -79,7 +114,10 @@ void vdl_context_notify (struct VdlContext *context,
 			 struct VdlFile *file,
 			 enum VdlEvent event);
 const char *vdl_context_lib_remap (const struct VdlContext *context, const char *name);
-void vdl_context_symbol_remap (const struct VdlContext *context, 
+// gnu_hash is the gnu hash of *name. Returns true if the
+// symbol was remapped, in which case *name has changed.
+bool vdl_context_symbol_remap (const struct VdlContext *context, 
+			       uint32_t gnu_hash,
 			       const char **name,
 			       const char **ver_name,
 			       const char **ver_filename);
@@ -44,6 +44,14 @@ EXPORT void vdl_dl_lmid_delete_public (Lmid_t lmid)
 {
   return vdl_dl_lmid_delete (lmid);
 }
+EXPORT Lmid_t vdl_dl_lmid_clone_public (Lmid_t lmid)
+{
+  return vdl_dl_lmid_clone (lmid);
+}
+EXPORT int vdl_dl_lmid_set_bind_policy_public (Lmid_t lmid, int policy)
+{
+  return vdl_dl_lmid_set_bind_policy (lmid, policy);
+}
 EXPORT int vdl_dl_lmid_add_callback_public (Lmid_t lmid, 
 					    void (*cb) (void *handle, int event, void *context),
 					    void *cb_context)
@@ -17,6 +17,8 @@ EXPORT void *vdl_dlmopen_public (Lmid_t lmid, const char *filename, int flag);
 // create a new linkmap
 EXPORT Lmid_t vdl_dl_lmid_new_public (int argc, char **argv, char **envp);
 EXPORT void vdl_dl_lmid_delete_public (Lmid_t lmid);
+EXPORT Lmid_t vdl_dl_lmid_clone_public (Lmid_t lmid);
+EXPORT int vdl_dl_lmid_set_bind_policy_public (Lmid_t lmid, int policy);
 EXPORT int vdl_dl_lmid_add_callback_public (Lmid_t lmid, 
 					    void (*cb) (void *handle, int event, void *context),
 					    void *cb_context);
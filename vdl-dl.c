@@ -17,6 +17,7 @@
 #include "vdl-alloc.h"
 #include "vdl-linkmap.h"
 #include "vdl-file.h"
+#include "vdl-image.h"
 #include "vdl-map.h"
 #include "vdl-unmap.h"
 #include "vdl-init.h"
@@ -67,11 +68,14 @@ addr_to_file (unsigned long caller)
   for (cur = g_vdl.link_map; cur != 0; cur = cur->next)
     {
       void **i;
-      for (i = vdl_list_begin (cur->maps); i != vdl_list_end (cur->maps); i = vdl_list_next (i))
+      for (i = vdl_list_begin (cur->image->maps); 
+	   i != vdl_list_end (cur->image->maps); 
+	   i = vdl_list_next (i))
 	{
 	  struct VdlFileMap *map = *i;
-	  if (caller >= map->mem_start_align &&
-	      caller <= map->mem_start_align + map->mem_size_align)
+	  unsigned long start = cur->load_base + map->mem_start_align;
+	  if (caller >= start &&
+	      caller <= start + map->mem_size_align)
 	    {
 	      return cur;
 	    }
@@ -217,13 +221,11 @@ static void *dlopen_with_context (struct VdlContext *context, const char *filena
     {
       // add this object as well as its dependencies to the global scope.
       // Note that it's not a big deal if the file has already been
-      // added to the global scope in the past. We call unicize so
-      // any duplicate entries appended here will be removed immediately.
-      vdl_list_insert_range (context->global_scope,
-			     vdl_list_end (context->global_scope),
-			     vdl_list_begin (scope),
-			     vdl_list_end (scope));
-      vdl_list_unicize (context->global_scope);
+      // added to the global scope in the past: files which are
+      // already there are skipped.
+      vdl_context_global_scope_append (context,
+				       vdl_list_begin (scope),
+				       vdl_list_end (scope));
     }
 
   // setup the local scope of each newly-loaded file.
@@ -334,7 +336,7 @@ remove_from_scopes (struct VdlList *files, struct VdlFile *file)
     }  
 
   // finally, remove from the global scope map
-  vdl_list_remove (file->context->global_scope, file);
+  vdl_context_global_scope_remove (file->context, file);
 }
 
 int vdl_dlclose (void *handle)
@@ -468,6 +470,17 @@ int vdl_dladdr1 (const void *addr, Dl_info *info,
 	      match = update_match ((unsigned long)addr, file, cur, match);
 	    }
 	}
+      else if (file->gnu_indices != 0)
+	{
+	  // this is a hash table synthesized by the loader: it
+	  // references all the defined symbols of the file.
+	  uint32_t i;
+	  for (i = 0; i < file->gnu_indices_size; i++)
+	    {
+	      ElfW(Sym) *cur = &dt_symtab[file->gnu_indices[i]];
+	      match = update_match ((unsigned long)addr, file, cur, match);
+	    }
+	}
       if (dt_gnu_hash != 0)
 	{
 	  // this is a gnu hash table.
@@ -771,6 +784,171 @@ void vdl_dl_lmid_delete (Lmid_t lmid)
  out:
   futex_unlock (g_vdl.futex);
 }
+// return the item of to located at the same position as data in from.
+static void *
+clone_translate (struct VdlList *from, struct VdlList *to, void *data)
+{
+  void **i, **j;
+  for (i = vdl_list_begin (from), j = vdl_list_begin (to);
+       i != vdl_list_end (from);
+       i = vdl_list_next (i), j = vdl_list_next (j))
+    {
+      if (*i == data)
+	{
+	  return *j;
+	}
+    }
+  return 0;
+}
+static void
+clone_translate_list (struct VdlList *from, struct VdlList *to,
+		      struct VdlList *src, struct VdlList *dst)
+{
+  void **i;
+  for (i = vdl_list_begin (src); i != vdl_list_end (src); i = vdl_list_next (i))
+    {
+      void *item = clone_translate (from, to, *i);
+      if (item != 0)
+	{
+	  vdl_list_push_back (dst, item);
+	}
+    }
+}
+static unsigned long
+clone_time_usec (void)
+{
+  struct timeval tv;
+  if (system_gettimeofday (&tv) == -1)
+    {
+      return 0;
+    }
+  return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+Lmid_t vdl_dl_lmid_clone (Lmid_t lmid)
+{
+  VDL_LOG_FUNCTION ("", 0);
+  futex_lock (g_vdl.futex);
+  unsigned long start = clone_time_usec ();
+  struct VdlContext *src;
+  if (lmid == LM_ID_BASE)
+    {
+      src = vdl_list_front (g_vdl.contexts);
+    }
+  else
+    {
+      src = search_context ((struct VdlContext *) lmid);
+      if (src == 0)
+	{
+	  goto error;
+	}
+    }
+  void **cur;
+  for (cur = vdl_list_begin (src->loaded); 
+       cur != vdl_list_end (src->loaded); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFile *item = *cur;
+      if (!item->image->registered)
+	{
+	  // the main binary and the loader itself were not
+	  // mapped by us so we can't map them again.
+	  set_error ("Can't clone lmid %p: \"%s\" was not loaded from a file", 
+		     src, item->name);
+	  goto error;
+	}
+    }
+
+  struct VdlContext *context = vdl_context_clone (src);
+  // the files of the new context, in the same order
+  // as the files of the source context.
+  struct VdlList *loaded = vdl_list_new ();
+  for (cur = vdl_list_begin (src->loaded); 
+       cur != vdl_list_end (src->loaded); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFile *item = *cur;
+      struct VdlFile *file = vdl_map_from_file (context, item);
+      if (file == 0)
+	{
+	  set_error ("Can't clone lmid %p: unable to map \"%s\"", 
+		     src, item->filename);
+	  goto unmap;
+	}
+      vdl_list_push_back (loaded, file);
+    }
+  
+  // reuse the dependency graph and the scopes of the source context
+  void **i, **j;
+  for (i = vdl_list_begin (src->loaded), j = vdl_list_begin (loaded);
+       i != vdl_list_end (src->loaded);
+       i = vdl_list_next (i), j = vdl_list_next (j))
+    {
+      struct VdlFile *item = *i;
+      struct VdlFile *file = *j;
+      // the new namespace holds one reference on each binary which
+      // was dlopened in the source namespace, whatever the number
+      // of dlopen calls there: see dl_lmid_clone in doc/dl-lmid.txt
+      file->count = (item->count > 0)?1:0;
+      file->is_executable = item->is_executable;
+      file->lookup_type = item->lookup_type;
+      file->depth = item->depth;
+      file->deps_initialized = 1;
+      clone_translate_list (src->loaded, loaded, item->deps, file->deps);
+      clone_translate_list (src->loaded, loaded, item->local_scope, file->local_scope);
+    }
+  {
+    struct VdlList *global = vdl_list_new ();
+    clone_translate_list (src->loaded, loaded, src->global_scope, global);
+    vdl_context_global_scope_append (context, vdl_list_begin (global),
+				     vdl_list_end (global));
+    vdl_list_delete (global);
+  }
+
+  if (!vdl_tls_file_initialize (loaded))
+    {
+      set_error ("Can't clone lmid %p: not enough space in static tls block", src);
+      vdl_tls_file_deinitialize (loaded);
+      goto unmap;
+    }
+
+  // the relocations replay the plans recorded when the files
+  // of the source context were relocated.
+  vdl_reloc (loaded, g_vdl.bind_now);
+
+  vdl_linkmap_append_range (vdl_list_begin (loaded),
+			    vdl_list_end (loaded));
+  vdl_tls_dtv_update ();
+  gdb_notify ();
+  glibc_patch (loaded);
+
+  VDL_LOG_STATS ("clone lmid=%p files=%lu usec=%lu\n", context, 
+		 (unsigned long)vdl_list_size (loaded),
+		 clone_time_usec () - start);
+
+  struct VdlList *call_init = vdl_sort_call_init (loaded);
+  futex_unlock (g_vdl.futex);
+  vdl_init_call (call_init);
+  futex_lock (g_vdl.futex);
+  vdl_list_delete (call_init);
+  vdl_list_delete (loaded);
+  futex_unlock (g_vdl.futex);
+  return (Lmid_t) context;
+
+ unmap:
+  if (vdl_list_empty (loaded))
+    {
+      vdl_context_delete (context);
+    }
+  else
+    {
+      // the last file unmapped deletes the context.
+      vdl_unmap (loaded, true);
+    }
+  vdl_list_delete (loaded);
+ error:
+  futex_unlock (g_vdl.futex);
+  return 0;
+}
 int vdl_dl_lmid_add_callback (Lmid_t lmid, 
 			      void (*cb) (void *handle, int event, void *context),
 			      void *cb_context)
@@ -792,6 +970,31 @@ int vdl_dl_lmid_add_callback (Lmid_t lmid,
   return -1;
 }
 int
+vdl_dl_lmid_set_bind_policy (Lmid_t lmid, int policy)
+{
+  VDL_LOG_FUNCTION ("policy=%d", policy);
+  futex_lock (g_vdl.futex);
+  struct VdlContext *context = (struct VdlContext *)lmid;
+  if (search_context (context) == 0)
+    {
+      goto error;
+    }
+  if (policy != VDL_BIND_LAZY &&
+      policy != VDL_BIND_NOW &&
+      policy != VDL_BIND_BACKGROUND)
+    {
+      set_error ("Invalid bind policy %d", policy);
+      goto error;
+    }
+  // This affects only the files loaded after this call.
+  context->bind_policy = policy;
+  futex_unlock (g_vdl.futex);
+  return 0;
+ error:
+  futex_unlock (g_vdl.futex);
+  return -1;
+}
+int
 vdl_dl_lmid_add_lib_remap (Lmid_t lmid, const char *src, const char *dst)
 {
   VDL_LOG_FUNCTION ("", 0);
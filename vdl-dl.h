@@ -25,6 +25,11 @@ void *vdl_dlmopen (Lmid_t lmid, const char *filename, int flag);
 // create a new linkmap
 Lmid_t vdl_dl_lmid_new (int argc, char **argv, char **envp);
 void vdl_dl_lmid_delete (Lmid_t lmid);
+// create a new linkmap which contains a copy of each file
+// loaded in lmid. Returns zero on failure.
+Lmid_t vdl_dl_lmid_clone (Lmid_t lmid);
+// policy is one of enum VdlBindPolicy. Returns -1 on failure.
+int vdl_dl_lmid_set_bind_policy (Lmid_t lmid, int policy);
 int vdl_dl_lmid_add_callback (Lmid_t lmid, 
 			      void (*cb) (void *handle, int event, void *context),
 			      void *cb_context);
@@ -7,6 +7,8 @@
 
 struct VdlContext;
 struct VdlList;
+struct VdlImage;
+struct VdlLookupIndexEntry;
 
 enum VdlFileLookupType
 {
@@ -45,6 +47,20 @@ struct VdlFileMap
   unsigned long mem_anon_size_align;
 };
 
+// An entry of the version table of a file, indexed by the
+// version indexes stored in dt_versym. It describes either a
+// version defined by the file (dt_verdef) or a version it
+// requires (dt_verneed).
+struct VdlFileVersion
+{
+  // zero if no version uses this index.
+  const char *name;
+  // the name of the file which defines this version
+  const char *filename;
+  // the elf hash of name, copied from vd_hash or vna_hash
+  unsigned long hash;
+};
+
 
 struct VdlFile
 {
@@ -85,12 +101,16 @@ struct VdlFile
   //     loaded during loader initialization
   // All other files have a count of zero.
   uint32_t count;
+  // points to the phdr array of the image.
   ElfW(Phdr) *phdr;
   uint32_t phnum;
   char *name;
   dev_t st_dev;
   ino_t st_ino;
-  struct VdlList *maps;
+  // the description of this file which does not depend on
+  // its load base, shared with the other mappings of the same file.
+  // The addresses of its maps are relative to load_base.
+  struct VdlImage *image;
   // indicates if the deps field has been initialized correctly
   uint32_t deps_initialized : 1;
   // indicates if the has_tls field has been initialized correctly
@@ -198,6 +218,42 @@ struct VdlFile
   const char *dt_runpath;
   const char *dt_soname;
   ElfW(Half) e_type;
+  // the entries which describe the symbols defined by this file
+  // in the global scope index of its context. This is non-null
+  // only while the file is part of the global scope.
+  struct VdlLookupIndexEntry *global_index;
+  unsigned long global_index_size;
+  // the header of dt_gnu_hash, parsed once by vdl_lookup_file_initialize.
+  // gnu_bloom is zero if there is no dt_gnu_hash.
+  uint32_t gnu_nbuckets;
+  uint32_t gnu_symndx;
+  // maskwords is always a power of two
+  uint32_t gnu_maskwords_mask;
+  uint32_t gnu_shift2;
+  ElfW(Addr) *gnu_bloom;
+  uint32_t *gnu_buckets;
+  uint32_t *gnu_chains;
+  // if the file has no dt_gnu_hash and LD_SYNTH_HASH is set, the
+  // fields above describe a table built by the loader in which chain 
+  // entry i describes symbol gnu_indices[i] instead of symbol 
+  // i + gnu_symndx. zero otherwise.
+  uint32_t *gnu_indices;
+  uint32_t gnu_indices_size;
+  // built by vdl_lookup_file_initialize from dt_verdef and dt_verneed
+  // if the file has a dt_versym. zero otherwise.
+  struct VdlFileVersion *versions;
+  uint32_t versions_size;
+  // packed relative relocations. zero if there is no DT_RELR.
+  ElfW(Addr) *dt_relr;
+  unsigned long dt_relrsz;
+  unsigned long dt_relrent;
+  // the number of R_*_RELATIVE entries located at the start
+  // of dt_rel and dt_rela (DT_RELCOUNT and DT_RELACOUNT).
+  unsigned long dt_relcount;
+  unsigned long dt_relacount;
+  // indicates if our fork handlers were registered with the
+  // __register_atfork of this file (see glibc.c).
+  uint32_t fork_handlers_registered : 1;
 };
 
 #endif /* VDL_FILE_H */
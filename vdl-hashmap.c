@@ -0,0 +1,176 @@
+#include "vdl-hashmap.h"
+#include "vdl-alloc.h"
+
+#define VDL_HASHMAP_INITIAL_BUCKETS 16
+
+static void
+buckets_clear (struct VdlHashMapBucket *buckets, uint32_t n)
+{
+  uint32_t i;
+  for (i = 0; i < n; i++)
+    {
+      buckets[i].head = 0;
+      buckets[i].tail = 0;
+    }
+}
+
+static void
+bucket_append (struct VdlHashMapBucket *bucket, struct VdlHashMapItem *item)
+{
+  item->next = 0;
+  if (bucket->tail == 0)
+    {
+      bucket->head = item;
+    }
+  else
+    {
+      bucket->tail->next = item;
+    }
+  bucket->tail = item;
+}
+
+// Double the number of buckets. Because all items which share
+// a hash value end up in the same new bucket and because we
+// move them in order, insertion order is preserved.
+static void
+grow (struct VdlHashMap *map)
+{
+  uint32_t n_buckets = map->n_buckets * 2;
+  struct VdlHashMapBucket *buckets =
+    vdl_alloc_malloc (sizeof (struct VdlHashMapBucket) * n_buckets);
+  buckets_clear (buckets, n_buckets);
+  uint32_t i;
+  for (i = 0; i < map->n_buckets; i++)
+    {
+      struct VdlHashMapItem *item, *next;
+      for (item = map->buckets[i].head; item != 0; item = next)
+	{
+	  next = item->next;
+	  bucket_append (&buckets[item->hash & (n_buckets - 1)], item);
+	}
+    }
+  vdl_alloc_free (map->buckets);
+  map->buckets = buckets;
+  map->n_buckets = n_buckets;
+}
+
+struct VdlHashMap *
+vdl_hashmap_new (void)
+{
+  struct VdlHashMap *map = vdl_alloc_new (struct VdlHashMap);
+  map->n_buckets = VDL_HASHMAP_INITIAL_BUCKETS;
+  map->buckets = vdl_alloc_malloc (sizeof (struct VdlHashMapBucket) * map->n_buckets);
+  buckets_clear (map->buckets, map->n_buckets);
+  map->size = 0;
+  return map;
+}
+void vdl_hashmap_delete (struct VdlHashMap *map)
+{
+  vdl_hashmap_clear (map);
+  vdl_alloc_free (map->buckets);
+  map->buckets = 0;
+  map->n_buckets = 0;
+  vdl_alloc_delete (map);
+}
+uint32_t vdl_hashmap_size (struct VdlHashMap *map)
+{
+  return map->size;
+}
+bool vdl_hashmap_empty (struct VdlHashMap *map)
+{
+  return map->size == 0;
+}
+void vdl_hashmap_insert (struct VdlHashMap *map, uint32_t hash, void *data)
+{
+  if (map->size >= map->n_buckets)
+    {
+      grow (map);
+    }
+  struct VdlHashMapItem *item = vdl_alloc_new (struct VdlHashMapItem);
+  item->data = data;
+  item->hash = hash;
+  bucket_append (&map->buckets[hash & (map->n_buckets - 1)], item);
+  map->size++;
+}
+void vdl_hashmap_remove (struct VdlHashMap *map, uint32_t hash, void *data)
+{
+  struct VdlHashMapBucket *bucket = &map->buckets[hash & (map->n_buckets - 1)];
+  struct VdlHashMapItem *item, *prev;
+  for (prev = 0, item = bucket->head; item != 0; prev = item, item = item->next)
+    {
+      if (item->hash != hash || item->data != data)
+	{
+	  continue;
+	}
+      if (prev == 0)
+	{
+	  bucket->head = item->next;
+	}
+      else
+	{
+	  prev->next = item->next;
+	}
+      if (bucket->tail == item)
+	{
+	  bucket->tail = prev;
+	}
+      vdl_alloc_delete (item);
+      map->size--;
+      return;
+    }
+}
+void vdl_hashmap_clear (struct VdlHashMap *map)
+{
+  uint32_t i;
+  for (i = 0; i < map->n_buckets; i++)
+    {
+      struct VdlHashMapItem *item, *next;
+      for (item = map->buckets[i].head; item != 0; item = next)
+	{
+	  next = item->next;
+	  vdl_alloc_delete (item);
+	}
+      map->buckets[i].head = 0;
+      map->buckets[i].tail = 0;
+    }
+  map->size = 0;
+}
+void **vdl_hashmap_find (struct VdlHashMap *map, uint32_t hash)
+{
+  struct VdlHashMapItem *item;
+  for (item = map->buckets[hash & (map->n_buckets - 1)].head;
+       item != 0; item = item->next)
+    {
+      if (item->hash == hash)
+	{
+	  return (void**)item;
+	}
+    }
+  return 0;
+}
+void **vdl_hashmap_find_next (void **i)
+{
+  struct VdlHashMapItem *cur = (struct VdlHashMapItem *)i;
+  struct VdlHashMapItem *item;
+  for (item = cur->next; item != 0; item = item->next)
+    {
+      if (item->hash == cur->hash)
+	{
+	  return (void**)item;
+	}
+    }
+  return 0;
+}
+void vdl_hashmap_iterate (struct VdlHashMap *map,
+			  void (*iterator) (void *data))
+{
+  uint32_t i;
+  for (i = 0; i < map->n_buckets; i++)
+    {
+      struct VdlHashMapItem *item;
+      for (item = map->buckets[i].head; item != 0; item = item->next)
+	{
+	  iterator (item->data);
+	}
+    }
+}
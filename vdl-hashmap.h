@@ -0,0 +1,64 @@
+#ifndef VDL_HASHMAP_H
+#define VDL_HASHMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A chained hash table keyed by a 32bit hash value computed
+ * by the caller. Multiple values can be stored with the same
+ * hash value: they are kept in insertion order which makes
+ * it possible to use this table as an ordered multimap.
+ * As in the VdlList API, we use void ** for the iterator
+ * type and void * for the value type.
+ */
+
+struct VdlHashMapItem
+{
+  void *data;
+  uint32_t hash;
+  struct VdlHashMapItem *next;
+};
+
+struct VdlHashMapBucket
+{
+  struct VdlHashMapItem *head;
+  struct VdlHashMapItem *tail;
+};
+
+struct VdlHashMap
+{
+  struct VdlHashMapBucket *buckets;
+  // always a power of two.
+  uint32_t n_buckets;
+  uint32_t size;
+};
+
+struct VdlHashMap *vdl_hashmap_new (void);
+void vdl_hashmap_delete (struct VdlHashMap *map);
+uint32_t vdl_hashmap_size (struct VdlHashMap *map);
+bool vdl_hashmap_empty (struct VdlHashMap *map);
+
+// append value after all other values which have the same hash.
+void vdl_hashmap_insert (struct VdlHashMap *map, uint32_t hash, void *data);
+// remove the first entry which matches both hash and data.
+void vdl_hashmap_remove (struct VdlHashMap *map, uint32_t hash, void *data);
+void vdl_hashmap_clear (struct VdlHashMap *map);
+
+// return the first value stored with this hash or 0 if there is none.
+void **vdl_hashmap_find (struct VdlHashMap *map, uint32_t hash);
+// return the next value stored with the same hash as i or 0 if there is none.
+void **vdl_hashmap_find_next (void **i);
+
+void vdl_hashmap_iterate (struct VdlHashMap *map,
+			  void (*iterator) (void *data));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VDL_HASHMAP_H */
@@ -0,0 +1,411 @@
+#include "vdl-image.h"
+#include "vdl-file.h"
+#include "vdl.h"
+#include "vdl-log.h"
+#include "vdl-utils.h"
+#include "vdl-list.h"
+#include "vdl-hashmap.h"
+#include "vdl-alloc.h"
+#include "vdl-mem.h"
+#include "vdl-reloc.h"
+#include "vdl-bind-profile.h"
+
+static unsigned long g_image_serial = 0;
+
+static uint32_t
+image_hash (dev_t dev, ino_t ino)
+{
+  uint64_t v = ((uint64_t)dev) * 0x9e3779b97f4a7c15ULL + (uint64_t)ino;
+  return (uint32_t)(v ^ (v >> 32));
+}
+
+struct VdlImage *
+vdl_image_new (ElfW(Half) e_type,
+	       ElfW(Phdr) *phdr, uint32_t phnum,
+	       struct VdlList *maps, unsigned long dynamic)
+{
+  struct VdlImage *image = vdl_alloc_new (struct VdlImage);
+  vdl_memset (image, 0, sizeof (*image));
+  image->count = 1;
+  g_image_serial++;
+  image->serial = g_image_serial;
+  image->e_type = e_type;
+  image->phdr = phdr;
+  image->phnum = phnum;
+  image->maps = maps;
+  image->dynamic = dynamic;
+  futex_construct (&image->ifuncs_futex);
+
+  unsigned long start = ~0;
+  unsigned long end = 0;
+  unsigned long offset = ~0;
+  void **cur;
+  for (cur = vdl_list_begin (maps); cur != vdl_list_end (maps); cur = vdl_list_next (cur))
+    {
+      struct VdlFileMap *map = *cur;
+      if (start >= map->mem_start_align)
+	{
+	  start = map->mem_start_align;
+	  offset = map->file_start_align;
+	}
+      end = vdl_utils_max (end, map->mem_start_align + map->mem_size_align);
+    }
+  image->mapping_start = start;
+  image->mapping_size = end - start;
+  image->mapping_offset = offset;
+  return image;
+}
+
+void
+vdl_image_register (struct VdlImage *image, const struct stat *st_buf)
+{
+  VDL_LOG_ASSERT (!image->registered, "image registered twice");
+  image->st_dev = st_buf->st_dev;
+  image->st_ino = st_buf->st_ino;
+  image->size = st_buf->st_size;
+  image->mtime = st_buf->st_mtime;
+  image->registered = 1;
+  vdl_hashmap_insert (g_vdl.images, image_hash (image->st_dev, image->st_ino),
+		      image);
+}
+
+struct VdlImage *
+vdl_image_find (const struct stat *st_buf)
+{
+  void **i;
+  for (i = vdl_hashmap_find (g_vdl.images, image_hash (st_buf->st_dev, st_buf->st_ino));
+       i != 0;
+       i = vdl_hashmap_find_next (i))
+    {
+      struct VdlImage *image = *i;
+      if (image->st_dev == st_buf->st_dev &&
+	  image->st_ino == st_buf->st_ino &&
+	  image->size == st_buf->st_size &&
+	  image->mtime == st_buf->st_mtime)
+	{
+	  image->count++;
+	  return image;
+	}
+    }
+  return 0;
+}
+
+void
+vdl_image_ref (struct VdlImage *image)
+{
+  image->count++;
+}
+
+void
+vdl_image_unref (struct VdlImage *image)
+{
+  image->count--;
+  if (image->count > 0)
+    {
+      return;
+    }
+  if (image->registered)
+    {
+      vdl_hashmap_remove (g_vdl.images, image_hash (image->st_dev, image->st_ino),
+			  image);
+    }
+  vdl_alloc_free (image->phdr);
+  vdl_list_iterate (image->maps, vdl_alloc_free);
+  vdl_list_delete (image->maps);
+  if (image->dynamic_initialized)
+    {
+      vdl_utils_str_list_delete (image->needed);
+      vdl_utils_str_list_delete (image->rpath);
+      vdl_utils_str_list_delete (image->runpath);
+    }
+  if (image->reloc_plan != 0)
+    {
+      vdl_reloc_plan_delete (image->reloc_plan);
+    }
+  if (image->ifuncs != 0)
+    {
+      vdl_alloc_free (image->ifuncs);
+    }
+  futex_destruct (&image->ifuncs_futex);
+  if (image->symbol_hashes != 0)
+    {
+      vdl_alloc_free (image->symbol_hashes);
+    }
+  if (image->bind_profile != 0)
+    {
+      vdl_bind_profile_save (image);
+      vdl_alloc_free (image->bind_profile);
+      vdl_alloc_free (image->bind_profile_path);
+    }
+  vdl_alloc_delete (image);
+}
+
+void
+vdl_image_dynamic_initialize (struct VdlImage *image,
+			      unsigned long load_base)
+{
+  VDL_LOG_FUNCTION ("image=%p, load_base=0x%lx", image, load_base);
+  if (image->dynamic_initialized)
+    {
+      return;
+    }
+  image->dynamic_initialized = 1;
+
+  ElfW(Dyn) *dynamic = (ElfW(Dyn)*)(load_base + image->dynamic);
+  ElfW(Dyn) *dyn = dynamic;
+  // do a first pass to get dt_strtab
+  while (dyn->d_tag != DT_NULL)
+    {
+      switch (dyn->d_tag)
+	{
+	case DT_STRTAB:
+	  image->dt_strtab = dyn->d_un.d_ptr;
+	  break;
+	}
+      dyn++;
+    }
+  const char *strtab = (const char *)(load_base + image->dt_strtab);
+  image->needed = vdl_list_new ();
+  dyn = dynamic;
+  while (dyn->d_tag != DT_NULL)
+    {
+      switch (dyn->d_tag)
+	{
+	case DT_RELENT:
+	  image->dt_relent = dyn->d_un.d_val;
+	  break;
+	case DT_RELSZ:
+	  image->dt_relsz = dyn->d_un.d_val;
+	  break;
+	case DT_REL:
+	  image->dt_rel = dyn->d_un.d_ptr;
+	  break;
+
+	case DT_RELAENT:
+	  image->dt_relaent = dyn->d_un.d_val;
+	  break;
+	case DT_RELASZ:
+	  image->dt_relasz = dyn->d_un.d_val;
+	  break;
+	case DT_RELA:
+	  image->dt_rela = dyn->d_un.d_ptr;
+	  break;
+
+	case DT_RELRSZ:
+	  image->dt_relrsz = dyn->d_un.d_val;
+	  break;
+	case DT_RELR:
+	  image->dt_relr = dyn->d_un.d_ptr;
+	  break;
+	case DT_RELRENT:
+	  image->dt_relrent = dyn->d_un.d_val;
+	  break;
+
+	case DT_RELCOUNT:
+	  image->dt_relcount = dyn->d_un.d_val;
+	  break;
+	case DT_RELACOUNT:
+	  image->dt_relacount = dyn->d_un.d_val;
+	  break;
+
+	case DT_PLTGOT:
+	  image->dt_pltgot = dyn->d_un.d_ptr;
+	  break;
+	case DT_JMPREL:
+	  image->dt_jmprel = dyn->d_un.d_ptr;
+	  break;
+	case DT_PLTREL:
+	  image->dt_pltrel = dyn->d_un.d_val;
+	  break;
+	case DT_PLTRELSZ:
+	  image->dt_pltrelsz = dyn->d_un.d_val;
+	  break;
+
+	case DT_SYMTAB:
+	  image->dt_symtab = dyn->d_un.d_ptr;
+	  break;
+	case DT_FLAGS:
+	  image->dt_flags |= dyn->d_un.d_val;
+	  break;
+
+	case DT_HASH:
+	  image->dt_hash = dyn->d_un.d_ptr;
+	  break;
+	case DT_GNU_HASH:
+	  image->dt_gnu_hash = dyn->d_un.d_ptr;
+	  break;
+
+	case DT_FINI:
+	  image->dt_fini = dyn->d_un.d_ptr;
+	  break;
+	case DT_FINI_ARRAY:
+	  image->dt_fini_array = dyn->d_un.d_ptr;
+	  break;
+	case DT_FINI_ARRAYSZ:
+	  image->dt_fini_arraysz = dyn->d_un.d_val;
+	  break;
+
+	case DT_INIT:
+	  image->dt_init = dyn->d_un.d_ptr;
+	  break;
+	case DT_INIT_ARRAY:
+	  image->dt_init_array = dyn->d_un.d_ptr;
+	  break;
+	case DT_INIT_ARRAYSZ:
+	  image->dt_init_arraysz = dyn->d_un.d_val;
+	  break;
+
+	case DT_VERSYM:
+	  image->dt_versym = dyn->d_un.d_ptr;
+	  break;
+	case DT_VERDEF:
+	  image->dt_verdef = dyn->d_un.d_ptr;
+	  break;
+	case DT_VERDEFNUM:
+	  image->dt_verdefnum = dyn->d_un.d_val;
+	  break;
+	case DT_VERNEED:
+	  image->dt_verneed = dyn->d_un.d_ptr;
+	  break;
+	case DT_VERNEEDNUM:
+	  image->dt_verneednum = dyn->d_un.d_val;
+	  break;
+	case DT_RPATH:
+	  VDL_LOG_ASSERT (image->dt_strtab != 0, "no strtab for RPATH");
+	  image->dt_rpath = image->dt_strtab + dyn->d_un.d_val;
+	  break;
+	case DT_RUNPATH:
+	  VDL_LOG_ASSERT (image->dt_strtab != 0, "no strtab for RUNPATH");
+	  image->dt_runpath = image->dt_strtab + dyn->d_un.d_val;
+	  break;
+	case DT_BIND_NOW:
+	  // transform DT_BIND_NOW in equivalent DF_BIND_NOW
+	  image->dt_flags |= DF_BIND_NOW;
+	  break;
+	case DT_FLAGS_1:
+	  if (dyn->d_un.d_val & DF_1_NOW)
+	    {
+	      image->dt_flags |= DF_BIND_NOW;
+	    }
+	  break;
+	case DT_TEXTREL:
+	  // transfor DT_TEXTREL in equivalent DF_TEXTREL
+	  image->dt_flags |= DF_TEXTREL;
+	  break;
+	case DT_SONAME:
+	  image->dt_soname = image->dt_strtab + dyn->d_un.d_val;
+	  break;
+	case DT_NEEDED:
+	  if (image->dt_strtab != 0)
+	    {
+	      const char *str = strtab + dyn->d_un.d_val;
+	      VDL_LOG_DEBUG ("needed=%s\n", str);
+	      vdl_list_push_back (image->needed, vdl_utils_strdup (str));
+	    }
+	  break;
+	}
+      dyn++;
+    }
+
+  image->rpath = vdl_utils_splitpath ((image->dt_rpath != 0)?
+				      (const char *)(load_base + image->dt_rpath):0);
+  image->runpath = vdl_utils_splitpath ((image->dt_runpath != 0)?
+					(const char *)(load_base + image->dt_runpath):0);
+}
+
+static struct VdlImageIfunc *
+image_ifunc_slot (struct VdlImageIfunc *ifuncs, uint32_t size,
+		  unsigned long resolver)
+{
+  uint32_t i = image_hash (0, resolver) & (size - 1);
+  while (ifuncs[i].resolver != 0 && ifuncs[i].resolver != resolver)
+    {
+      i = (i + 1) & (size - 1);
+    }
+  return &ifuncs[i];
+}
+
+static void
+image_ifunc_insert (struct VdlImage *image,
+		    unsigned long resolver, unsigned long value)
+{
+  // keep the table at most half full
+  if ((image->ifuncs_n + 1) * 2 > image->ifuncs_size)
+    {
+      uint32_t size = (image->ifuncs_size == 0)?16:image->ifuncs_size * 2;
+      struct VdlImageIfunc *ifuncs = vdl_alloc_malloc (size * sizeof (struct VdlImageIfunc));
+      vdl_memset (ifuncs, 0, size * sizeof (struct VdlImageIfunc));
+      uint32_t i;
+      for (i = 0; i < image->ifuncs_size; i++)
+	{
+	  struct VdlImageIfunc *old = &image->ifuncs[i];
+	  if (old->resolver != 0)
+	    {
+	      *image_ifunc_slot (ifuncs, size, old->resolver) = *old;
+	    }
+	}
+      if (image->ifuncs != 0)
+	{
+	  vdl_alloc_free (image->ifuncs);
+	}
+      image->ifuncs = ifuncs;
+      image->ifuncs_size = size;
+    }
+  struct VdlImageIfunc *slot = image_ifunc_slot (image->ifuncs, image->ifuncs_size,
+						 resolver);
+  if (slot->resolver == 0)
+    {
+      // another thread might have inserted it while we were
+      // calling the resolver.
+      slot->resolver = resolver;
+      slot->value = value;
+      image->ifuncs_n++;
+    }
+}
+
+unsigned long
+vdl_image_ifunc_call (struct VdlImage *image,
+		      unsigned long load_base,
+		      unsigned long resolver)
+{
+  VDL_LOG_FUNCTION ("image=%p, load_base=0x%lx, resolver=0x%lx",
+		    image, load_base, resolver);
+  // images which are not registered are never shared so
+  // there is no point in caching their resolvers.
+  bool cache = image->registered && g_vdl.ifunc_cache && resolver != 0;
+  if (cache)
+    {
+      futex_lock (&image->ifuncs_futex);
+      if (image->ifuncs_size != 0)
+	{
+	  struct VdlImageIfunc *slot = image_ifunc_slot (image->ifuncs,
+							 image->ifuncs_size,
+							 resolver);
+	  if (slot->resolver == resolver)
+	    {
+	      unsigned long value = slot->value;
+	      futex_unlock (&image->ifuncs_futex);
+	      return load_base + value;
+	    }
+	}
+      futex_unlock (&image->ifuncs_futex);
+    }
+
+  // We do not hold any lock while calling the resolver
+  // because it is user code.
+  unsigned long (*ifunc) (void) = (unsigned long (*) (void))(load_base + resolver);
+  unsigned long value = ifunc ();
+
+  // The resolvers select an implementation based only on the
+  // features of the cpu. An address outside of this image could
+  // not be rebased in another mapping so, we do not cache it.
+  if (cache &&
+      value >= load_base + image->mapping_start &&
+      value < load_base + image->mapping_start + image->mapping_size)
+    {
+      futex_lock (&image->ifuncs_futex);
+      image_ifunc_insert (image, resolver, value - load_base);
+      futex_unlock (&image->ifuncs_futex);
+    }
+  return value;
+}
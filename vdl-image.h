@@ -0,0 +1,164 @@
+#ifndef VDL_IMAGE_H
+#define VDL_IMAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <link.h>
+#include "futex.h"
+
+struct VdlList;
+struct VdlRelocPlan;
+
+// the value returned by an IFUNC resolver of an image.
+// Both fields are relative to the load base. A resolver
+// of zero marks an empty slot.
+struct VdlImageIfunc
+{
+  unsigned long resolver;
+  unsigned long value;
+};
+
+// Everything we know about an ELF file which depends neither on the
+// address at which it is mapped nor on the context it is mapped in.
+// All addresses stored here are relative to the load base of the
+// file, just like the p_vaddr fields of its program headers.
+// An image is shared by all the VdlFile instances which map the same
+// file (same st_dev/st_ino) so that loading a library in many
+// contexts reads and parses its headers only once.
+struct VdlImage
+{
+  // number of VdlFile instances which use this image.
+  uint32_t count;
+  // unique among all images ever created by this process.
+  unsigned long serial;
+  // indicates if this image is registered in g_vdl.images and can
+  // thus be reused by other VdlFile instances. Images created from
+  // a memory mapping done by someone else are not registered.
+  uint32_t registered : 1;
+  // indicates if the dt_ fields, needed, rpath and runpath have been
+  // initialized by vdl_image_dynamic_initialize.
+  uint32_t dynamic_initialized : 1;
+  // indicates if the bind_profile fields have been initialized.
+  uint32_t bind_profile_initialized : 1;
+  // indicates if bind_profile has changed since it was read.
+  uint32_t bind_profile_dirty : 1;
+  // indicates if st_dev, st_ino, size, mtime and build_id have been
+  // initialized by vdl-resolve-cache.c. Always true for registered
+  // images, except for build_id.
+  uint32_t identity_initialized : 1;
+  dev_t st_dev;
+  ino_t st_ino;
+  // used to detect that the file was modified in place.
+  off_t size;
+  time_t mtime;
+  // a hash of the NT_GNU_BUILD_ID note or zero if there is none.
+  uint64_t build_id;
+
+  ElfW(Half) e_type;
+  ElfW(Phdr) *phdr;
+  uint32_t phnum;
+  // the list of VdlFileMap which describe the PT_LOAD entries.
+  struct VdlList *maps;
+  // the area covered by all maps and the file offset of its start.
+  unsigned long mapping_start;
+  unsigned long mapping_size;
+  unsigned long mapping_offset;
+  // the p_vaddr of the PT_DYNAMIC area
+  unsigned long dynamic;
+
+  // the content of the DYNAMIC section. The fields which are
+  // pointers in VdlFile are stored here as addresses relative to
+  // the load base or zero if the entry is not present.
+  unsigned long dt_relent;
+  unsigned long dt_relsz;
+  unsigned long dt_rel;
+  unsigned long dt_relaent;
+  unsigned long dt_relasz;
+  unsigned long dt_rela;
+  unsigned long dt_relrsz;
+  unsigned long dt_relr;
+  unsigned long dt_relrent;
+  unsigned long dt_relcount;
+  unsigned long dt_relacount;
+  unsigned long dt_pltgot;
+  unsigned long dt_jmprel;
+  unsigned long dt_pltrel;
+  unsigned long dt_pltrelsz;
+  unsigned long dt_strtab;
+  unsigned long dt_symtab;
+  unsigned long dt_flags;
+  unsigned long dt_hash;
+  unsigned long dt_gnu_hash;
+  unsigned long dt_fini;
+  unsigned long dt_fini_array;
+  unsigned long dt_fini_arraysz;
+  unsigned long dt_init;
+  unsigned long dt_init_array;
+  unsigned long dt_init_arraysz;
+  unsigned long dt_versym;
+  unsigned long dt_verdef;
+  unsigned long dt_verdefnum;
+  unsigned long dt_verneed;
+  unsigned long dt_verneednum;
+  unsigned long dt_rpath;
+  unsigned long dt_runpath;
+  unsigned long dt_soname;
+  // the DT_NEEDED entries, as a list of strings.
+  struct VdlList *needed;
+  // the DT_RPATH and DT_RUNPATH entries split in lists of directories.
+  struct VdlList *rpath;
+  struct VdlList *runpath;
+  // the symbols resolved by the relocations of the first
+  // file which was relocated with this image. See vdl-reloc.c
+  struct VdlRelocPlan *reloc_plan;
+  // an open-addressing hash table of the IFUNC resolvers called so
+  // far in any mapping of this image, keyed by resolver. ifuncs_size
+  // is zero or a power of two. Protected by ifuncs_futex because the
+  // IRELATIVE relocations are processed without holding g_vdl.futex.
+  struct VdlImageIfunc *ifuncs;
+  uint32_t ifuncs_size;
+  uint32_t ifuncs_n;
+  struct Futex ifuncs_futex;
+  // a bitmap of the dt_jmprel entries which were resolved lazily
+  // in this run or an earlier one. zero if LD_BIND_PROFILE is not
+  // set. See vdl-bind-profile.c
+  uint32_t *bind_profile;
+  uint32_t bind_profile_n;
+  char *bind_profile_path;
+  // the identity of the file the profile was recorded for.
+  off_t bind_profile_size;
+  time_t bind_profile_mtime;
+  // the gnu hash of the name of the symbols used by relocations,
+  // indexed by symbol index and calculated on demand. An entry of 
+  // zero has not been calculated yet. See vdl-reloc.c
+  uint32_t *symbol_hashes;
+  uint32_t symbol_hashes_size;
+};
+
+// takes ownership of phdr and maps. The new image has a count of 1.
+struct VdlImage *vdl_image_new (ElfW(Half) e_type,
+				ElfW(Phdr) *phdr, uint32_t phnum,
+				struct VdlList *maps, unsigned long dynamic);
+// make the image available to vdl_image_find.
+void vdl_image_register (struct VdlImage *image, const struct stat *st_buf);
+// return a registered image which describes the file identified by
+// st_buf with a new reference or zero if there is none.
+struct VdlImage *vdl_image_find (const struct stat *st_buf);
+void vdl_image_ref (struct VdlImage *image);
+// release a reference and delete the image when the last one is gone.
+void vdl_image_unref (struct VdlImage *image);
+// parse the DYNAMIC section of a mapping of this image located at
+// load_base. Does nothing if this was already done by an earlier
+// mapping. Must be called before the DYNAMIC section is relocated.
+void vdl_image_dynamic_initialize (struct VdlImage *image,
+				   unsigned long load_base);
+// return the address selected by the IFUNC resolver located at
+// offset resolver in the mapping of this image at load_base.
+// The resolver is called only if no other mapping of the image
+// called it already and returned an address within the image.
+unsigned long vdl_image_ifunc_call (struct VdlImage *image,
+				    unsigned long load_base,
+				    unsigned long resolver);
+
+#endif /* VDL_IMAGE_H */
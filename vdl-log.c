@@ -57,10 +57,14 @@ void vdl_log_set (const char *debug_str)
 	{
 	  logging |= VDL_LOG_REL;
 	}
+      else if (vdl_utils_strisequal (*cur, "stats"))
+	{
+	  logging |= VDL_LOG_STAT;
+	}
       else if (vdl_utils_strisequal (*cur, "help"))
 	{
 	  VDL_LOG_ERROR ("Available logging levels: debug, "
-			 "function, error, assert, symbol-fail, symbol-ok, reloc\n");
+			 "function, error, assert, symbol-fail, symbol-ok, reloc, stats\n");
 	}
     }
   g_logging |= logging;
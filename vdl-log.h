@@ -1,6 +1,7 @@
 #ifndef VDL_LOG_H
 #define VDL_LOG_H
 
+#include <stdint.h>
 // for system_exit in VDL_LOG_ASSERT
 #include "system.h"
 
@@ -12,15 +13,31 @@ enum VdlLog {
   VDL_LOG_SYM_FAIL = (1<<4),
   VDL_LOG_REL      = (1<<5),
   VDL_LOG_SYM_OK   = (1<<6),
-  VDL_LOG_PRINT    = (1<<7)
+  VDL_LOG_PRINT    = (1<<7),
+  VDL_LOG_STAT     = (1<<8)
 };
 
+// the set of enabled VdlLog channels. Checked before calling 
+// vdl_log_printf by the macros of the hot paths to avoid evaluating
+// their arguments when they are disabled.
+extern uint32_t g_logging;
+
 void vdl_log_printf (enum VdlLog log, const char *str, ...);
 #define VDL_LOG_FUNCTION(str,...)					\
-  vdl_log_printf (VDL_LOG_FUNC, "%s:%d, %s (" str ")\n",		\
-		  __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define VDL_LOG_DEBUG(str,...) \
-  vdl_log_printf (VDL_LOG_DBG, str, ##__VA_ARGS__)
+  do {									\
+    if (g_logging & VDL_LOG_FUNC)					\
+      {									\
+	vdl_log_printf (VDL_LOG_FUNC, "%s:%d, %s (" str ")\n",		\
+			__FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__); \
+      }									\
+  } while (0)
+#define VDL_LOG_DEBUG(str,...)						\
+  do {									\
+    if (g_logging & VDL_LOG_DBG)					\
+      {									\
+	vdl_log_printf (VDL_LOG_DBG, str, ##__VA_ARGS__);		\
+      }									\
+  } while (0)
 #define VDL_LOG_ERROR(str,...) \
   vdl_log_printf (VDL_LOG_ERR, "%s:%d:%s: " str,		\
 		  __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
@@ -32,6 +49,8 @@ void vdl_log_printf (enum VdlLog log, const char *str, ...);
   vdl_log_printf (VDL_LOG_SYM_OK, "Resolved symbol=%s, from file=\"%s\", in file=\"%s\":0x%x\n", \
 		  symbol_name, from->filename, match.file->filename,	\
 		  match.file->load_base + match.symbol->st_value)
+#define VDL_LOG_STATS(str,...) \
+  vdl_log_printf (VDL_LOG_STAT, str, ##__VA_ARGS__)
 #define VDL_LOG_RELOC(rel)					      \
   vdl_log_printf (VDL_LOG_REL, "Unhandled reloc type=0x%x at=0x%x\n", \
 		  ELFW_R_TYPE (rel->r_info), rel->r_offset)
@@ -4,9 +4,13 @@
 #include "vdl-list.h"
 #include "vdl-context.h"
 #include "vdl-file.h"
+#include "vdl-hashmap.h"
+#include "vdl-alloc.h"
+#include "vdl-mem.h"
+#include "vdl.h"
 #include <stdint.h>
 
-static uint32_t
+uint32_t
 vdl_gnu_hash (const char *s)
 {
   // Copy/paste from the glibc source code.
@@ -21,7 +25,7 @@ vdl_gnu_hash (const char *s)
   return h;
 }
 
-static unsigned long
+unsigned long
 vdl_elf_hash (const char *n)
 {
   // Copy/paste from the ELF specification (figure 2-9)
@@ -42,6 +46,7 @@ struct VdlFileLookupIterator
   const char *name;
   const char *dt_strtab;
   ElfW(Sym) *dt_symtab;
+  uint32_t gnu_hash;
   enum {
     ELF_HASH,
     GNU_HASH,
@@ -56,10 +61,349 @@ struct VdlFileLookupIterator
     struct {
       uint32_t current;
       uint32_t *cur_hash;
+      // zero unless the hash table was synthesized: in this case,
+      // the symbol index of current is *cur_index.
+      uint32_t *cur_index;
     } gnu;
   } u;
 };
 
+// Fill the version table of file if versions is not zero and
+// return its size, that is, the largest version index plus one.
+// Versions needed are stored after versions defined so that, if 
+// an index is used by both (this should never happen), the 
+// needed version wins, as it always did in sym_to_ver_req.
+static uint32_t
+file_versions_fill (const struct VdlFile *file, struct VdlFileVersion *versions)
+{
+  const char *dt_strtab = file->dt_strtab;
+  uint32_t size = 0;
+  if (file->dt_verdef != 0 && file->dt_verdefnum != 0)
+    {
+      // the filename comes from the base definition (i.e., the first entry)
+      // in the verdef array.
+      ElfW(Verdef) *base = file->dt_verdef;
+      ElfW(Verdaux) *base_verdaux = (ElfW(Verdaux)*)(((unsigned long)base)+base->vd_aux);
+      ElfW(Verdef) *cur, *prev;
+      for (prev = 0, cur = file->dt_verdef; cur != prev;
+	   prev = cur, cur = (ElfW(Verdef)*)(((unsigned long)cur)+cur->vd_next))
+	{
+	  VDL_LOG_ASSERT (cur->vd_version == 1, "version number invalid for Verdef");
+	  size = vdl_utils_max (size, cur->vd_ndx + 1U);
+	  if (versions != 0)
+	    {
+	      ElfW(Verdaux) *verdaux = (ElfW(Verdaux)*)(((unsigned long)cur)+cur->vd_aux);
+	      versions[cur->vd_ndx].name = dt_strtab + verdaux->vda_name;
+	      versions[cur->vd_ndx].filename = dt_strtab + base_verdaux->vda_name;
+	      versions[cur->vd_ndx].hash = cur->vd_hash;
+	    }
+	}
+    }
+  if (file->dt_verneed != 0 && file->dt_verneednum != 0)
+    {
+      ElfW(Verneed) *cur, *prev;
+      for (cur = file->dt_verneed, prev = 0; 
+	   cur != prev; 
+	   prev = cur, cur = (ElfW(Verneed) *)(((unsigned long)cur)+cur->vn_next))
+	{
+	  VDL_LOG_ASSERT (cur->vn_version == 1, "version number invalid for Verneed");
+	  ElfW(Vernaux) *cur_aux, *prev_aux;
+	  for (cur_aux = (ElfW(Vernaux)*)(((unsigned long)cur)+cur->vn_aux), prev_aux = 0;
+	       cur_aux != prev_aux; 
+	       prev_aux = cur_aux, cur_aux = (ElfW(Vernaux)*)(((unsigned long)cur_aux)+cur_aux->vna_next))
+	    {
+	      size = vdl_utils_max (size, cur_aux->vna_other + 1U);
+	      if (versions != 0)
+		{
+		  versions[cur_aux->vna_other].name = dt_strtab + cur_aux->vna_name;
+		  versions[cur_aux->vna_other].filename = dt_strtab + cur->vn_file;
+		  versions[cur_aux->vna_other].hash = cur_aux->vna_hash;
+		}
+	    }
+	}
+    }
+  return size;
+}
+
+static void
+file_versions_initialize (struct VdlFile *file)
+{
+  file->versions = 0;
+  file->versions_size = 0;
+  if (file->dt_strtab == 0 || file->dt_versym == 0)
+    {
+      return;
+    }
+  uint32_t size = file_versions_fill (file, 0);
+  if (size == 0)
+    {
+      return;
+    }
+  struct VdlFileVersion *versions = 
+    vdl_alloc_malloc (size * sizeof (struct VdlFileVersion));
+  vdl_memset (versions, 0, size * sizeof (struct VdlFileVersion));
+  file_versions_fill (file, versions);
+  file->versions = versions;
+  file->versions_size = size;
+}
+
+static inline bool
+symbol_is_defined (const ElfW(Sym) *sym)
+{
+  return sym->st_name != 0 && sym->st_shndx != SHN_UNDEF;
+}
+
+// Build a gnu-style hash table in loader memory for a file which
+// has only a dt_hash table or no hash table at all. Because we
+// can't reorder the symbol table, as the static linker does, we
+// sort the chains and use gnu_indices to map each chain entry back
+// to its symbol table index.
+static void
+file_gnu_hash_synthesize (struct VdlFile *file)
+{
+  const char *dt_strtab = file->dt_strtab;
+  ElfW(Sym) *dt_symtab = file->dt_symtab;
+  unsigned long nsyms = vdl_lookup_symbol_count (file);
+  if (dt_strtab == 0 || nsyms == 0)
+    {
+      return;
+    }
+  uint32_t n = 0;
+  unsigned long i;
+  for (i = 1; i < nsyms; i++)
+    {
+      if (symbol_is_defined (&dt_symtab[i]))
+	{
+	  n++;
+	}
+    }
+  if (n == 0)
+    {
+      return;
+    }
+  uint32_t nbuckets = n / 2 + 1;
+  // aim for 8 bits per symbol in the bloom filter.
+  uint32_t maskwords = 1;
+  while (maskwords * __ELF_NATIVE_CLASS < n * 8)
+    {
+      maskwords <<= 1;
+    }
+  uint32_t shift2 = 6;
+  unsigned long size = maskwords * sizeof (ElfW(Addr)) + 
+    (nbuckets + n + n) * sizeof (uint32_t);
+  uint8_t *buffer = vdl_alloc_malloc (size);
+  vdl_memset (buffer, 0, size);
+  ElfW(Addr) *bloom = (ElfW(Addr) *)buffer;
+  uint32_t *buckets = (uint32_t *)(buffer + maskwords * sizeof (ElfW(Addr)));
+  uint32_t *chains = &buckets[nbuckets];
+  uint32_t *indices = &chains[n];
+  uint32_t *hashes = vdl_alloc_malloc (n * sizeof (uint32_t));
+  uint32_t *cursor = vdl_alloc_malloc (nbuckets * sizeof (uint32_t));
+  vdl_memset (cursor, 0, nbuckets * sizeof (uint32_t));
+
+  // first, hash every symbol, fill the bloom filter and 
+  // count the number of symbols in each bucket.
+  uint32_t k = 0;
+  for (i = 1; i < nsyms; i++)
+    {
+      if (!symbol_is_defined (&dt_symtab[i]))
+	{
+	  continue;
+	}
+      uint32_t h = vdl_gnu_hash (dt_strtab + dt_symtab[i].st_name);
+      hashes[k] = h;
+      k++;
+      cursor[h % nbuckets]++;
+      ElfW(Addr) bitmask = 
+	(((ElfW(Addr))1) << (h % __ELF_NATIVE_CLASS)) |
+	(((ElfW(Addr))1) << ((h >> shift2) % __ELF_NATIVE_CLASS));
+      bloom[(h / __ELF_NATIVE_CLASS) & (maskwords - 1)] |= bitmask;
+    }
+  // then, calculate the start of each chain. Chain positions
+  // are offset by one (symndx) because zero marks an empty bucket.
+  uint32_t start = 0;
+  uint32_t b;
+  for (b = 0; b < nbuckets; b++)
+    {
+      uint32_t count = cursor[b];
+      buckets[b] = (count != 0)?start + 1:0;
+      cursor[b] = start;
+      start += count;
+    }
+  // fill the chains, in symbol table order within each chain.
+  k = 0;
+  for (i = 1; i < nsyms; i++)
+    {
+      if (!symbol_is_defined (&dt_symtab[i]))
+	{
+	  continue;
+	}
+      uint32_t h = hashes[k];
+      k++;
+      uint32_t position = cursor[h % nbuckets];
+      cursor[h % nbuckets]++;
+      chains[position] = h & ~1;
+      indices[position] = i;
+    }
+  // finally, mark the end of each chain.
+  for (b = 0; b < nbuckets; b++)
+    {
+      if (buckets[b] != 0)
+	{
+	  chains[cursor[b] - 1] |= 1;
+	}
+    }
+  vdl_alloc_free (cursor);
+  vdl_alloc_free (hashes);
+
+  file->gnu_nbuckets = nbuckets;
+  file->gnu_symndx = 1;
+  file->gnu_maskwords_mask = maskwords - 1;
+  file->gnu_shift2 = shift2;
+  file->gnu_bloom = bloom;
+  file->gnu_buckets = buckets;
+  file->gnu_chains = chains;
+  file->gnu_indices = indices;
+  file->gnu_indices_size = n;
+}
+
+unsigned long
+vdl_lookup_symbol_count (const struct VdlFile *file)
+{
+  const char *dt_strtab = file->dt_strtab;
+  ElfW(Sym) *dt_symtab = file->dt_symtab;
+  if (dt_symtab == 0)
+    {
+      return 0;
+    }
+  if (file->dt_hash != 0)
+    {
+      // the number of chains is the number of symbols
+      return file->dt_hash[1];
+    }
+  if (file->dt_gnu_hash != 0)
+    {
+      // the symbols hashed by the table come last: the end of the
+      // chain which starts last is the end of the symbol table.
+      uint32_t last = 0;
+      uint32_t b;
+      for (b = 0; b < file->gnu_nbuckets; b++)
+	{
+	  last = vdl_utils_max (last, file->gnu_buckets[b]);
+	}
+      if (last < file->gnu_symndx)
+	{
+	  return file->gnu_symndx;
+	}
+      while ((file->gnu_chains[last - file->gnu_symndx] & 1) == 0)
+	{
+	  last++;
+	}
+      return last + 1;
+    }
+  if ((unsigned long)dt_strtab > (unsigned long)dt_symtab)
+    {
+      // there is no way to know the size of the symbol table 
+      // without a hash table but the static linker always puts 
+      // the string table right after the symbol table.
+      return ((unsigned long)dt_strtab - (unsigned long)dt_symtab) / sizeof (ElfW(Sym));
+    }
+  return 0;
+}
+
+void
+vdl_lookup_file_initialize (struct VdlFile *file)
+{
+  file_versions_initialize (file);
+
+  uint32_t *dt_gnu_hash = file->dt_gnu_hash;
+  file->gnu_indices = 0;
+  file->gnu_indices_size = 0;
+  if (dt_gnu_hash == 0)
+    {
+      file->gnu_nbuckets = 0;
+      file->gnu_symndx = 0;
+      file->gnu_maskwords_mask = 0;
+      file->gnu_shift2 = 0;
+      file->gnu_bloom = 0;
+      file->gnu_buckets = 0;
+      file->gnu_chains = 0;
+      if (g_vdl.synth_hash)
+	{
+	  file_gnu_hash_synthesize (file);
+	}
+      return;
+    }
+  // read header
+  uint32_t nbuckets = dt_gnu_hash[0];
+  uint32_t symndx = dt_gnu_hash[1];
+  uint32_t maskwords = dt_gnu_hash[2];
+  uint32_t shift2 = dt_gnu_hash[3];
+  // read other parts of hash table
+  ElfW(Addr) *bloom = (ElfW(Addr)*)(dt_gnu_hash + 4);
+  uint32_t *buckets = (uint32_t *)(((unsigned long)bloom) + maskwords * sizeof (ElfW(Addr)));
+  VDL_LOG_ASSERT ((maskwords & (maskwords - 1)) == 0,
+		  "Invalid maskwords in gnu hash table of %s", file->filename);
+  file->gnu_nbuckets = nbuckets;
+  file->gnu_symndx = symndx;
+  file->gnu_maskwords_mask = maskwords - 1;
+  file->gnu_shift2 = shift2;
+  file->gnu_bloom = bloom;
+  file->gnu_buckets = buckets;
+  file->gnu_chains = &buckets[nbuckets];
+}
+
+void
+vdl_lookup_file_finalize (struct VdlFile *file)
+{
+  if (file->versions != 0)
+    {
+      vdl_alloc_free (file->versions);
+    }
+  if (file->gnu_indices != 0)
+    {
+      // the synthesized hash table is a single buffer
+      vdl_alloc_free (file->gnu_bloom);
+    }
+  file->versions = 0;
+  file->versions_size = 0;
+  file->gnu_bloom = 0;
+  file->gnu_buckets = 0;
+  file->gnu_chains = 0;
+  file->gnu_indices = 0;
+  file->gnu_indices_size = 0;
+}
+
+// Returns false only if we are sure that the symbol is not 
+// present in this file.
+static inline bool
+vdl_lookup_file_bloom (const struct VdlFile *file, uint32_t gnu_hash)
+{
+  if (file->gnu_bloom == 0)
+    {
+      return true;
+    }
+  ElfW(Addr) bitmask = 
+    (((ElfW(Addr))1) << (gnu_hash % __ELF_NATIVE_CLASS)) |
+    (((ElfW(Addr))1) << ((gnu_hash >> file->gnu_shift2) % __ELF_NATIVE_CLASS));
+  ElfW(Addr) bitmask_word = 
+    file->gnu_bloom[(gnu_hash / __ELF_NATIVE_CLASS) & file->gnu_maskwords_mask];
+  return (bitmask_word & bitmask) == bitmask;
+}
+
+static inline void
+vdl_lookup_file_prefetch (const struct VdlFile *file, uint32_t gnu_hash)
+{
+  if (file->gnu_bloom == 0)
+    {
+      return;
+    }
+  __builtin_prefetch (&file->gnu_bloom[(gnu_hash / __ELF_NATIVE_CLASS) & 
+				       file->gnu_maskwords_mask]);
+  __builtin_prefetch (&file->gnu_buckets[gnu_hash % file->gnu_nbuckets]);
+}
+
+// The caller is responsible for checking vdl_lookup_file_bloom first.
 static struct VdlFileLookupIterator 
 vdl_lookup_file_begin (const struct VdlFile *file,
 		       const char *name, 
@@ -70,48 +414,31 @@ vdl_lookup_file_begin (const struct VdlFile *file,
 		    name, elf_hash, gnu_hash, file->filename);
   struct VdlFileLookupIterator i;
   i.name = name;
+  i.gnu_hash = gnu_hash;
   // first, gather information needed to look into the hash table
   i.dt_strtab = file->dt_strtab;
   i.dt_symtab = file->dt_symtab;
   ElfW(Word) *dt_hash = file->dt_hash;
-  uint32_t *dt_gnu_hash = file->dt_gnu_hash;
 
   if (i.dt_strtab == 0 || i.dt_symtab == 0)
     {
       i.type = NO_SYM;
     }
-  else if (dt_gnu_hash != 0)
+  else if (file->gnu_bloom != 0)
     {
       i.type = NO_SYM; // by default, unless we can find a matching chain
-      // read header
-      uint32_t nbuckets = dt_gnu_hash[0];
-      uint32_t symndx = dt_gnu_hash[1];
-      uint32_t maskwords = dt_gnu_hash[2];
-      uint32_t shift2 = dt_gnu_hash[3];
-      // read other parts of hash table
-      ElfW(Addr) *bloom = (ElfW(Addr)*)(dt_gnu_hash + 4);
-      uint32_t *buckets = (uint32_t *)(((unsigned long)bloom) + maskwords * sizeof (ElfW(Addr)));
-      uint32_t *chains = &buckets[nbuckets];
-
-      // test against the Bloom filter
-      uint32_t hashbit1 = gnu_hash % __ELF_NATIVE_CLASS;
-      uint32_t hashbit2 = (gnu_hash >> shift2) % __ELF_NATIVE_CLASS;
-      ElfW(Addr) bitmask1 = 1;
-      bitmask1 <<= hashbit1;
-      ElfW(Addr) bitmask2 = 1;
-      bitmask2 <<= hashbit2;
-      ElfW(Addr) bitmask = bitmask1 | bitmask2;
-      ElfW(Addr) bitmask_word = bloom[(gnu_hash / __ELF_NATIVE_CLASS) % maskwords];
-      if ((bitmask_word & bitmask) == bitmask)
-	{
-	  // check bucket
-	  uint32_t chain = buckets[gnu_hash % nbuckets];
-	  if (chain != 0)
+      // check bucket
+      uint32_t chain = file->gnu_buckets[gnu_hash % file->gnu_nbuckets];
+      if (chain != 0)
+	{
+	  // we have the start of the chain !
+	  i.type = GNU_HASH;
+	  i.u.gnu.current = chain;
+	  i.u.gnu.cur_hash = &file->gnu_chains[chain - file->gnu_symndx];
+	  i.u.gnu.cur_index = 0;
+	  if (file->gnu_indices != 0)
 	    {
-	      // we have the start of the chain !
-	      i.type = GNU_HASH;
-	      i.u.gnu.current = chain;
-	      i.u.gnu.cur_hash = &chains[chain-symndx];
+	      i.u.gnu.cur_index = &file->gnu_indices[chain - file->gnu_symndx];
 	    }
 	}
     }
@@ -180,16 +507,21 @@ vdl_lookup_file_has_next (const struct VdlFileLookupIterator *i)
   case GNU_HASH: {
     unsigned long current = i->u.gnu.current;
     uint32_t *cur_hash = i->u.gnu.cur_hash;
+    uint32_t *cur_index = i->u.gnu.cur_index;
     unsigned long found = 0;
     while (cur_hash != 0)
       {
 	// The values stored in the hash table are
-	// an index in the symbol table.
-	if (i->dt_symtab[current].st_name != 0 && 
-	    i->dt_symtab[current].st_shndx != SHN_UNDEF)
+	// an index in the symbol table. The chain also stores the
+	// hash of each symbol name, save for the low bit, so we can
+	// avoid comparing strings which cannot match.
+	unsigned long sym = (cur_index != 0)?*cur_index:current;
+	if ((*cur_hash | 1) == (i->gnu_hash | 1) &&
+	    i->dt_symtab[sym].st_name != 0 && 
+	    i->dt_symtab[sym].st_shndx != SHN_UNDEF)
 	  {
 	    // the symbol name is an index in the string table
-	    if (vdl_utils_strisequal (i->dt_strtab + i->dt_symtab[current].st_name, i->name))
+	    if (vdl_utils_strisequal (i->dt_strtab + i->dt_symtab[sym].st_name, i->name))
 	      {
 		found = 1;
 		break;
@@ -201,6 +533,10 @@ vdl_lookup_file_has_next (const struct VdlFileLookupIterator *i)
 	    continue;
 	  }
 	cur_hash++;
+	if (cur_index != 0)
+	  {
+	    cur_index++;
+	  }
 	current++;
       }
     // as an optimization, to save us from iterating again
@@ -210,6 +546,7 @@ vdl_lookup_file_has_next (const struct VdlFileLookupIterator *i)
     struct VdlFileLookupIterator *i_unconst = (struct VdlFileLookupIterator *)i;
     i_unconst->u.gnu.current = current;
     i_unconst->u.gnu.cur_hash = cur_hash;
+    i_unconst->u.gnu.cur_index = cur_index;
     return found;
   } break;
   case ELF_SYM:
@@ -240,6 +577,10 @@ vdl_lookup_file_next (struct VdlFileLookupIterator *i)
   case GNU_HASH:
     VDL_LOG_ASSERT (vdl_lookup_file_has_next (i), "Next called while no data to read");
     unsigned long next = i->u.gnu.current;
+    if (i->u.gnu.cur_index != 0)
+      {
+	next = *(i->u.gnu.cur_index);
+      }
     if ((*(i->u.gnu.cur_hash) & 0x1) == 0x1)
       {
 	// if we have reached the end of the hash array,
@@ -251,6 +592,10 @@ vdl_lookup_file_next (struct VdlFileLookupIterator *i)
 	// otherwise, goto the next entry
 	i->u.gnu.current++;
 	i->u.gnu.cur_hash++;
+	if (i->u.gnu.cur_index != 0)
+	  {
+	    i->u.gnu.cur_index++;
+	  }
       }
     return next;
     break;
@@ -276,13 +621,16 @@ enum VdlVersionMatch
 // this function. It's not that it would be horrendously
 // hard to handle it but it would make our life harder
 // for the symbol replacement policy we use.
+// depends_on_from is set to true if the returned value would have
+// been different had 'from' been another file.
 static enum VdlVersionMatch
 symbol_version_matches (const struct VdlFile *in,
 			const struct VdlFile *from,
 			const char *from_ver_name,
 			const char *from_ver_filename,
 			unsigned long from_ver_hash,
-			unsigned long in_index)
+			unsigned long in_index,
+			bool *depends_on_from)
 {
   VDL_LOG_FUNCTION("%s %s %ld %ld\n", from_ver_name?from_ver_name:"", from_ver_filename?from_ver_filename:"", from_ver_hash, in_index);
   ElfW(Half) *in_dt_versym = in->dt_versym;
@@ -314,9 +662,6 @@ symbol_version_matches (const struct VdlFile *in,
   else
     {
       // ok, so, now, we have version requirements information.
-      ElfW(Verdef) *in_dt_verdef = in->dt_verdef;
-      ElfW(Verneed) *in_dt_verneed = in->dt_verneed;
-
       if (in_dt_versym == 0)
 	{
 	  // we have a version requirement but no version definition in this object
@@ -340,6 +685,7 @@ symbol_version_matches (const struct VdlFile *in,
 	{
 	  // this is a symbol with local scope
 	  // it's ok only if we reference it within the same file.
+	  *depends_on_from = true;
 	  if (in == from)
 	    {
 	      return VERSION_MATCH_PERFECT;
@@ -353,6 +699,7 @@ symbol_version_matches (const struct VdlFile *in,
 	{
 	  // if the high bit is set, this means that it is a 'hidden' symbol
 	  // which means that it can't be referenced from outside of its binary.
+	  *depends_on_from = true;
 	  if (in != from)
 	    {
 	      // the matching symbol we found is hidden and is located
@@ -360,165 +707,733 @@ symbol_version_matches (const struct VdlFile *in,
 	      return VERSION_MATCH_BAD;
 	    }
 	}
-      const char *in_dt_strtab = in->dt_strtab;
-      // try to lookup a matching version in the verdef array
-      {
-	ElfW(Verdef) *cur, *prev;
-	for (prev = 0, cur = in_dt_verdef; cur != prev;
-	     prev = cur, cur = (ElfW(Verdef)*)(((unsigned long)cur)+cur->vd_next))
-	  {
-	    VDL_LOG_ASSERT (cur->vd_version == 1, "version number invalid for Verdef");
-	    if (cur->vd_ndx == ver_index &&
-		cur->vd_hash == from_ver_hash)
-	      {
-		// the hash values of the version names are equal.
-		ElfW(Verdaux) *verdaux = (ElfW(Verdaux)*)(((unsigned long)cur)+cur->vd_aux);
-		if (vdl_utils_strisequal (in_dt_strtab + verdaux->vda_name, 
-					  from_ver_name))
-		  {
-		    // the version names are equal.
-		    return VERSION_MATCH_PERFECT;
-		  }
-	      }
-	  }
-      }
-      // and, then, try to lookup the verneed array
-      // XXX: this is something I really don't understand.
-      // XXX: yes, this is really buggy I think. Why are we doing it ?
-      {
-	ElfW(Verneed) *cur, *prev;
-	for (prev = 0, cur = in_dt_verneed; cur != prev;
-	     prev = cur, cur = (ElfW(Verneed)*)(((unsigned long)cur)+cur->vn_next))
-	  {
-	    VDL_LOG_ASSERT (cur->vn_version == 1, "version number invalid for Verneed");
-	    ElfW(Vernaux) *cur_aux, *prev_aux;
-	    for (cur_aux = (ElfW(Vernaux)*)(((unsigned long)cur)+cur->vn_aux), prev_aux = 0;
-		 cur_aux != prev_aux; 
-		 prev_aux = cur_aux, 
-		   cur_aux = (ElfW(Vernaux)*)(((unsigned long)cur_aux)+cur_aux->vna_next))
-	      {
-		if (cur_aux->vna_other == ver_index &&
-		    cur_aux->vna_hash == from_ver_hash)
-		  {
-		    // the hash values of the version names are equal.
-		    if (vdl_utils_strisequal (in_dt_strtab + cur_aux->vna_name, 
-					      from_ver_name))
-		      {
-			// the version names are equal.
-			return VERSION_MATCH_PERFECT;
-		      }
-		  }
-	      }
-	  }
-      }
+      // Note that a hidden symbol referenced from within its own file
+      // has an index larger than any valid index: it never matches.
+      if (ver_index < in->versions_size)
+	{
+	  const struct VdlFileVersion *version = &in->versions[ver_index];
+	  if (version->name != 0 &&
+	      version->hash == from_ver_hash &&
+	      vdl_utils_strisequal (version->name, from_ver_name))
+	    {
+	      // the version names are equal.
+	      return VERSION_MATCH_PERFECT;
+	    }
+	}
     }
   // the versions don't match.
   return VERSION_MATCH_BAD;
 }
 
+// the value of elf_hash before it is calculated. The sysv hash
+// is 28 bits wide so, it can't take this value.
+#define LOOKUP_ELF_HASH_NONE (~0UL)
+
+// Lookup the requested symbol in item. Returns true and fills result
+// if it was found there.
+static bool
+vdl_lookup_in_file (struct VdlFile *file,
+		    struct VdlFile *item,
+		    const char *name, 
+		    const char *ver_name,
+		    const char *ver_filename,
+		    unsigned long *elf_hash,
+		    uint32_t gnu_hash,
+		    unsigned long ver_hash,
+		    bool *depends_on_from,
+		    struct VdlLookupResult *result)
+{
+  int n_ambiguous_matches = 0;
+  unsigned long last_ambiguous_match, first_ambiguous_match;
+  struct VdlFile *first_ambiguous_match_item;
+  if (*elf_hash == LOOKUP_ELF_HASH_NONE && item->gnu_bloom == 0)
+    {
+      // the sysv hash is needed only by the files which have no 
+      // gnu hash table so, we calculate it at most once per lookup, 
+      // the first time we meet one.
+      *elf_hash = vdl_elf_hash (name);
+    }
+  struct VdlFileLookupIterator i = vdl_lookup_file_begin (item, name, *elf_hash, gnu_hash);
+  while (vdl_lookup_file_has_next (&i))
+    {
+      unsigned long index = vdl_lookup_file_next (&i);
+      enum VdlVersionMatch version_match = symbol_version_matches (item, file, 
+								   ver_name, ver_filename, ver_hash,
+								   index, depends_on_from);
+      if (version_match == VERSION_MATCH_PERFECT)
+	{
+	  // We have resolved the symbol
+	  result->file = item;
+	  result->symbol = &i.dt_symtab[index];
+	  result->found = true;
+	  return true;
+	}
+      else if (version_match == VERSION_MATCH_AMBIGUOUS)
+	{
+	  if (n_ambiguous_matches == 0)
+	    {
+	      first_ambiguous_match = index;
+	      first_ambiguous_match_item = item;
+	    }
+	  n_ambiguous_matches++;
+	  last_ambiguous_match = index;
+	}
+    }
+
+  unsigned long final_match;
+  struct VdlFile *final_item;      
+  if (n_ambiguous_matches == 1)
+    {
+      // if there is only one ambiguous match, it's not really ambiguous: it's a match !
+      final_match = last_ambiguous_match;
+      final_item = item;
+    }
+  else if (n_ambiguous_matches > 1)
+    {
+      // If we have multiple ambiguous matches, it means that we are doing
+      // a lookup for a symbol that has no version information and we found 
+      // more than one version of this symbol within the current file.
+      // In this case, we pick the 'oldest' symbol, that is, the first one
+      // we found. This is what I believe glibc is doing.
+      final_match = first_ambiguous_match;
+      final_item = first_ambiguous_match_item;
+    }
+  else
+    {
+      // no match
+      return false;
+    }
+  result->file = final_item;
+  result->symbol = &i.dt_symtab[final_match];
+  result->found = true;
+  return true;
+}
+
+// number of scope entries whose bloom filters are probed together.
+#define LOOKUP_BLOOM_BATCH 8
+
 static struct VdlLookupResult
 vdl_lookup_with_scope_internal (struct VdlFile *file,
 				const char *name, 
 				const char *ver_name,
 				const char *ver_filename,
-				unsigned long elf_hash,
+				unsigned long *elf_hash,
 				uint32_t gnu_hash,
 				unsigned long ver_hash,
 				enum VdlLookupFlag flags,
-				struct VdlList *scope)
+				struct VdlList *scope,
+				bool *depends_on_from)
 {
-  VDL_LOG_FUNCTION ("name=%s, ver_name=%s, ver_filename=%s, elf_hash=0x%lx, gnu_hash=0x%x, "
+  VDL_LOG_FUNCTION ("name=%s, ver_name=%s, ver_filename=%s, gnu_hash=0x%x, "
 		    "ver_hash=0x%x, flags=0x%x, scope=%p", 
 		    name, (ver_name!=0)?ver_name:"",(ver_filename!=0)?ver_filename:"",
-		    elf_hash, gnu_hash, ver_hash, flags, scope);
+		    gnu_hash, ver_hash, flags, scope);
 
+  struct VdlLookupResult result;
   // then, iterate scope until we find the requested symbol.
-  void **cur;
-  for (cur = vdl_list_begin (scope); cur != vdl_list_end (scope); cur = vdl_list_next (cur))
+  // Most files of a scope do not define the symbol we are looking for
+  // so, most of the time is spent failing bloom tests. To avoid
+  // stalling on the load of each bloom word in turn, we gather a 
+  // batch of files, prefetch all their bloom words and buckets, test 
+  // them all and only then look at the chains of the files which passed.
+  void **cur = vdl_list_begin (scope);
+  while (cur != vdl_list_end (scope))
     {
-      struct VdlFile *item = *cur;
-      if (flags & VDL_LOOKUP_NO_EXEC && 
-	  item->is_executable)
+      struct VdlFile *batch[LOOKUP_BLOOM_BATCH];
+      bool maybe[LOOKUP_BLOOM_BATCH];
+      uint32_t n = 0;
+      for (; cur != vdl_list_end (scope) && n < LOOKUP_BLOOM_BATCH; 
+	   cur = vdl_list_next (cur))
 	{
-	  // this flag specifies that we should not lookup symbols
-	  // in the main executable binary. see the definition of VDL_LOOKUP_NO_EXEC
-	  continue;
+	  struct VdlFile *item = *cur;
+	  if (flags & VDL_LOOKUP_NO_EXEC && 
+	      item->is_executable)
+	    {
+	      // this flag specifies that we should not lookup symbols
+	      // in the main executable binary. see the definition of VDL_LOOKUP_NO_EXEC
+	      continue;
+	    }
+	  vdl_lookup_file_prefetch (item, gnu_hash);
+	  batch[n] = item;
+	  n++;
 	}
-      int n_ambiguous_matches = 0;
-      unsigned long last_ambiguous_match, first_ambiguous_match;
-      struct VdlFile *first_ambiguous_match_item;
-      struct VdlFileLookupIterator i = vdl_lookup_file_begin (item, name, elf_hash, gnu_hash);
-      while (vdl_lookup_file_has_next (&i))
-	{
-	  unsigned long index = vdl_lookup_file_next (&i);
-	  enum VdlVersionMatch version_match = symbol_version_matches (item, file, 
-								       ver_name, ver_filename, ver_hash,
-								       index);
-	  if (version_match == VERSION_MATCH_PERFECT)
+      uint32_t k;
+      for (k = 0; k < n; k++)
+	{
+	  maybe[k] = vdl_lookup_file_bloom (batch[k], gnu_hash);
+	}
+      for (k = 0; k < n; k++)
+	{
+	  if (maybe[k] &&
+	      vdl_lookup_in_file (file, batch[k], name, ver_name, ver_filename,
+				  elf_hash, gnu_hash, ver_hash, depends_on_from,
+				  &result))
+	    {
+	      return result;
+	    }
+	}
+    }
+  result.found = false;
+  return result;
+}
+
+// An entry of the global scope index of a context.
+// The entries of a file are allocated in a single array
+// stored in VdlFile::global_index.
+struct VdlLookupIndexEntry
+{
+  struct VdlFile *file;
+  // index in dt_symtab
+  uint32_t index;
+  // key of this entry in VdlContext::global_index
+  uint32_t key;
+};
+
+// The low bit of the hash values stored in the gnu hash
+// chains is used as an end-of-chain marker so, we ignore it.
+#define GLOBAL_INDEX_KEY(gnu_hash) ((gnu_hash) >> 1)
+
+// Gather the symbols of file which can be found with
+// vdl_lookup_file_begin in the order in which they would
+// be returned by vdl_lookup_file_next. If entries is zero,
+// the symbols are just counted.
+static uint32_t
+global_index_gather (struct VdlFile *file, struct VdlLookupIndexEntry *entries)
+{
+  ElfW(Sym) *dt_symtab = file->dt_symtab;
+  const char *dt_strtab = file->dt_strtab;
+  uint32_t n = 0;
+  if (dt_strtab == 0 || dt_symtab == 0)
+    {
+      return 0;
+    }
+  if (file->gnu_bloom != 0)
+    {
+      uint32_t nbuckets = file->gnu_nbuckets;
+      uint32_t symndx = file->gnu_symndx;
+      uint32_t *buckets = file->gnu_buckets;
+      uint32_t *chains = file->gnu_chains;
+      uint32_t i;
+      for (i = 0; i < nbuckets; i++)
+	{
+	  uint32_t current = buckets[i];
+	  if (current == 0)
+	    {
+	      continue;
+	    }
+	  while (true)
 	    {
-	      // We have resolved the symbol
-	      if (item != file && file != 0)
+	      uint32_t chain = chains[current-symndx];
+	      uint32_t sym = current;
+	      if (file->gnu_indices != 0)
 		{
-		  // The symbol has been resolved in another binary. Make note of this.
-		  vdl_list_push_front (file->gc_symbols_resolved_in, item);
+		  sym = file->gnu_indices[current-symndx];
 		}
-	      struct VdlLookupResult result;
-	      result.file = item;
-	      result.symbol = &i.dt_symtab[index];
-	      result.found = true;
-	      return result;
+	      if (dt_symtab[sym].st_name != 0 && 
+		  dt_symtab[sym].st_shndx != SHN_UNDEF)
+		{
+		  if (entries != 0)
+		    {
+		      entries[n].file = file;
+		      entries[n].index = sym;
+		      entries[n].key = GLOBAL_INDEX_KEY (chain);
+		    }
+		  n++;
+		}
+	      if ((chain & 0x1) == 0x1)
+		{
+		  break;
+		}
+	      current++;
 	    }
-	  else if (version_match == VERSION_MATCH_AMBIGUOUS)
+	}
+    }
+  else if (file->dt_hash != 0)
+    {
+      ElfW(Word) *dt_hash = file->dt_hash;
+      ElfW(Word) nbuckets = dt_hash[0];
+      ElfW(Word) *chain = &dt_hash[2+nbuckets];
+      ElfW(Word) i;
+      for (i = 0; i < nbuckets; i++)
+	{
+	  ElfW(Word) current;
+	  for (current = dt_hash[2+i]; current != 0; current = chain[current])
 	    {
-	      if (n_ambiguous_matches == 0)
+	      if (dt_symtab[current].st_name == 0 ||
+		  dt_symtab[current].st_shndx == SHN_UNDEF)
+		{
+		  continue;
+		}
+	      if (entries != 0)
 		{
-		  first_ambiguous_match = index;
-		  first_ambiguous_match_item = item;
+		  const char *name = dt_strtab + dt_symtab[current].st_name;
+		  entries[n].file = file;
+		  entries[n].index = current;
+		  entries[n].key = GLOBAL_INDEX_KEY (vdl_gnu_hash (name));
 		}
-	      n_ambiguous_matches++;
-	      last_ambiguous_match = index;
+	      n++;
 	    }
 	}
+    }
+  return n;
+}
+
+void
+vdl_lookup_global_index_add (struct VdlContext *context, struct VdlFile *file)
+{
+  VDL_LOG_FUNCTION ("context=%p, file=%s", context, file->filename);
+  VDL_LOG_ASSERT (file->global_index == 0, "File already indexed");
+  uint32_t n = global_index_gather (file, 0);
+  if (n == 0)
+    {
+      return;
+    }
+  struct VdlLookupIndexEntry *entries = 
+    vdl_alloc_malloc (n * sizeof (struct VdlLookupIndexEntry));
+  global_index_gather (file, entries);
+  uint32_t i;
+  for (i = 0; i < n; i++)
+    {
+      vdl_hashmap_insert (context->global_index, entries[i].key, &entries[i]);
+    }
+  file->global_index = entries;
+  file->global_index_size = n;
+}
+
+void
+vdl_lookup_global_index_remove (struct VdlContext *context, struct VdlFile *file)
+{
+  VDL_LOG_FUNCTION ("context=%p, file=%s", context, file->filename);
+  if (file->global_index == 0)
+    {
+      return;
+    }
+  unsigned long i;
+  for (i = 0; i < file->global_index_size; i++)
+    {
+      struct VdlLookupIndexEntry *entry = &file->global_index[i];
+      vdl_hashmap_remove (context->global_index, entry->key, entry);
+    }
+  vdl_alloc_free (file->global_index);
+  file->global_index = 0;
+  file->global_index_size = 0;
+}
 
-      unsigned long final_match;
-      struct VdlFile *final_item;      
-      if (n_ambiguous_matches == 1)
+// This function returns exactly what vdl_lookup_with_scope_internal
+// would return if it was called on the global scope of context but
+// it needs only one probe in the global index instead of one
+// probe per file in the scope.
+static struct VdlLookupResult
+vdl_lookup_with_global_index (struct VdlFile *file,
+			      const char *name, 
+			      const char *ver_name,
+			      const char *ver_filename,
+			      uint32_t gnu_hash,
+			      unsigned long ver_hash,
+			      enum VdlLookupFlag flags,
+			      struct VdlContext *context,
+			      bool *depends_on_from)
+{
+  VDL_LOG_FUNCTION ("name=%s, ver_name=%s, ver_filename=%s, gnu_hash=0x%x, "
+		    "ver_hash=0x%x, flags=0x%x, context=%p", 
+		    name, (ver_name!=0)?ver_name:"",(ver_filename!=0)?ver_filename:"",
+		    gnu_hash, ver_hash, flags, context);
+  struct VdlFile *item = 0;
+  const ElfW(Sym) *first_ambiguous_match = 0;
+  void **i;
+  for (i = vdl_hashmap_find (context->global_index, GLOBAL_INDEX_KEY (gnu_hash)); 
+       i != 0; i = vdl_hashmap_find_next (i))
+    {
+      struct VdlLookupIndexEntry *entry = *i;
+      if (entry->file != item)
 	{
-	  // if there is only one ambiguous match, it's not really ambiguous: it's a match !
-	  final_match = last_ambiguous_match;
-	  final_item = item;
+	  if (first_ambiguous_match != 0)
+	    {
+	      // the previous file had ambiguous matches only and
+	      // we pick the first of them, just like
+	      // vdl_lookup_with_scope_internal does.
+	      break;
+	    }
+	  item = entry->file;
 	}
-      else if (n_ambiguous_matches > 1)
+      if (flags & VDL_LOOKUP_NO_EXEC && 
+	  item->is_executable)
 	{
-	  // If we have multiple ambiguous matches, it means that we are doing
-	  // a lookup for a symbol that has no version information and we found 
-	  // more than one version of this symbol within the current file.
-	  // In this case, we pick the 'oldest' symbol, that is, the first one
-	  // we found. This is what I believe glibc is doing.
-	  final_match = first_ambiguous_match;
-	  final_item = first_ambiguous_match_item;
+	  continue;
 	}
-      else
+      const ElfW(Sym) *symbol = &item->dt_symtab[entry->index];
+      if (!vdl_utils_strisequal (item->dt_strtab + symbol->st_name, name))
 	{
-	  // no match so keep looking
 	  continue;
 	}
-      if (final_item != file && file != 0)
+      enum VdlVersionMatch version_match = symbol_version_matches (item, file, 
+								   ver_name, ver_filename, ver_hash,
+								   entry->index, depends_on_from);
+      if (version_match == VERSION_MATCH_PERFECT)
 	{
-	  // The symbol has been resolved in another binary. Make note of this.
-	  vdl_list_push_front (file->gc_symbols_resolved_in, final_item);
+	  first_ambiguous_match = 0;
+	  break;
 	}
-      struct VdlLookupResult result;
-      result.file = final_item;
-      result.symbol = &i.dt_symtab[final_match];
-      result.found = true;
+      else if (version_match == VERSION_MATCH_AMBIGUOUS &&
+	       first_ambiguous_match == 0)
+	{
+	  first_ambiguous_match = symbol;
+	}
+    }
+  struct VdlLookupResult result;
+  if (i == 0 && first_ambiguous_match == 0)
+    {
+      result.found = false;
       return result;
     }
+  if (first_ambiguous_match != 0)
+    {
+      result.symbol = first_ambiguous_match;
+    }
+  else
+    {
+      struct VdlLookupIndexEntry *entry = *i;
+      result.symbol = &item->dt_symtab[entry->index];
+    }
+  result.file = item;
+  result.found = true;
+  return result;
+}
+
+struct VdlLookupCacheEntry
+{
+  // the entry is valid only if it is equal to the
+  // generation of the cache.
+  unsigned long generation;
+  const struct VdlList *scope;
+  const char *name;
+  const char *ver_name;
+  // symbol_version_matches ignores ver_name if ver_filename is zero.
+  const char *ver_filename;
+  uint32_t gnu_hash;
+  uint32_t flags;
+  unsigned long ver_hash;
+  // result.found is false for a negative entry.
   struct VdlLookupResult result;
-  result.found = false;
+};
+
+struct VdlLookupCache
+{
+  // zero outside of vdl_lookup_cache_reserve and
+  // vdl_lookup_cache_release.
+  struct VdlLookupCacheEntry *entries;
+  unsigned long mask;
+  // the number of relocations of the files being relocated.
+  unsigned long reserved;
+  unsigned long generation;
+  unsigned long hits;
+  unsigned long negative_hits;
+  unsigned long misses;
+  unsigned long uncacheable;
+  unsigned long flushes;
+};
+
+static struct VdlLookupCache *
+lookup_cache_get (struct VdlContext *context)
+{
+  struct VdlLookupCache *cache = context->lookup_cache;
+  if (cache == 0 || cache->entries != 0)
+    {
+      return cache;
+    }
+  if (cache->reserved == 0)
+    {
+      // we are not relocating files: the lookups done by lazy
+      // binding and dlsym are too few to pay for a table.
+      return 0;
+    }
+  unsigned long max = vdl_utils_min (cache->reserved, g_vdl.lookup_cache_size);
+  unsigned long size = 1;
+  while (size < max)
+    {
+      size <<= 1;
+    }
+  cache->entries = vdl_alloc_malloc (size * sizeof (struct VdlLookupCacheEntry));
+  vdl_memset (cache->entries, 0, size * sizeof (struct VdlLookupCacheEntry));
+  cache->mask = size - 1;
+  return cache;
+}
+
+void
+vdl_lookup_cache_reserve (struct VdlContext *context, unsigned long n_relocs)
+{
+  if (g_vdl.lookup_cache_size == 0)
+    {
+      return;
+    }
+  struct VdlLookupCache *cache = context->lookup_cache;
+  if (cache == 0)
+    {
+      cache = vdl_alloc_new (struct VdlLookupCache);
+      cache->entries = 0;
+      cache->mask = 0;
+      cache->reserved = 0;
+      // entries start at generation zero so they are all invalid.
+      cache->generation = 1;
+      cache->hits = 0;
+      cache->negative_hits = 0;
+      cache->misses = 0;
+      cache->uncacheable = 0;
+      cache->flushes = 0;
+      context->lookup_cache = cache;
+    }
+  cache->reserved += n_relocs;
+}
+
+void
+vdl_lookup_cache_release (struct VdlContext *context)
+{
+  struct VdlLookupCache *cache = context->lookup_cache;
+  if (cache == 0)
+    {
+      return;
+    }
+  // keep the statistics for vdl_lookup_cache_print_stats
+  if (cache->entries != 0)
+    {
+      vdl_alloc_free (cache->entries);
+      cache->entries = 0;
+    }
+  cache->reserved = 0;
+}
+
+static struct VdlLookupCacheEntry *
+lookup_cache_slot (struct VdlLookupCache *cache,
+		   const struct VdlList *scope,
+		   uint32_t gnu_hash,
+		   unsigned long ver_hash)
+{
+  unsigned long key = gnu_hash ^ (ver_hash * 31) ^ (((unsigned long)scope) >> 4);
+  return &cache->entries[key & cache->mask];
+}
+
+// a and b are two strings which may be zero.
+static bool
+lookup_cache_string_equal (const char *a, const char *b)
+{
+  if (a == b)
+    {
+      return true;
+    }
+  if (a == 0 || b == 0)
+    {
+      return false;
+    }
+  return vdl_utils_strisequal (a, b);
+}
+
+static bool
+lookup_cache_entry_matches (const struct VdlLookupCacheEntry *entry,
+			    unsigned long generation,
+			    const struct VdlList *scope,
+			    const char *name,
+			    const char *ver_name,
+			    const char *ver_filename,
+			    uint32_t gnu_hash,
+			    unsigned long ver_hash,
+			    enum VdlLookupFlag flags)
+{
+  if (entry->generation != generation ||
+      entry->scope != scope ||
+      entry->gnu_hash != gnu_hash ||
+      entry->ver_hash != ver_hash ||
+      entry->flags != flags)
+    {
+      return false;
+    }
+  if (entry->name != name && !vdl_utils_strisequal (entry->name, name))
+    {
+      return false;
+    }
+  return lookup_cache_string_equal (entry->ver_name, ver_name) &&
+    lookup_cache_string_equal (entry->ver_filename, ver_filename);
+}
+
+void
+vdl_lookup_cache_flush (struct VdlContext *context)
+{
+  struct VdlLookupCache *cache = context->lookup_cache;
+  if (cache == 0)
+    {
+      return;
+    }
+  cache->generation++;
+  cache->flushes++;
+}
+
+void
+vdl_lookup_cache_print_stats (struct VdlContext *context)
+{
+  struct VdlLookupCache *cache = context->lookup_cache;
+  if (cache == 0)
+    {
+      return;
+    }
+  VDL_LOG_STATS ("lookup cache context=%p size=%lu hits=%lu negative-hits=%lu "
+		 "misses=%lu uncacheable=%lu flushes=%lu\n",
+		 context, cache->mask + 1, cache->hits, cache->negative_hits,
+		 cache->misses, cache->uncacheable, cache->flushes);
+}
+
+void
+vdl_lookup_cache_delete (struct VdlContext *context)
+{
+  struct VdlLookupCache *cache = context->lookup_cache;
+  if (cache == 0)
+    {
+      return;
+    }
+  vdl_lookup_cache_print_stats (context);
+  vdl_lookup_cache_release (context);
+  vdl_alloc_delete (cache);
+  context->lookup_cache = 0;
+}
+
+static struct VdlLookupResult
+vdl_lookup_in_scope (struct VdlFile *file,
+		     const char *name, 
+		     const char *ver_name,
+		     const char *ver_filename,
+		     unsigned long *elf_hash,
+		     uint32_t gnu_hash,
+		     unsigned long ver_hash,
+		     enum VdlLookupFlag flags,
+		     struct VdlList *scope)
+{
+  struct VdlLookupResult result;
+  if (scope == 0)
+    {
+      result.found = false;
+      return result;
+    }
+  struct VdlLookupCache *cache = lookup_cache_get (file->context);
+  struct VdlLookupCacheEntry *entry = 0;
+  if (cache != 0)
+    {
+      entry = lookup_cache_slot (cache, scope, gnu_hash, ver_hash);
+      if (lookup_cache_entry_matches (entry, cache->generation, scope, 
+				      name, ver_name, ver_filename, gnu_hash, 
+				      ver_hash, flags))
+	{
+	  cache->hits++;
+	  result = entry->result;
+	  if (!result.found)
+	    {
+	      cache->negative_hits++;
+	    }
+	  goto out;
+	}
+      cache->misses++;
+    }
+  bool depends_on_from = false;
+  if (scope == file->context->global_scope)
+    {
+      result = vdl_lookup_with_global_index (file, name, ver_name, ver_filename,
+					     gnu_hash, ver_hash, flags, 
+					     file->context, &depends_on_from);
+    }
+  else
+    {
+      result = vdl_lookup_with_scope_internal (file, name, ver_name, ver_filename, 
+					       elf_hash, gnu_hash, ver_hash,
+					       flags, scope, &depends_on_from);
+    }
+  if (cache != 0)
+    {
+      if (depends_on_from)
+	{
+	  // a local or hidden symbol was involved: the result
+	  // is valid only for lookups from this file.
+	  cache->uncacheable++;
+	}
+      else
+	{
+	  entry->generation = cache->generation;
+	  entry->scope = scope;
+	  entry->name = name;
+	  entry->ver_name = ver_name;
+	  entry->ver_filename = ver_filename;
+	  entry->gnu_hash = gnu_hash;
+	  entry->ver_hash = ver_hash;
+	  entry->flags = flags;
+	  entry->result = result;
+	}
+    }
+ out:
+  if (result.found && result.file != file)
+    {
+      // The symbol has been resolved in another binary. Make note of this.
+      vdl_list_push_front (file->gc_symbols_resolved_in, (void *)result.file);
+    }
   return result;
 }
 
+// Direct binding: a reference whose version was required from a
+// dependency (vn_file) is looked up in that dependency first. Returns
+// true and fills result if the symbol was found there and the main
+// executable does not interpose it.
+static bool
+vdl_lookup_direct (struct VdlFile *file,
+		   const char *name, 
+		   const char *ver_name,
+		   const char *ver_filename,
+		   unsigned long *elf_hash,
+		   uint32_t gnu_hash,
+		   unsigned long ver_hash,
+		   enum VdlLookupFlag flags,
+		   struct VdlLookupResult *result)
+{
+  struct VdlFile *target = 0;
+  void **cur;
+  for (cur = vdl_list_begin (file->deps); 
+       cur != vdl_list_end (file->deps); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFile *dep = *cur;
+      if (vdl_utils_strisequal (dep->name, ver_filename) ||
+	  (dep->dt_soname != 0 && vdl_utils_strisequal (dep->dt_soname, ver_filename)))
+	{
+	  target = dep;
+	  break;
+	}
+    }
+  if (target == 0 || target->is_executable ||
+      !vdl_lookup_file_bloom (target, gnu_hash))
+    {
+      return false;
+    }
+  bool depends_on_from = false;
+  if (!(flags & VDL_LOOKUP_NO_EXEC) &&
+      vdl_list_size (file->context->global_scope) != 0)
+    {
+      // the main binary comes first in the global scope and it
+      // can define a copy of the symbol (R_*_COPY) which we must use.
+      struct VdlFile *main_file = vdl_list_front (file->context->global_scope);
+      struct VdlLookupResult ignored;
+      if (main_file->is_executable && 
+	  vdl_lookup_file_bloom (main_file, gnu_hash) &&
+	  vdl_lookup_in_file (file, main_file, name, ver_name, ver_filename,
+			      elf_hash, gnu_hash, ver_hash, &depends_on_from,
+			      &ignored))
+	{
+	  return false;
+	}
+    }
+  if (!vdl_lookup_in_file (file, target, name, ver_name, ver_filename,
+			   elf_hash, gnu_hash, ver_hash, &depends_on_from,
+			   result))
+    {
+      return false;
+    }
+  vdl_list_push_front (file->gc_symbols_resolved_in, (void *)result->file);
+  return true;
+}
+
 struct VdlLookupResult
 vdl_lookup (struct VdlFile *file,
 	    const char *name, 
@@ -526,19 +1441,44 @@ vdl_lookup (struct VdlFile *file,
 	    const char *ver_filename,
 	    enum VdlLookupFlag flags)
 {
-  if (!(flags & VDL_LOOKUP_NO_REMAP))
-    {
-      vdl_context_symbol_remap (file->context, &name, &ver_name, &ver_filename);
-    }
-  // calculate the hash here to avoid calculating 
-  // it twice in both calls to symbol_lookup
-  unsigned long elf_hash = vdl_elf_hash (name);
-  uint32_t gnu_hash = vdl_gnu_hash (name);
   unsigned long ver_hash = 0;
   if (ver_name != 0)
     {
       ver_hash = vdl_elf_hash (ver_name);
     }
+  return vdl_lookup_hashed (file, name, vdl_gnu_hash (name), 
+			    ver_name, ver_hash, ver_filename, flags);
+}
+
+struct VdlLookupResult
+vdl_lookup_hashed (struct VdlFile *file,
+		   const char *name, 
+		   uint32_t gnu_hash,
+		   const char *ver_name,
+		   unsigned long ver_hash,
+		   const char *ver_filename,
+		   enum VdlLookupFlag flags)
+{
+  bool remapped = false;
+  if (!(flags & VDL_LOOKUP_NO_REMAP) &&
+      vdl_context_symbol_remap (file->context, gnu_hash, 
+				&name, &ver_name, &ver_filename))
+    {
+      gnu_hash = vdl_gnu_hash (name);
+      ver_hash = (ver_name != 0)?vdl_elf_hash (ver_name):0;
+      remapped = true;
+    }
+  // calculated on demand and shared by both calls to 
+  // vdl_lookup_in_scope
+  unsigned long elf_hash = LOOKUP_ELF_HASH_NONE;
+
+  struct VdlLookupResult result;
+  if (g_vdl.direct_bind && ver_filename != 0 && !remapped &&
+      vdl_lookup_direct (file, name, ver_name, ver_filename,
+			 &elf_hash, gnu_hash, ver_hash, flags, &result))
+    {
+      return result;
+    }
 
   struct VdlList *first = 0;
   struct VdlList *second = 0;
@@ -561,27 +1501,34 @@ vdl_lookup (struct VdlFile *file,
       second = 0;
       break;
     }
-  struct VdlLookupResult result;
-  result = vdl_lookup_with_scope_internal (file, name, ver_name, ver_filename, 
-					   elf_hash, gnu_hash, ver_hash,
-					   flags, first);
+  result = vdl_lookup_in_scope (file, name, ver_name, ver_filename, 
+				&elf_hash, gnu_hash, ver_hash,
+				flags, first);
   if (!result.found)
     {
-      result = vdl_lookup_with_scope_internal (file, name, ver_name, ver_filename,
-					       elf_hash, gnu_hash, ver_hash,
-					       flags, second);
+      result = vdl_lookup_in_scope (file, name, ver_name, ver_filename,
+				    &elf_hash, gnu_hash, ver_hash,
+				    flags, second);
     }
   return result;
 }
 struct VdlLookupResult
 vdl_lookup_local (const struct VdlFile *file, const char *name)
 {
-  vdl_context_symbol_remap (file->context, &name, 0, 0);
-  unsigned long elf_hash = vdl_elf_hash (name);
   uint32_t gnu_hash = vdl_gnu_hash (name);
-  struct VdlFileLookupIterator i = vdl_lookup_file_begin (file, name, elf_hash, gnu_hash);
+  if (vdl_context_symbol_remap (file->context, gnu_hash, &name, 0, 0))
+    {
+      gnu_hash = vdl_gnu_hash (name);
+    }
+  unsigned long elf_hash = vdl_elf_hash (name);
   struct VdlLookupResult result;
   result.file = file;
+  result.found = false;
+  if (!vdl_lookup_file_bloom (file, gnu_hash))
+    {
+      return result;
+    }
+  struct VdlFileLookupIterator i = vdl_lookup_file_begin (file, name, elf_hash, gnu_hash);
   if (vdl_lookup_file_has_next (&i))
     {
       unsigned long index = vdl_lookup_file_next (&i);
@@ -604,20 +1551,23 @@ vdl_lookup_with_scope (const struct VdlContext *from_context,
 		       enum VdlLookupFlag flags,
 		       struct VdlList *scope)
 {
-  if (!(flags & VDL_LOOKUP_NO_REMAP))
+  uint32_t gnu_hash = vdl_gnu_hash (name);
+  if (!(flags & VDL_LOOKUP_NO_REMAP) &&
+      vdl_context_symbol_remap (from_context, gnu_hash, 
+				&name, &ver_name, &ver_filename))
     {
-      vdl_context_symbol_remap (from_context, &name, &ver_name, &ver_filename);
+      gnu_hash = vdl_gnu_hash (name);
     }
-  unsigned long elf_hash = vdl_elf_hash (name);
-  uint32_t gnu_hash = vdl_gnu_hash (name);
+  unsigned long elf_hash = LOOKUP_ELF_HASH_NONE;
   unsigned long ver_hash = 0;
   if (ver_name != 0)
     {
       ver_hash = vdl_elf_hash (ver_name);
     }
+  bool depends_on_from = false;
   struct VdlLookupResult result;
   result = vdl_lookup_with_scope_internal (0, name, ver_name, ver_filename,
-					   elf_hash, gnu_hash, ver_hash,
-					   flags, scope);
+					   &elf_hash, gnu_hash, ver_hash,
+					   flags, scope, &depends_on_from);
   return result;
 }
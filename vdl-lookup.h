@@ -4,6 +4,7 @@
 #include <elf.h>
 #include <link.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 struct VdlContext;
 struct VdlFile;
@@ -25,11 +26,50 @@ enum VdlLookupFlag {
   // This can be used to get the original symbol back.
   VDL_LOOKUP_NO_REMAP = 2
 };
+uint32_t vdl_gnu_hash (const char *s);
+unsigned long vdl_elf_hash (const char *n);
+
+// must be called once the dt_ fields of file have been initialized.
+void vdl_lookup_file_initialize (struct VdlFile *file);
+void vdl_lookup_file_finalize (struct VdlFile *file);
+// the number of entries of the dt_symtab of file, as described by
+// its hash tables, or zero if it is not known.
+unsigned long vdl_lookup_symbol_count (const struct VdlFile *file);
+
+// maintain the global scope index of context: these are called by
+// vdl_context_global_scope_append and vdl_context_global_scope_remove
+void vdl_lookup_global_index_add (struct VdlContext *context,
+				  struct VdlFile *file);
+void vdl_lookup_global_index_remove (struct VdlContext *context,
+				     struct VdlFile *file);
+
+// The results of vdl_lookup are memoized in a per-context cache
+// which must be flushed whenever the content of one of the scopes
+// of the context changes. The cache holds entries only between
+// vdl_lookup_cache_reserve and vdl_lookup_cache_release, that is,
+// while vdl_reloc relocates a batch of files: it is sized after the
+// number of relocations of these files, up to g_vdl.lookup_cache_size.
+void vdl_lookup_cache_reserve (struct VdlContext *context, unsigned long n_relocs);
+void vdl_lookup_cache_release (struct VdlContext *context);
+void vdl_lookup_cache_flush (struct VdlContext *context);
+void vdl_lookup_cache_print_stats (struct VdlContext *context);
+void vdl_lookup_cache_delete (struct VdlContext *context);
+
 struct VdlLookupResult vdl_lookup (struct VdlFile *from_file,
 				   const char *name, 
 				   const char *ver_name,
 				   const char *ver_filename,
 				   enum VdlLookupFlag flags);
+// same as vdl_lookup for callers which already know gnu_hash, the 
+// gnu hash of name, and ver_hash, the elf hash of ver_name (zero if 
+// ver_name is zero).
+struct VdlLookupResult vdl_lookup_hashed (struct VdlFile *from_file,
+					  const char *name, 
+					  uint32_t gnu_hash,
+					  const char *ver_name,
+					  unsigned long ver_hash,
+					  const char *ver_filename,
+					  enum VdlLookupFlag flags);
 struct VdlLookupResult vdl_lookup_local (const struct VdlFile *file, 
 					 const char *name);
 struct VdlLookupResult vdl_lookup_with_scope (const struct VdlContext *from_context,
@@ -1,8 +1,10 @@
 #include "vdl-map.h"
+#include "vdl-lookup.h"
 #include "vdl-log.h"
 #include "vdl-alloc.h"
 #include "vdl-context.h"
 #include "vdl-file.h"
+#include "vdl-image.h"
 #include "vdl-utils.h"
 #include "vdl-mem.h"
 #include "machine.h"
@@ -27,36 +29,11 @@ debug_print_maps (const char *filename, struct VdlList *maps)
     }
 }
 
-static void
-get_total_mapping_boundaries (struct VdlList *maps, 
-			      unsigned long *pstart, 
-			      unsigned long *size,
-			      unsigned long *poffset)
-{
-  unsigned long start = ~0;
-  unsigned long end = 0;
-  unsigned long offset = ~0;
-  void **cur;
-  for (cur = vdl_list_begin (maps); cur != vdl_list_end (maps); cur = vdl_list_next (cur))
-    {
-      struct VdlFileMap *map = *cur;
-      if (start >= map->mem_start_align)
-	{
-	  start = map->mem_start_align;
-	  offset = map->file_start_align;
-	}
-      end = vdl_utils_max (end, map->mem_start_align + map->mem_size_align);
-    }
-  *pstart = start;
-  *size = end - start;
-  *poffset = offset;
-}
-static void
-file_map_add_load_base (struct VdlFileMap *map, unsigned long load_base)
+// convert an address relative to the load base stored in a VdlImage.
+static unsigned long
+image_address (unsigned long address, unsigned long load_base)
 {
-  map->mem_start_align += load_base;
-  map->mem_zero_start += load_base;
-  map->mem_anon_start_align += load_base;
+  return (address == 0)?0:(load_base + address);
 }
 
 static struct VdlFileMap *
@@ -91,30 +68,6 @@ pt_load_to_file_map (const ElfW(Phdr) *phdr)
   return map;
 }
 
-static struct VdlList *
-vdl_file_get_dt_needed (struct VdlFile *file)
-{
-  VDL_LOG_FUNCTION ("file=%s", file->name);
-  struct VdlList *list = vdl_list_new ();
-  const char *dt_strtab = file->dt_strtab;
-  if (dt_strtab == 0)
-    {
-      return list;
-    }
-  ElfW(Dyn) *dynamic = (ElfW(Dyn)*)file->dynamic;
-  ElfW(Dyn)*cur;
-  for (cur = dynamic; cur->d_tag != DT_NULL; cur++)
-    {
-      if (cur->d_tag == DT_NEEDED)
-	{
-	  const char *str = (const char *)(dt_strtab + cur->d_un.d_val);
-	  VDL_LOG_DEBUG ("needed=%s\n", str);
-	  vdl_list_push_back (list, vdl_utils_strdup (str));
-	}
-    }
-  return list;
-}
-
 static char *
 replace_magic (char *filename)
 {
@@ -304,9 +257,8 @@ get_file_info (uint32_t phnum,
 }
 
 static struct VdlFile *
-file_new (unsigned long load_base,
-	  unsigned long dynamic,
-	  struct VdlList *maps,
+file_new (struct VdlImage *image,
+	  unsigned long load_base,
 	  const char *filename, 
 	  const char *name,
 	  struct VdlContext *context)
@@ -317,21 +269,18 @@ file_new (unsigned long load_base,
 
   file->load_base = load_base;
   file->filename = vdl_utils_strdup (filename);
-  file->dynamic = dynamic + load_base;
+  file->dynamic = image->dynamic + load_base;
   file->next = 0;
   file->prev = 0;
   file->is_main_namespace = (context == vdl_list_front (g_vdl.contexts))?0:1;
   file->count = 0;
   file->context = context;
-  file->st_dev = 0;
-  file->st_ino = 0;
-  file->maps = maps;
-  void **i;
-  for (i = vdl_list_begin (maps); i != vdl_list_end (maps); i = vdl_list_next (i))
-    {
-      struct VdlFileMap *map = *i;
-      file_map_add_load_base (map, load_base);
-    }
+  file->st_dev = image->st_dev;
+  file->st_ino = image->st_ino;
+  file->image = image;
+  file->phdr = image->phdr;
+  file->phnum = image->phnum;
+  file->e_type = image->e_type;
   file->deps_initialized = 0;
   file->tls_initialized = 0;
   file->init_called = 0;
@@ -339,6 +288,7 @@ file_new (unsigned long load_base,
   file->fini_called = 0;
   file->reloced = 0;
   file->patched = 0;
+  file->fork_handlers_registered = 0;
   file->is_executable = 0;
   // no need to initialize gc_color because it is always 
   // initialized when needed by vdl_gc
@@ -348,6 +298,8 @@ file_new (unsigned long load_base,
   file->deps = vdl_list_new ();
   file->name = vdl_utils_strdup (name);
   file->depth = 0;
+  file->global_index = 0;
+  file->global_index_size = 0;
 
   // Note: we could theoretically access the content of the DYNAMIC section
   // through the file->dynamic field. However, some platforms (say, i386)
@@ -359,166 +311,59 @@ file_new (unsigned long load_base,
   // This is pure madness so, to avoid having to always remember which entries
   // are potentially relocated and when they are relocated (on which platform),
   // we make a copy of all the entries we need here and let machine_reloc_dynamic
-  // do its crazy work.
-  file->dt_relent = 0;
-  file->dt_relsz = 0;
-  file->dt_rel = 0;
-
-  file->dt_relaent = 0;
-  file->dt_relasz = 0;
-  file->dt_rela = 0;
-
-  file->dt_pltgot = 0;
-  file->dt_jmprel = 0;
-  file->dt_pltrel = 0;
-  file->dt_pltrelsz = 0;
-
-  file->dt_strtab = 0;
-  file->dt_symtab = 0;
-  file->dt_flags = 0;
-
-  file->dt_hash = 0;
-  file->dt_gnu_hash = 0;
-
-  file->dt_fini = 0;
-  file->dt_fini_array = 0;
-  file->dt_fini_arraysz = 0;
-
-  file->dt_init = 0;
-  file->dt_init_array = 0;
-  file->dt_init_arraysz = 0;
-
-  file->dt_versym = 0;
-  file->dt_verdef = 0;
-  file->dt_verdefnum = 0;
-  file->dt_verneed = 0;
-  file->dt_verneednum = 0;
-
-  file->dt_rpath = 0;
-  file->dt_runpath = 0;
-  file->dt_soname = 0;
-
-  ElfW(Dyn) *dyn = (ElfW(Dyn)*)file->dynamic;
-  // do a first pass to get dt_strtab
-  while (dyn->d_tag != DT_NULL)
-    {
-      switch (dyn->d_tag)
-	{
-	case DT_STRTAB:
-	  file->dt_strtab = (const char *)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-	}
-      dyn++;
-    }
-  dyn = (ElfW(Dyn)*)file->dynamic;
-  while (dyn->d_tag != DT_NULL)
-    {
-      switch (dyn->d_tag)
-	{
-	case DT_RELENT:
-	  file->dt_relent = dyn->d_un.d_val;
-	  break;
-	case DT_RELSZ:
-	  file->dt_relsz = dyn->d_un.d_val;
-	  break;
-	case DT_REL:
-	  file->dt_rel = (ElfW(Rel)*)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-
-	case DT_RELAENT:
-	  file->dt_relaent = dyn->d_un.d_val;
-	  break;
-	case DT_RELASZ:
-	  file->dt_relasz = dyn->d_un.d_val;
-	  break;
-	case DT_RELA:
-	  file->dt_rela = (ElfW(Rela)*)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-
-	case DT_PLTGOT:
-	  file->dt_pltgot = file->load_base + dyn->d_un.d_ptr;
-	  break;
-	case DT_JMPREL:
-	  file->dt_jmprel = file->load_base + dyn->d_un.d_ptr;
-	  break;
-	case DT_PLTREL:
-	  file->dt_pltrel = dyn->d_un.d_val;
-	  break;
-	case DT_PLTRELSZ:
-	  file->dt_pltrelsz = dyn->d_un.d_val;
-	  break;
-
-	case DT_SYMTAB:
-	  file->dt_symtab = (ElfW(Sym) *) (file->load_base + dyn->d_un.d_ptr);
-	  break;
-	case DT_FLAGS:
-	  file->dt_flags |= dyn->d_un.d_val;
-	  break;
-
-	case DT_HASH:
-	  file->dt_hash = (ElfW(Word) *)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-	case DT_GNU_HASH:
-	  file->dt_gnu_hash = (uint32_t *)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-
-	case DT_FINI:
-	  file->dt_fini = dyn->d_un.d_ptr;
-	  break;
-	case DT_FINI_ARRAY:
-	  file->dt_fini_array = dyn->d_un.d_ptr;
-	  break;
-	case DT_FINI_ARRAYSZ:
-	  file->dt_fini_arraysz = dyn->d_un.d_val;
-	  break;
-
-	case DT_INIT:
-	  file->dt_init = dyn->d_un.d_ptr;
-	  break;
-	case DT_INIT_ARRAY:
-	  file->dt_init_array = dyn->d_un.d_ptr;
-	  break;
-	case DT_INIT_ARRAYSZ:
-	  file->dt_init_arraysz = dyn->d_un.d_val;
-	  break;
-
-	case DT_VERSYM:
-	  file->dt_versym = (ElfW(Half) *)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-	case DT_VERDEF:
-	  file->dt_verdef = (ElfW(Verdef) *)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-	case DT_VERDEFNUM:
-	  file->dt_verdefnum = dyn->d_un.d_val;
-	  break;
-	case DT_VERNEED:
-	  file->dt_verneed = (ElfW(Verneed) *)(file->load_base + dyn->d_un.d_ptr);
-	  break;
-	case DT_VERNEEDNUM:
-	  file->dt_verneednum = dyn->d_un.d_val;
-	  break;
-	case DT_RPATH:
-	  VDL_LOG_ASSERT (file->dt_strtab != 0, "no strtab for RPATH");
-	  file->dt_rpath = file->dt_strtab + dyn->d_un.d_val;
-	  break;
-	case DT_RUNPATH:
-	  VDL_LOG_ASSERT (file->dt_strtab != 0, "no strtab for RUNPATH");
-	  file->dt_runpath = file->dt_strtab + dyn->d_un.d_val;
-	  break;
-	case DT_TEXTREL:
-	  // transfor DT_TEXTREL in equivalent DF_TEXTREL
-	  file->dt_flags |= DF_TEXTREL;
-	  break;
-	case DT_SONAME:
-	  file->dt_soname = file->dt_strtab + dyn->d_un.d_val;
-	  break;
-	}      
-      dyn++;
-    }
+  // do its crazy work. The parsing itself is done only once per image.
+  vdl_image_dynamic_initialize (image, load_base);
+
+  file->dt_relent = image->dt_relent;
+  file->dt_relsz = image->dt_relsz;
+  file->dt_rel = (ElfW(Rel)*)image_address (image->dt_rel, load_base);
+
+  file->dt_relaent = image->dt_relaent;
+  file->dt_relasz = image->dt_relasz;
+  file->dt_rela = (ElfW(Rela)*)image_address (image->dt_rela, load_base);
+
+  file->dt_relrsz = image->dt_relrsz;
+  file->dt_relr = (ElfW(Addr)*)image_address (image->dt_relr, load_base);
+  file->dt_relrent = image->dt_relrent;
+  file->dt_relcount = image->dt_relcount;
+  file->dt_relacount = image->dt_relacount;
+
+  file->dt_pltgot = image_address (image->dt_pltgot, load_base);
+  file->dt_jmprel = image_address (image->dt_jmprel, load_base);
+  file->dt_pltrel = image->dt_pltrel;
+  file->dt_pltrelsz = image->dt_pltrelsz;
+
+  file->dt_strtab = (const char *)image_address (image->dt_strtab, load_base);
+  file->dt_symtab = (ElfW(Sym) *)image_address (image->dt_symtab, load_base);
+  file->dt_flags = image->dt_flags;
+
+  file->dt_hash = (ElfW(Word) *)image_address (image->dt_hash, load_base);
+  file->dt_gnu_hash = (uint32_t *)image_address (image->dt_gnu_hash, load_base);
+
+  // these are kept relative to the load base.
+  file->dt_fini = image->dt_fini;
+  file->dt_fini_array = image->dt_fini_array;
+  file->dt_fini_arraysz = image->dt_fini_arraysz;
+
+  file->dt_init = image->dt_init;
+  file->dt_init_array = image->dt_init_array;
+  file->dt_init_arraysz = image->dt_init_arraysz;
+
+  file->dt_versym = (ElfW(Half) *)image_address (image->dt_versym, load_base);
+  file->dt_verdef = (ElfW(Verdef) *)image_address (image->dt_verdef, load_base);
+  file->dt_verdefnum = image->dt_verdefnum;
+  file->dt_verneed = (ElfW(Verneed) *)image_address (image->dt_verneed, load_base);
+  file->dt_verneednum = image->dt_verneednum;
+
+  file->dt_rpath = (const char *)image_address (image->dt_rpath, load_base);
+  file->dt_runpath = (const char *)image_address (image->dt_runpath, load_base);
+  file->dt_soname = (const char *)image_address (image->dt_soname, load_base);
 
   // Now, relocate the dynamic section
   machine_reloc_dynamic ((ElfW(Dyn)*)file->dynamic, file->load_base);
 
+  vdl_lookup_file_initialize (file);
+
   return file;
 }
 
@@ -577,29 +422,17 @@ file_map_do (const struct VdlFileMap *map,
     }
 }
 
-static struct VdlFile *
-vdl_file_map_single (struct VdlContext *context, 
-		     const char *filename, 
-		     const char *name)
+// read the ELF header and the program headers of the file
+// to build a new image for it.
+static struct VdlImage *
+image_read (int fd, const char *filename)
 {
-  VDL_LOG_FUNCTION ("context=%p, filename=%s, name=%s", context, filename, name);
   ElfW(Ehdr) header;
   ElfW(Phdr) *phdr = 0;
   size_t bytes_read;
-  unsigned long mapping_start = 0;
-  unsigned long mapping_size = 0;
-  unsigned long offset_start = 0;
-  int fd = -1;
   struct VdlList *maps;
   unsigned long dynamic;
 
-  fd = system_open_ro (filename);
-  if (fd == -1)
-    {
-      VDL_LOG_ERROR ("Could not open ro target file: %s\n", filename);
-      goto error;
-    }
-
   bytes_read = system_read (fd, &header, sizeof (header));
   if (bytes_read == -1 || bytes_read != sizeof (header))
     {
@@ -640,75 +473,130 @@ vdl_file_map_single (struct VdlContext *context,
 
   debug_print_maps (filename, maps);
 
-  unsigned long requested_mapping_start;
-  get_total_mapping_boundaries (maps, &requested_mapping_start, 
-				&mapping_size, &offset_start);
+  return vdl_image_new (header.e_type, phdr, header.e_phnum, maps, dynamic);
+ error:
+  vdl_alloc_free (phdr);
+  return 0;
+}
 
+// map a new instance of image from fd. Takes ownership of 
+// our reference to image.
+static struct VdlFile *
+file_map_image (struct VdlContext *context,
+		int fd,
+		struct VdlImage *image,
+		const char *filename, 
+		const char *name)
+{
+  unsigned long mapping_start;
   // If this is an executable, we try to map it exactly at its base address
-  int fixed = (header.e_type == ET_EXEC)?MAP_FIXED:0;
+  int fixed = (image->e_type == ET_EXEC)?MAP_FIXED:0;
   // We perform a single initial mmap to reserve all the virtual space we need
   // and, then, we map again portions of the space to make sure we get
   // the mappings we need
-  mapping_start = (unsigned long) system_mmap ((void*)requested_mapping_start,
-					       mapping_size,
+  mapping_start = (unsigned long) system_mmap ((void*)image->mapping_start,
+					       image->mapping_size,
 					       PROT_NONE,
 					       MAP_PRIVATE | fixed,
-					       fd, offset_start);
+					       fd, image->mapping_offset);
   if (mapping_start == -1)
     {
       VDL_LOG_ERROR ("Unable to allocate complete mapping for %s\n", filename);
-      goto error;
+      vdl_image_unref (image);
+      return 0;
     }
-  VDL_LOG_ASSERT (!fixed || (fixed && mapping_start == requested_mapping_start),
+  VDL_LOG_ASSERT (!fixed || (fixed && mapping_start == image->mapping_start),
 		  "We need a fixed address and we did not get it but this should have failed mmap");
   // calculate the offset between the start address we asked for and the one we got
-  unsigned long load_base = mapping_start - requested_mapping_start;
+  unsigned long load_base = mapping_start - image->mapping_start;
 
   // unmap the area before mapping it again.
-  int int_result = system_munmap ((void*)mapping_start, mapping_size);
+  int int_result = system_munmap ((void*)mapping_start, image->mapping_size);
   VDL_LOG_ASSERT (int_result == 0, "munmap can't possibly fail here");
 
   // remap the portions we want.
   void **i;
-  for (i = vdl_list_begin (maps); i != vdl_list_end (maps); i = vdl_list_next (i))
+  for (i = vdl_list_begin (image->maps); i != vdl_list_end (image->maps); i = vdl_list_next (i))
     {
       struct VdlFileMap *map = *i;
       file_map_do (map, fd, map->mmap_flags, load_base);
     }
 
-  struct stat st_buf;
-  if (system_fstat (filename, &st_buf) == -1)
-    {
-      VDL_LOG_ERROR ("Unable to stat file %s\n", filename);
-      goto error;
-    }
-
-  struct VdlFile *file = file_new (load_base, dynamic, maps,
+  struct VdlFile *file = file_new (image, load_base,
 				   filename, name,
 				   context);
-  file->st_dev = st_buf.st_dev;
-  file->st_ino = st_buf.st_ino;
-  
-  file->phdr = phdr;
-  file->phnum = header.e_phnum;
-  file->e_type = header.e_type;
-
-  system_close (fd);
 
   vdl_context_notify (context, file, VDL_EVENT_MAPPED);
 
   return file;
-error:
-  if (fd >= 0)
+}
+
+static struct VdlFile *
+vdl_file_map_single (struct VdlContext *context, 
+		     const char *filename, 
+		     const char *name,
+		     const struct stat *st_buf)
+{
+  VDL_LOG_FUNCTION ("context=%p, filename=%s, name=%s", context, filename, name);
+  int fd = -1;
+  struct VdlImage *image = 0;
+
+  fd = system_open_ro (filename);
+  if (fd == -1)
     {
-      system_close (fd);
+      VDL_LOG_ERROR ("Could not open ro target file: %s\n", filename);
+      return 0;
     }
-  vdl_alloc_free (phdr);
-  if (mapping_start != 0)
+
+  // if this file is already mapped in another context, we
+  // don't need to read and parse its headers again.
+  image = vdl_image_find (st_buf);
+  if (image == 0)
     {
-      system_munmap ((void*)mapping_start, mapping_size);
+      image = image_read (fd, filename);
+      if (image == 0)
+	{
+	  system_close (fd);
+	  return 0;
+	}
+      vdl_image_register (image, st_buf);
     }
-  return 0;
+
+  struct VdlFile *file = file_map_image (context, fd, image, filename, name);
+  system_close (fd);
+  return file;
+}
+
+struct VdlFile *
+vdl_map_from_file (struct VdlContext *context, const struct VdlFile *file)
+{
+  VDL_LOG_FUNCTION ("context=%p, file=%s", context, file->filename);
+  struct stat st_buf;
+  if (!file->image->registered ||
+      system_fstat (file->filename, &st_buf) == -1)
+    {
+      return 0;
+    }
+  struct VdlImage *image = vdl_image_find (&st_buf);
+  if (image != file->image)
+    {
+      // the file was modified since it was mapped.
+      if (image != 0)
+	{
+	  vdl_image_unref (image);
+	}
+      return 0;
+    }
+  int fd = system_open_ro (file->filename);
+  if (fd == -1)
+    {
+      vdl_image_unref (image);
+      return 0;
+    }
+  struct VdlFile *copy = file_map_image (context, fd, image, 
+					 file->filename, file->name);
+  system_close (fd);
+  return copy;
 }
 
 struct SingleMapResult
@@ -770,7 +658,7 @@ vdl_file_map_single_maybe (struct VdlContext *context,
       return result;
     }
   // The file is really not yet mapped so, we have to map it
-  result.file = vdl_file_map_single (context, filename, name);
+  result.file = vdl_file_map_single (context, filename, name, &buf);
   VDL_LOG_ASSERT (result.file != 0, "The file should be there so this should not fail.");
   result.newly_mapped = true;
 
@@ -793,8 +681,8 @@ vdl_file_map_deps_recursive (struct VdlFile *item,
     }
   item->deps_initialized = 1;
 
-  struct VdlList *rpath = vdl_utils_splitpath (item->dt_rpath);
-  struct VdlList *runpath = vdl_utils_splitpath (item->dt_runpath);
+  struct VdlList *rpath = item->image->rpath;
+  struct VdlList *runpath = item->image->runpath;
   struct VdlList *current_rpath = vdl_list_copy (rpath);
   vdl_list_insert_range (current_rpath,
 			 vdl_list_end (current_rpath),
@@ -802,7 +690,7 @@ vdl_file_map_deps_recursive (struct VdlFile *item,
 			 vdl_list_end (caller_rpath));
 
   // get list of deps for the input file.
-  struct VdlList *dt_needed = vdl_file_get_dt_needed (item);
+  struct VdlList *dt_needed = item->image->needed;
 
   // first, map each dep and accumulate them in deps variable
   void **cur;
@@ -841,10 +729,7 @@ vdl_file_map_deps_recursive (struct VdlFile *item,
     }
 
  out:
-  vdl_utils_str_list_delete (rpath);
   vdl_list_delete (current_rpath);
-  vdl_utils_str_list_delete (runpath);
-  vdl_utils_str_list_delete (dt_needed);
   return error;
 }
 
@@ -877,11 +762,13 @@ vdl_map_from_memory (unsigned long load_base,
 					       path, filename);
       goto out;
     }
-  struct VdlFile *file = file_new (load_base, dynamic, maps,
+  // this mapping was not done by us so, its image is not shared.
+  ElfW(Phdr) *phdr_copy = vdl_alloc_malloc (phnum * sizeof(ElfW(Phdr)));
+  vdl_memcpy (phdr_copy, phdr, phnum * sizeof(ElfW(Phdr)));
+  struct VdlImage *image = vdl_image_new (ET_NONE, phdr_copy, phnum,
+					  maps, dynamic);
+  struct VdlFile *file = file_new (image, load_base,
 				   path, filename, context);
-  file->phdr = vdl_alloc_malloc (phnum * sizeof(ElfW(Phdr)));
-  vdl_memcpy (file->phdr, phdr, phnum * sizeof(ElfW(Phdr)));
-  file->phnum = phnum;
   vdl_list_push_back (result.newly_mapped, file);  
 
   struct VdlList *empty = vdl_list_new ();
@@ -6,6 +6,7 @@
 #include <link.h>
 
 struct VdlContext;
+struct VdlFile;
 
 struct VdlMapResult
 {
@@ -32,6 +33,12 @@ struct VdlMapResult vdl_map_from_memory (unsigned long load_base,
 					 struct VdlContext *context);
 struct VdlMapResult vdl_map_from_filename (struct VdlContext *context, 
 					   const char *filename);
+// map in context a new instance of the image of file without
+// searching for it nor reading its headers. Does not map its
+// dependencies. Returns zero if file was not mapped from a file
+// or if this file was modified since.
+struct VdlFile *vdl_map_from_file (struct VdlContext *context, 
+				   const struct VdlFile *file);
 
 
 #endif /* VDL_MAP_H */
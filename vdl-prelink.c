@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Fill the resolution cache of a program which uses ldso as its
+// interpreter (see elfedit): the program and its dependencies are 
+// loaded and relocated with all their PLT slots bound, the plans are 
+// saved in the cache directory and the program exits before running
+// any of its code. The program must then be run with the same
+// LD_RESOLVE_CACHE.
+int main (int argc, char *argv[])
+{
+  if (argc < 3)
+    {
+      fprintf (stderr, "usage: %s cache-dir program [args...]\n", argv[0]);
+      return 1;
+    }
+  if (setenv ("LD_RESOLVE_CACHE", argv[1], 1) == -1 ||
+      setenv ("LD_RESOLVE_CACHE_ONLY", "1", 1) == -1 ||
+      setenv ("LD_BIND_NOW", "1", 1) == -1)
+    {
+      return 2;
+    }
+  execv (argv[2], &argv[2]);
+  perror (argv[2]);
+  return 3;
+}
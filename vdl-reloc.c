@@ -8,6 +8,14 @@
 #include "futex.h"
 #include "vdl-mem.h"
 #include "vdl-file.h"
+#include "vdl-image.h"
+#include "vdl-context.h"
+#include "vdl-alloc.h"
+#include "vdl-bind-profile.h"
+#include "vdl-bind-worker.h"
+#include "vdl-uffd.h"
+#include "vdl-resolve-cache.h"
+#include "system.h"
 #include <sys/mman.h>
 #include <stdbool.h>
 
@@ -16,102 +24,423 @@
 #define STT_GNU_IFUNC 10
 #endif
 
+// the result of the lookup of a symbol of the dt_symtab of the 
+// file being relocated, memoized during a relocation pass.
+struct VdlRelocMemoEntry
+{
+  bool valid;
+  struct VdlLookupResult result;
+};
+
+// the state of an initial relocation pass
+struct VdlRelocPass
+{
+  // indexed by symbol index. Grown as needed.
+  struct VdlRelocMemoEntry *memo;
+  uint32_t memo_size;
+  // the files which make up the lookup scope, in lookup order.
+  struct VdlFile **scope;
+  uint32_t scope_size;
+  // zero if the pass neither records nor replays a plan.
+  struct VdlRelocPlan *plan;
+  bool replay;
+  // the index of the next relocation to process.
+  uint32_t current;
+  unsigned long n_replayed;
+  unsigned long n_lookups;
+  // the number of lookups avoided by the memo.
+  unsigned long n_memo_hits;
+};
+
+void
+vdl_reloc_plan_delete (struct VdlRelocPlan *plan)
+{
+  vdl_alloc_free (plan->scope);
+  if (plan->mapping != 0)
+    {
+      system_munmap (plan->mapping, plan->mapping_size);
+    }
+  else
+    {
+      vdl_alloc_free (plan->entries);
+    }
+  vdl_alloc_delete (plan);
+}
+
+static void
+reloc_scopes (struct VdlFile *file, 
+	      struct VdlList **first, struct VdlList **second)
+{
+  // must match the lookup order of vdl_lookup
+  *first = 0;
+  *second = 0;
+  switch (file->lookup_type)
+    {
+    case FILE_LOOKUP_LOCAL_GLOBAL:
+      *first = file->local_scope;
+      *second = file->context->global_scope;
+      break;
+    case FILE_LOOKUP_GLOBAL_LOCAL:
+      *first = file->context->global_scope;
+      *second = file->local_scope;
+      break;
+    case FILE_LOOKUP_GLOBAL_ONLY:
+      *first = file->context->global_scope;
+      break;
+    case FILE_LOOKUP_LOCAL_ONLY:
+      *first = file->local_scope;
+      break;
+    }
+}
+
+static uint32_t
+reloc_count (struct VdlFile *file, int now)
+{
+  uint32_t count = 0;
+  if (file->dt_rel != 0 && file->dt_relent != 0)
+    {
+      count += file->dt_relsz / file->dt_relent;
+    }
+  if (file->dt_rela != 0 && file->dt_relaent != 0)
+    {
+      count += file->dt_relasz / file->dt_relaent;
+    }
+  if (now && file->dt_jmprel != 0)
+    {
+      if (file->dt_pltrel == DT_REL)
+	{
+	  count += file->dt_pltrelsz / sizeof (ElfW(Rel));
+	}
+      else if (file->dt_pltrel == DT_RELA)
+	{
+	  count += file->dt_pltrelsz / sizeof (ElfW(Rela));
+	}
+    }
+  return count;
+}
+
+static bool
+reloc_plan_matches (const struct VdlRelocPlan *plan,
+		    const struct VdlRelocPass *pass,
+		    uint32_t first_size,
+		    const struct VdlFile *file)
+{
+  if (plan->lookup_type != file->lookup_type ||
+      plan->symbol_remaps_signature != file->context->symbol_remaps_signature ||
+      plan->first_size != first_size ||
+      plan->scope_size != pass->scope_size)
+    {
+      return false;
+    }
+  uint32_t i;
+  for (i = 0; i < pass->scope_size; i++)
+    {
+      if (plan->scope[i] != pass->scope[i]->image->serial)
+	{
+	  return false;
+	}
+    }
+  return true;
+}
+
+static void
+reloc_pass_initialize (struct VdlRelocPass *pass, struct VdlFile *file, int now)
+{
+  pass->scope = 0;
+  pass->scope_size = 0;
+  pass->plan = 0;
+  pass->replay = false;
+  pass->current = 0;
+  pass->n_replayed = 0;
+  pass->n_lookups = 0;
+  pass->n_memo_hits = 0;
+  pass->memo = 0;
+  pass->memo_size = 0;
+  if (!file->image->registered && g_vdl.resolve_cache == 0)
+    {
+      // no other file can share this image.
+      return;
+    }
+  struct VdlList *first, *second;
+  reloc_scopes (file, &first, &second);
+  uint32_t first_size = (first == 0)?0:vdl_list_size (first);
+  uint32_t second_size = (second == 0)?0:vdl_list_size (second);
+  pass->scope_size = first_size + second_size;
+  pass->scope = vdl_alloc_malloc (sizeof (struct VdlFile *) * (pass->scope_size + 1));
+  uint32_t n = 0;
+  void **i;
+  if (first != 0)
+    {
+      for (i = vdl_list_begin (first); i != vdl_list_end (first); i = vdl_list_next (i))
+	{
+	  pass->scope[n++] = *i;
+	}
+    }
+  if (second != 0)
+    {
+      for (i = vdl_list_begin (second); i != vdl_list_end (second); i = vdl_list_next (i))
+	{
+	  pass->scope[n++] = *i;
+	}
+    }
+
+  struct VdlRelocPlan *plan = file->image->reloc_plan;
+  if (plan == 0 && g_vdl.resolve_cache != 0)
+    {
+      plan = vdl_resolve_cache_load (file, pass->scope, pass->scope_size, 
+				     first_size);
+      file->image->reloc_plan = plan;
+    }
+  if (plan != 0)
+    {
+      if (reloc_plan_matches (plan, pass, first_size, file))
+	{
+	  pass->plan = plan;
+	  pass->replay = true;
+	}
+      return;
+    }
+  // record a new plan
+  plan = vdl_alloc_new (struct VdlRelocPlan);
+  plan->scope_size = pass->scope_size;
+  plan->first_size = first_size;
+  plan->scope = vdl_alloc_malloc (sizeof (unsigned long) * (plan->scope_size + 1));
+  for (n = 0; n < plan->scope_size; n++)
+    {
+      plan->scope[n] = pass->scope[n]->image->serial;
+    }
+  plan->lookup_type = file->lookup_type;
+  plan->symbol_remaps_signature = file->context->symbol_remaps_signature;
+  plan->n_entries = reloc_count (file, now);
+  plan->entries = vdl_alloc_malloc (sizeof (struct VdlRelocPlanEntry) * 
+				    (plan->n_entries + 1));
+  plan->mapping = 0;
+  plan->mapping_size = 0;
+  vdl_memset (plan->entries, 0xff, 
+	      sizeof (struct VdlRelocPlanEntry) * plan->n_entries);
+  file->image->reloc_plan = plan;
+  pass->plan = plan;
+}
+
+static void
+reloc_pass_finalize (struct VdlRelocPass *pass, struct VdlFile *file)
+{
+  VDL_LOG_STATS ("reloc file=%s plan=%s relocs=%lu lookups=%lu "
+		 "replayed=%lu memo-hits=%lu\n",
+		 file->filename, 
+		 (pass->plan == 0)?"none":(pass->replay?"replay":"record"),
+		 (unsigned long)pass->current, pass->n_lookups, 
+		 pass->n_replayed, pass->n_memo_hits);
+  if (pass->plan != 0 && !pass->replay && g_vdl.resolve_cache != 0)
+    {
+      vdl_resolve_cache_save (file, pass->scope, pass->plan);
+    }
+  if (pass->scope != 0)
+    {
+      vdl_alloc_free (pass->scope);
+    }
+  if (pass->memo != 0)
+    {
+      vdl_alloc_free (pass->memo);
+    }
+}
+
+// replay the lookup of the relocation number index of the pass.
+static struct VdlLookupResult
+reloc_plan_replay (struct VdlRelocPass *pass, struct VdlFile *file,
+		   uint32_t index)
+{
+  struct VdlRelocPlanEntry *entry = &pass->plan->entries[index];
+  struct VdlLookupResult result;
+  pass->n_replayed++;
+  if (entry->position == VDL_RELOC_PLAN_NOT_FOUND)
+    {
+      result.found = false;
+      return result;
+    }
+  result.found = true;
+  result.file = pass->scope[entry->position];
+  result.symbol = &result.file->dt_symtab[entry->symbol];
+  if (result.file != file)
+    {
+      // as done by vdl_lookup
+      vdl_list_push_front (file->gc_symbols_resolved_in, (void *)result.file);
+    }
+  return result;
+}
+
+static void
+reloc_plan_record (struct VdlRelocPass *pass, uint32_t index,
+		   struct VdlLookupResult result)
+{
+  struct VdlRelocPlan *plan = pass->plan;
+  if (!result.found || index >= plan->n_entries)
+    {
+      return;
+    }
+  uint32_t i;
+  for (i = 0; i < pass->scope_size; i++)
+    {
+      if (pass->scope[i] == result.file)
+	{
+	  plan->entries[index].position = i;
+	  plan->entries[index].symbol = result.symbol - result.file->dt_symtab;
+	  return;
+	}
+    }
+  // the symbol was not found in the scope: this should
+  // not happen but, if it does, we can't replay the plan 
+  // from this point.
+  plan->n_entries = index;
+}
+
+static bool
+reloc_memo_get (struct VdlRelocPass *pass, unsigned long symbol,
+		struct VdlLookupResult *result)
+{
+  if (symbol >= pass->memo_size || !pass->memo[symbol].valid)
+    {
+      return false;
+    }
+  *result = pass->memo[symbol].result;
+  pass->n_memo_hits++;
+  return true;
+}
+
+static void
+reloc_memo_set (struct VdlRelocPass *pass, unsigned long symbol,
+		struct VdlLookupResult result)
+{
+  if (symbol >= pass->memo_size)
+    {
+      uint32_t size = vdl_utils_max (pass->memo_size * 2, symbol + 1);
+      struct VdlRelocMemoEntry *memo = 
+	vdl_alloc_malloc (sizeof (struct VdlRelocMemoEntry) * size);
+      vdl_memset (memo, 0, sizeof (struct VdlRelocMemoEntry) * size);
+      if (pass->memo != 0)
+	{
+	  vdl_memcpy (memo, pass->memo, 
+		      sizeof (struct VdlRelocMemoEntry) * pass->memo_size);
+	  vdl_alloc_free (pass->memo);
+	}
+      pass->memo = memo;
+      pass->memo_size = size;
+    }
+  pass->memo[symbol].valid = true;
+  pass->memo[symbol].result = result;
+}
+
 static bool
 sym_to_ver_req (struct VdlFile *file,
 		unsigned long index,
 		const char **ver_name,
+		unsigned long *ver_hash,
 		const char **ver_filename)
 {
-  const char *dt_strtab = file->dt_strtab;
-  ElfW(Half) *dt_versym = file->dt_versym;
-  ElfW(Verneed) *dt_verneed = file->dt_verneed;
-  unsigned long dt_verneednum = file->dt_verneednum;
-  ElfW(Verdef) *dt_verdef = file->dt_verdef;
-  unsigned long dt_verdefnum = file->dt_verdefnum;
-
-  if (dt_strtab != 0 && dt_versym != 0)
-    {
-      // the same offset used to look in the symbol table (dt_symtab)
-      // is an offset in the version table (dt_versym).
-      // dt_versym contains a set of 15bit indexes and 
-      // 1bit flags packed into 16 bits. When the upper bit is
-      // set, the associated symbol is 'hidden', that is, it
-      // cannot be referenced from outside of the object.
-      ElfW(Half) ver_ndx = dt_versym[index];
-      if (ver_ndx & 0x8000)
+  // file->versions is zero if there is no dt_versym or dt_strtab.
+  if (file->versions == 0)
+    {
+      return false;
+    }
+  // the same offset used to look in the symbol table (dt_symtab)
+  // is an offset in the version table (dt_versym).
+  // dt_versym contains a set of 15bit indexes and 
+  // 1bit flags packed into 16 bits. When the upper bit is
+  // set, the associated symbol is 'hidden', that is, it
+  // cannot be referenced from outside of the object.
+  ElfW(Half) ver_ndx = file->dt_versym[index];
+  if (ver_ndx & 0x8000 ||
+      ver_ndx >= file->versions_size ||
+      file->versions[ver_ndx].name == 0)
+    {
+      return false;
+    }
+  // a version needed (from dt_verneed) or defined (from dt_verdef)
+  *ver_name = file->versions[ver_ndx].name;
+  *ver_hash = file->versions[ver_ndx].hash;
+  *ver_filename = file->versions[ver_ndx].filename;
+  return true;
+}
+
+// the number of entries of dt_symtab used by the relocations of file.
+static uint32_t
+reloc_symbol_count (const struct VdlFile *file)
+{
+  unsigned long count = 0;
+  unsigned long i;
+  if (file->dt_rel != 0 && file->dt_relent != 0)
+    {
+      for (i = 0; i < file->dt_relsz / file->dt_relent; i++)
 	{
-	  return false;
+	  count = vdl_utils_max (count, ELFW_R_SYM (file->dt_rel[i].r_info) + 1);
 	}
-      // search the version needed whose vna_other is equal to ver_ndx.
-      if (dt_verneed != 0 && dt_verneednum != 0)
+    }
+  if (file->dt_rela != 0 && file->dt_relaent != 0)
+    {
+      for (i = 0; i < file->dt_relasz / file->dt_relaent; i++)
 	{
-	  ElfW(Verneed) *cur, *prev;
-	  for (cur = dt_verneed, prev = 0; 
-	       cur != prev; 
-	       prev = cur, cur = (ElfW(Verneed) *)(((unsigned long)cur)+cur->vn_next))
-	    {
-	      VDL_LOG_ASSERT (cur->vn_version == 1, "version number invalid for Verneed");
-	      ElfW(Vernaux) *cur_aux, *prev_aux;
-	      for (cur_aux = (ElfW(Vernaux)*)(((unsigned long)cur)+cur->vn_aux), prev_aux = 0;
-		   cur_aux != prev_aux; 
-		   prev_aux = cur_aux, cur_aux = (ElfW(Vernaux)*)(((unsigned long)cur_aux)+cur_aux->vna_next))
-		{
-		  if (cur_aux->vna_other == ver_ndx)
-		    {
-		      *ver_name = dt_strtab + cur_aux->vna_name;
-		      *ver_filename = dt_strtab + cur->vn_file;
-		      return true;
-		    }
-		}
-	    }
+	  count = vdl_utils_max (count, ELFW_R_SYM (file->dt_rela[i].r_info) + 1);
 	}
-      // ok, there is no match for the requested version in the verneed array so,
-      // we look in the verdef array.
-      // search the version whose vd_ndx is equal to ver_ndx
-      if (dt_verdef != 0 && dt_verdefnum != 0)
+    }
+  if (file->dt_jmprel != 0 && file->dt_pltrel == DT_REL)
+    {
+      ElfW(Rel) *jmprel = (ElfW(Rel) *)file->dt_jmprel;
+      for (i = 0; i < file->dt_pltrelsz / sizeof (ElfW(Rel)); i++)
 	{
-	  ElfW(Verdef) *cur, *prev;
-	  for (prev = 0, cur = dt_verdef; cur != prev;
-	       prev = cur, cur = (ElfW(Verdef)*)(((unsigned long)cur)+cur->vd_next))
-	    {
-	      VDL_LOG_ASSERT (cur->vd_version == 1, "version number invalid for Verdef");
-	      if (cur->vd_ndx == ver_ndx)
-		{
-		  ElfW(Verdaux) *verdaux = (ElfW(Verdaux)*)(((unsigned long)cur)+cur->vd_aux);
-		  *ver_name = dt_strtab + verdaux->vda_name;
-		  // the filename comes from the base definition (i.e., the first entry)
-		  // in the verdef array.
-		  ElfW(Verdef) *base = &dt_verdef[0];
-		  ElfW(Verdaux) *base_verdaux = (ElfW(Verdaux)*)(((unsigned long)base)+base[0].vd_aux);
-		  *ver_filename = dt_strtab + base_verdaux->vda_name;
-		  return true;
-		}
-	    }
+	  count = vdl_utils_max (count, ELFW_R_SYM (jmprel[i].r_info) + 1);
+	}
+    }
+  else if (file->dt_jmprel != 0 && file->dt_pltrel == DT_RELA)
+    {
+      ElfW(Rela) *jmprel = (ElfW(Rela) *)file->dt_jmprel;
+      for (i = 0; i < file->dt_pltrelsz / sizeof (ElfW(Rela)); i++)
+	{
+	  count = vdl_utils_max (count, ELFW_R_SYM (jmprel[i].r_info) + 1);
 	}
     }
-  return false;
+  return count;
 }
 
-static unsigned long
-do_process_reloc (struct VdlFile *file, 
-		  unsigned long reloc_type, unsigned long *reloc_addr,
-		  unsigned long reloc_addend, unsigned long reloc_sym)
+// return the gnu hash of the name of symbol index of file. 
+// It is calculated at most once per image rather than once 
+// per lookup in each of the mappings of the image.
+static uint32_t
+reloc_symbol_gnu_hash (struct VdlFile *file, unsigned long index)
 {
-  const char *dt_strtab = file->dt_strtab;
-  ElfW(Sym) *dt_symtab = file->dt_symtab;
-  if (dt_strtab == 0 || dt_symtab == 0)
+  struct VdlImage *image = file->image;
+  const char *name = file->dt_strtab + file->dt_symtab[index].st_name;
+  if (image->symbol_hashes == 0)
     {
-      return 0;
+      uint32_t size = reloc_symbol_count (file);
+      image->symbol_hashes = vdl_alloc_malloc (sizeof (uint32_t) * (size + 1));
+      vdl_memset (image->symbol_hashes, 0, sizeof (uint32_t) * (size + 1));
+      image->symbol_hashes_size = size;
     }
-  ElfW(Sym) *sym = &dt_symtab[reloc_sym];
+  if (index >= image->symbol_hashes_size)
+    {
+      return vdl_gnu_hash (name);
+    }
+  uint32_t *hash = &image->symbol_hashes[index];
+  if (*hash == 0)
+    {
+      // a name whose hash is really zero is just hashed every time.
+      *hash = vdl_gnu_hash (name);
+    }
+  return *hash;
+}
 
-  VDL_LOG_FUNCTION ("file=%s, type=%s, addr=0x%lx, addend=0x%lx, sym=%s", 
-		    file->filename, machine_reloc_type_to_str (reloc_type), 
-		    reloc_addr, reloc_addend, reloc_sym == 0?"0":dt_strtab + sym->st_name);
-  
-  const struct VdlFile *symbol_file = 0;
-  unsigned long symbol_value = 0;
-  unsigned long symbol_type = 0;
+// find the symbol used by a relocation of file. For R_*_COPY
+// relocations, the symbol is not resolved if it is an IFUNC.
+// Returns false if the symbol is not found.
+static bool
+reloc_symbol_resolve (struct VdlFile *file, 
+		      struct VdlRelocPass *pass, uint32_t index,
+		      unsigned long reloc_type, unsigned long reloc_sym,
+		      struct VdlRelocSymbol *out)
+{
+  const char *dt_strtab = file->dt_strtab;
+  ElfW(Sym) *dt_symtab = file->dt_symtab;
+  ElfW(Sym) *sym = &dt_symtab[reloc_sym];
   if (!machine_reloc_is_relative (reloc_type) &&
       sym->st_name != 0)
     {
@@ -124,12 +453,40 @@ do_process_reloc (struct VdlFile *file,
 	  // in the main binary.
 	  flags |= VDL_LOOKUP_NO_EXEC;
 	}
-      const char *ver_name = 0;
-      const char *ver_filename = 0;
-      sym_to_ver_req (file, reloc_sym, &ver_name, &ver_filename);
-
       struct VdlLookupResult result;
-      result = vdl_lookup (file, symbol_name, ver_name, ver_filename, flags);
+      // relocations which use the same symbol and the same
+      // lookup flags within a pass resolve to the same symbol.
+      bool memoize = pass != 0 && flags == 0;
+      if (memoize && reloc_memo_get (pass, reloc_sym, &result))
+	{
+	  // nothing to do.
+	}
+      else if (pass != 0 && pass->replay && index < pass->plan->n_entries)
+	{
+	  result = reloc_plan_replay (pass, file, index);
+	}
+      else
+	{
+	  const char *ver_name = 0;
+	  unsigned long ver_hash = 0;
+	  const char *ver_filename = 0;
+	  sym_to_ver_req (file, reloc_sym, &ver_name, &ver_hash, &ver_filename);
+	  result = vdl_lookup_hashed (file, symbol_name, 
+				      reloc_symbol_gnu_hash (file, reloc_sym),
+				      ver_name, ver_hash, ver_filename, flags);
+	  if (pass != 0)
+	    {
+	      pass->n_lookups++;
+	    }
+	}
+      if (pass != 0 && pass->plan != 0 && !pass->replay)
+	{
+	  reloc_plan_record (pass, index, result);
+	}
+      if (memoize)
+	{
+	  reloc_memo_set (pass, reloc_sym, result);
+	}
       if (!result.found)
 	{
 	  if (ELFW_ST_BIND (sym->st_info) == STB_WEAK)
@@ -143,34 +500,27 @@ do_process_reloc (struct VdlFile *file,
 	      // to emulate the glibc behavior
 	      VDL_LOG_SYMBOL_FAIL (symbol_name, file);
 	    }
-	  return 0;
+	  return false;
 	}
       VDL_LOG_SYMBOL_OK (symbol_name, file, result);
+      out->file = result.file;
+      out->symbol = result.symbol;
+      out->value = result.symbol->st_value;
+      out->type = ELFW_ST_TYPE (result.symbol->st_info);
       if (machine_reloc_is_copy (reloc_type))
 	{
-	  // we handle R_*_COPY relocs ourselves
-	  VDL_LOG_ASSERT (result.symbol->st_size == sym->st_size,
-			  "Symbols don't have the same size: likely a recipe for disaster.");
-	  vdl_memcpy (reloc_addr, 
-		      (void*)(result.file->load_base + result.symbol->st_value),
-		      result.symbol->st_size);
-	  return *reloc_addr;
-	}
-      else
-	{
-	  symbol_file = result.file;
-	  symbol_value = result.symbol->st_value;
-	  symbol_type = ELFW_ST_TYPE (result.symbol->st_info);
+	  return true;
 	}
     }
   else
     {
-      symbol_file = file;
-      symbol_value = sym->st_value;
-      symbol_type = ELFW_ST_TYPE (sym->st_info);
+      out->file = file;
+      out->symbol = sym;
+      out->value = sym->st_value;
+      out->type = ELFW_ST_TYPE (sym->st_info);
     }
 
-  if (symbol_type == STT_GNU_IFUNC)
+  if (out->type == STT_GNU_IFUNC)
     {
       // We must call the symbol to get the symbol value.
       // This is a glibc extension which appeared in fc12 for
@@ -179,45 +529,121 @@ do_process_reloc (struct VdlFile *file,
       // used to detect automatically the hardware type and
       // use optimized versions of specified functions such
       // as strlen, etc.
-      unsigned long (*ifunc) (void) = (unsigned long (*) (void)) 
-	(symbol_value + symbol_file->load_base);
-      symbol_value = ifunc ();
+      // The result is shared by all the mappings of the image.
+      out->value = vdl_image_ifunc_call (out->file->image,
+					 out->file->load_base,
+					 out->value);
       // we need to remove the load base such that the relocation
       // code which adds the load_base again generates a valid
       // address
-      symbol_value -= symbol_file->load_base;
+      out->value -= out->file->load_base;
+    }
+  return true;
+}
+
+bool
+vdl_reloc_symbol_resolve (struct VdlFile *file, 
+			  unsigned long reloc_type, unsigned long reloc_sym,
+			  struct VdlRelocSymbol *symbol)
+{
+  if (file->dt_strtab == 0 || file->dt_symtab == 0)
+    {
+      return false;
+    }
+  return reloc_symbol_resolve (file, 0, 0, reloc_type, reloc_sym, symbol);
+}
+
+// index is the position of the relocation in the plan of pass.
+static unsigned long
+do_process_reloc (struct VdlFile *file, 
+		  struct VdlRelocPass *pass, uint32_t index,
+		  unsigned long reloc_type, unsigned long *reloc_addr,
+		  unsigned long reloc_addend, unsigned long reloc_sym)
+{
+  const char *dt_strtab = file->dt_strtab;
+  ElfW(Sym) *dt_symtab = file->dt_symtab;
+  if (dt_strtab == 0 || dt_symtab == 0)
+    {
+      return 0;
     }
 
-  machine_reloc (symbol_file, reloc_addr, reloc_type, reloc_addend,
-		 symbol_value, symbol_type);
+  VDL_LOG_FUNCTION ("file=%s, type=%s, addr=0x%lx, addend=0x%lx, sym=%s", 
+		    file->filename, machine_reloc_type_to_str (reloc_type), 
+		    reloc_addr, reloc_addend, 
+		    reloc_sym == 0?"0":dt_strtab + dt_symtab[reloc_sym].st_name);
+  
+  struct VdlRelocSymbol symbol;
+  if (!reloc_symbol_resolve (file, pass, index, reloc_type, reloc_sym, &symbol))
+    {
+      return 0;
+    }
+  if (machine_reloc_is_copy (reloc_type))
+    {
+      // we handle R_*_COPY relocs ourselves
+      VDL_LOG_ASSERT (symbol.symbol->st_size == dt_symtab[reloc_sym].st_size,
+		      "Symbols don't have the same size: likely a recipe for disaster.");
+      vdl_memcpy (reloc_addr, 
+		  (void*)(symbol.file->load_base + symbol.symbol->st_value),
+		  symbol.symbol->st_size);
+      return *reloc_addr;
+    }
+
+  machine_reloc (symbol.file, reloc_addr, reloc_type, reloc_addend,
+		 symbol.value, symbol.type);
 
   return *reloc_addr;
 }
 
+// return the index of the next relocation processed by pass.
+static uint32_t
+reloc_pass_next (struct VdlRelocPass *pass)
+{
+  // pass is zero for the lazy relocations of dt_jmprel.
+  if (pass == 0)
+    {
+      return 0;
+    }
+  return pass->current++;
+}
+
 static unsigned long
-process_rel (struct VdlFile *file, ElfW(Rel) *rel)
+process_rel_at (struct VdlFile *file, struct VdlRelocPass *pass, uint32_t index,
+		ElfW(Rel) *rel)
 {
   unsigned long reloc_type = ELFW_R_TYPE (rel->r_info);
   unsigned long *reloc_addr = (unsigned long*) (file->load_base + rel->r_offset);
   unsigned long reloc_addend = *reloc_addr;
   unsigned long reloc_sym = ELFW_R_SYM (rel->r_info);
 
-  return do_process_reloc (file, reloc_type, reloc_addr, reloc_addend, reloc_sym);
+  return do_process_reloc (file, pass, index, reloc_type, reloc_addr, reloc_addend, reloc_sym);
 }
 
 static unsigned long
-process_rela (struct VdlFile *file, ElfW(Rela) *rela)
+process_rela_at (struct VdlFile *file, struct VdlRelocPass *pass, uint32_t index,
+		 ElfW(Rela) *rela)
 {
   unsigned long reloc_type = ELFW_R_TYPE (rela->r_info);
   unsigned long *reloc_addr = (unsigned long*) (file->load_base + rela->r_offset);
   unsigned long reloc_addend = rela->r_addend;
   unsigned long reloc_sym = ELFW_R_SYM (rela->r_info);
 
-  return do_process_reloc (file, reloc_type, reloc_addr, reloc_addend, reloc_sym);
+  return do_process_reloc (file, pass, index, reloc_type, reloc_addr, reloc_addend, reloc_sym);
+}
+
+static unsigned long
+process_rel (struct VdlFile *file, struct VdlRelocPass *pass, ElfW(Rel) *rel)
+{
+  return process_rel_at (file, pass, reloc_pass_next (pass), rel);
+}
+
+static unsigned long
+process_rela (struct VdlFile *file, struct VdlRelocPass *pass, ElfW(Rela) *rela)
+{
+  return process_rela_at (file, pass, reloc_pass_next (pass), rela);
 }
 
 static void
-reloc_jmprel (struct VdlFile *file)
+reloc_jmprel (struct VdlFile *file, struct VdlRelocPass *pass)
 {
   VDL_LOG_FUNCTION ("file=%s", file->name);
   unsigned long dt_jmprel = file->dt_jmprel;
@@ -235,7 +661,7 @@ reloc_jmprel (struct VdlFile *file)
       for (i = 0; i < dt_pltrelsz/sizeof(ElfW(Rel)); i++)
 	{
 	  ElfW(Rel) *rel = &(((ElfW(Rel)*)dt_jmprel)[i]);
-	  process_rel (file, rel);
+	  process_rel (file, pass, rel);
 	}
     }
   else
@@ -244,10 +670,123 @@ reloc_jmprel (struct VdlFile *file)
       for (i = 0; i < dt_pltrelsz/sizeof(ElfW(Rela)); i++)
 	{
 	  ElfW(Rela) *rela = &(((ElfW(Rela)*)dt_jmprel)[i]);
-	  process_rela (file, rela);
+	  process_rela (file, pass, rela);
+	}
+    }
+}
+unsigned long
+vdl_reloc_jmprel_range (struct VdlFile *file,
+			unsigned long start, unsigned long end)
+{
+  VDL_LOG_FUNCTION ("file=%s, start=%lu, end=%lu", file->name, start, end);
+  if (file->dt_jmprel == 0)
+    {
+      return start;
+    }
+  unsigned long i = start;
+  if (file->dt_pltrel == DT_REL)
+    {
+      ElfW(Rel) *dt_jmprel = (ElfW(Rel)*)file->dt_jmprel;
+      end = vdl_utils_min (end, file->dt_pltrelsz/sizeof(ElfW(Rel)));
+      for (; i < end; i++)
+	{
+	  if (machine_reloc_is_jump_slot (ELFW_R_TYPE (dt_jmprel[i].r_info)))
+	    {
+	      process_rel (file, 0, &dt_jmprel[i]);
+	    }
+	}
+    }
+  else if (file->dt_pltrel == DT_RELA)
+    {
+      ElfW(Rela) *dt_jmprel = (ElfW(Rela)*)file->dt_jmprel;
+      end = vdl_utils_min (end, file->dt_pltrelsz/sizeof(ElfW(Rela)));
+      for (; i < end; i++)
+	{
+	  if (machine_reloc_is_jump_slot (ELFW_R_TYPE (dt_jmprel[i].r_info)))
+	    {
+	      process_rela (file, 0, &dt_jmprel[i]);
+	    }
+	}
+    }
+  return i;
+}
+
+// the TLS descriptors of dt_jmprel can't be resolved lazily
+// by machine_resolve_trampoline so, we resolve them now.
+static void
+reloc_jmprel_tlsdesc (struct VdlFile *file)
+{
+  if (file->dt_jmprel == 0)
+    {
+      return;
+    }
+  if (file->dt_pltrel == DT_REL)
+    {
+      unsigned long i;
+      for (i = 0; i < file->dt_pltrelsz/sizeof(ElfW(Rel)); i++)
+	{
+	  ElfW(Rel) *rel = &(((ElfW(Rel)*)file->dt_jmprel)[i]);
+	  if (machine_reloc_is_tlsdesc (ELFW_R_TYPE (rel->r_info)))
+	    {
+	      process_rel (file, 0, rel);
+	    }
+	}
+    }
+  else if (file->dt_pltrel == DT_RELA)
+    {
+      unsigned long i;
+      for (i = 0; i < file->dt_pltrelsz/sizeof(ElfW(Rela)); i++)
+	{
+	  ElfW(Rela) *rela = &(((ElfW(Rela)*)file->dt_jmprel)[i]);
+	  if (machine_reloc_is_tlsdesc (ELFW_R_TYPE (rela->r_info)))
+	    {
+	      process_rela (file, 0, rela);
+	    }
 	}
     }
 }
+
+// bind now the PLT slots which were resolved lazily by earlier
+// runs, according to the bind profile of this file.
+static void
+reloc_jmprel_hot (struct VdlFile *file)
+{
+  if (g_vdl.bind_profile == 0 || file->dt_jmprel == 0)
+    {
+      return;
+    }
+  unsigned long n_hot = 0;
+  if (file->dt_pltrel == DT_REL)
+    {
+      unsigned long i;
+      for (i = 0; i < file->dt_pltrelsz/sizeof(ElfW(Rel)); i++)
+	{
+	  ElfW(Rel) *rel = &(((ElfW(Rel)*)file->dt_jmprel)[i]);
+	  if (machine_reloc_is_jump_slot (ELFW_R_TYPE (rel->r_info)) &&
+	      vdl_bind_profile_is_hot (file, i))
+	    {
+	      process_rel (file, 0, rel);
+	      n_hot++;
+	    }
+	}
+    }
+  else if (file->dt_pltrel == DT_RELA)
+    {
+      unsigned long i;
+      for (i = 0; i < file->dt_pltrelsz/sizeof(ElfW(Rela)); i++)
+	{
+	  ElfW(Rela) *rela = &(((ElfW(Rela)*)file->dt_jmprel)[i]);
+	  if (machine_reloc_is_jump_slot (ELFW_R_TYPE (rela->r_info)) &&
+	      vdl_bind_profile_is_hot (file, i))
+	    {
+	      process_rela (file, 0, rela);
+	      n_hot++;
+	    }
+	}
+    }
+  VDL_LOG_DEBUG ("file=%s prebound=%lu\n", file->name, n_hot);
+}
+
 unsigned long 
 vdl_reloc_offset_jmprel (struct VdlFile *file, 
 			 unsigned long offset)
@@ -271,12 +810,14 @@ vdl_reloc_offset_jmprel (struct VdlFile *file,
   if (dt_pltrel == DT_REL)
     {
       ElfW(Rel) *rel = (ElfW(Rel)*)(dt_jmprel+offset);
-      symbol = process_rel (file, rel);
+      symbol = process_rel (file, 0, rel);
+      vdl_bind_profile_record (file, offset / sizeof (ElfW(Rel)));
     }
   else
     {
       ElfW(Rela) *rela = (ElfW(Rela)*)(dt_jmprel+offset);
-      symbol = process_rela (file, rela);
+      symbol = process_rela (file, 0, rela);
+      vdl_bind_profile_record (file, offset / sizeof (ElfW(Rela)));
     }
   futex_unlock (g_vdl.futex);
   return symbol;
@@ -305,22 +846,76 @@ vdl_reloc_index_jmprel (struct VdlFile *file,
       VDL_LOG_ASSERT (index < dt_pltrelsz / sizeof(ElfW(Rel)), 
 		      "Relocation entry not within range");
       ElfW(Rel) *rel = &((ElfW(Rel)*)dt_jmprel)[index];
-      symbol = process_rel (file, rel);
+      symbol = process_rel (file, 0, rel);
     }
   else
     {
       VDL_LOG_ASSERT (index < dt_pltrelsz / sizeof(ElfW(Rela)), 
 		      "Relocation entry not within range");
       ElfW(Rela) *rela = &((ElfW(Rela)*)dt_jmprel)[index];
-      symbol = process_rela (file, rela);
+      symbol = process_rela (file, 0, rela);
     }
+  vdl_bind_profile_record (file, index);
   futex_unlock (g_vdl.futex);
   return symbol;
 }
 
 
+void
+vdl_reloc_relr (unsigned long load_base,
+		const ElfW(Addr) *relr, unsigned long relrsz)
+{
+  // An even entry is the address of a word to relocate and starts
+  // a run. An odd entry is a bitmap: bit i+1 is set if word i of 
+  // the next 8*sizeof(word)-1 words after the current position
+  // needs to be relocated.
+  const unsigned long nbits = 8 * sizeof (ElfW(Addr)) - 1;
+  const ElfW(Addr) *end = relr + relrsz / sizeof (ElfW(Addr));
+  ElfW(Addr) *where = 0;
+  const ElfW(Addr) *cur;
+  for (cur = relr; cur < end; cur++)
+    {
+      ElfW(Addr) entry = *cur;
+      if ((entry & 1) == 0)
+	{
+	  where = (ElfW(Addr) *)(load_base + entry);
+	  *where += load_base;
+	  where++;
+	}
+      else
+	{
+	  ElfW(Addr) *word;
+	  for (word = where, entry >>= 1; entry != 0; word++, entry >>= 1)
+	    {
+	      if (entry & 1)
+		{
+		  *word += load_base;
+		}
+	    }
+	  where += nbits;
+	}
+    }
+}
+
+static void
+reloc_dtrelr (struct VdlFile *file)
+{
+  VDL_LOG_FUNCTION ("file=%s", file->name);
+  if (file->dt_relr == 0 || file->dt_relrsz == 0)
+    {
+      return;
+    }
+  VDL_LOG_ASSERT (file->dt_relrent == 0 || file->dt_relrent == sizeof (ElfW(Addr)),
+		  "Invalid DT_RELRENT");
+  vdl_reloc_relr (file->load_base, file->dt_relr, file->dt_relrsz);
+}
+
+// The symbol relocations of the types returned by machine_reloc_group
+// are applied directly by the function of their type, which is looked
+// up only when the type changes from one entry to the next. The other
+// relocations go through machine_reloc.
 static void
-reloc_dtrel (struct VdlFile *file)
+reloc_dtrel (struct VdlFile *file, struct VdlRelocPass *pass)
 {
   VDL_LOG_FUNCTION ("file=%s", file->name);
   ElfW(Rel) *dt_rel = file->dt_rel;
@@ -330,16 +925,41 @@ reloc_dtrel (struct VdlFile *file)
     {
       return;
     }
-  uint32_t i;
-  for (i = 0; i < dt_relsz/dt_relent; i++)
+  uint32_t n = dt_relsz/dt_relent;
+  // the leading relative relocations need no symbol.
+  uint32_t i = vdl_utils_min (file->dt_relcount, n);
+  machine_reloc_relative_rel (file->load_base, dt_rel, i);
+  pass->current += i;
+  bool grouped = file->dt_strtab != 0 && file->dt_symtab != 0;
+  unsigned long type = ~0UL;
+  MachineRelocFunction function = 0;
+  for (; i < n; i++)
     {
       ElfW(Rel) *rel = &dt_rel[i];
-      process_rel (file, rel);
+      uint32_t index = reloc_pass_next (pass);
+      if (ELFW_R_TYPE (rel->r_info) != type)
+	{
+	  // consecutive entries often share their type.
+	  type = ELFW_R_TYPE (rel->r_info);
+	  function = grouped?machine_reloc_group (type):0;
+	}
+      if (function == 0)
+	{
+	  process_rel_at (file, pass, index, rel);
+	  continue;
+	}
+      unsigned long *reloc_addr = (unsigned long*) (file->load_base + rel->r_offset);
+      struct VdlRelocSymbol symbol;
+      if (reloc_symbol_resolve (file, pass, index, type,
+				ELFW_R_SYM (rel->r_info), &symbol))
+	{
+	  function (symbol.file, reloc_addr, *reloc_addr, symbol.value);
+	}
     }
 }
 
 static void
-reloc_dtrela (struct VdlFile *file)
+reloc_dtrela (struct VdlFile *file, struct VdlRelocPass *pass)
 {
   VDL_LOG_FUNCTION ("file=%s", file->name);
   ElfW(Rela) *dt_rela = file->dt_rela;
@@ -349,11 +969,56 @@ reloc_dtrela (struct VdlFile *file)
     {
       return;
     }
-  uint32_t i;
-  for (i = 0; i < dt_relasz/dt_relaent; i++)
+  uint32_t n = dt_relasz/dt_relaent;
+  // the leading relative relocations need no symbol.
+  uint32_t i = vdl_utils_min (file->dt_relacount, n);
+  machine_reloc_relative_rela (file->load_base, dt_rela, i);
+  pass->current += i;
+  bool grouped = file->dt_strtab != 0 && file->dt_symtab != 0;
+  unsigned long type = ~0UL;
+  MachineRelocFunction function = 0;
+  for (; i < n; i++)
     {
       ElfW(Rela) *rela = &dt_rela[i];
-      process_rela (file, rela);
+      uint32_t index = reloc_pass_next (pass);
+      if (ELFW_R_TYPE (rela->r_info) != type)
+	{
+	  // consecutive entries often share their type.
+	  type = ELFW_R_TYPE (rela->r_info);
+	  function = grouped?machine_reloc_group (type):0;
+	}
+      if (function == 0)
+	{
+	  process_rela_at (file, pass, index, rela);
+	  continue;
+	}
+      unsigned long *reloc_addr = (unsigned long*) (file->load_base + rela->r_offset);
+      struct VdlRelocSymbol symbol;
+      if (reloc_symbol_resolve (file, pass, index, type,
+				ELFW_R_SYM (rela->r_info), &symbol))
+	{
+	  function (symbol.file, reloc_addr, rela->r_addend, symbol.value);
+	}
+    }
+}
+
+// the dt_rel and dt_rela entries were handed to vdl_uffd_reloc.
+static void
+reloc_pass_skip_deferred (struct VdlRelocPass *pass, struct VdlFile *file)
+{
+  if (pass->plan != 0 && !pass->replay)
+    {
+      // their lookups were not recorded so the plan can't
+      // be replayed from this point.
+      pass->plan->n_entries = vdl_utils_min (pass->plan->n_entries, pass->current);
+    }
+  if (file->dt_rel != 0 && file->dt_relent != 0)
+    {
+      pass->current += file->dt_relsz / file->dt_relent;
+    }
+  if (file->dt_rela != 0 && file->dt_relaent != 0)
+    {
+      pass->current += file->dt_relasz / file->dt_relaent;
     }
 }
 
@@ -365,39 +1030,67 @@ do_reloc (struct VdlFile *file, int now)
       return;
     }
   file->reloced = 1;
+  // the binary or its namespace can ask for immediate binding
+  // even if the caller did not.
+  now = now || 
+    (file->dt_flags & DF_BIND_NOW) || 
+    file->context->bind_policy == VDL_BIND_NOW;
 
   if (file->dt_flags & DF_TEXTREL)
     {
       // we need to mark the pages as write to allow
       // the relocations to proceed
       void **i;
-      for (i = vdl_list_begin (file->maps); i != vdl_list_end (file->maps); i = vdl_list_next (i))
+      for (i = vdl_list_begin (file->image->maps); 
+	   i != vdl_list_end (file->image->maps); 
+	   i = vdl_list_next (i))
 	{
 	  struct VdlFileMap *map = *i;
-	  system_mprotect ((void*)map->mem_start_align, map->mem_size_align, 
+	  system_mprotect ((void*)(file->load_base + map->mem_start_align), 
+			   map->mem_size_align, 
 			   map->mmap_flags | PROT_WRITE);
 	}
     }
 
-  reloc_dtrel (file);
-  reloc_dtrela (file);
+  struct VdlRelocPass pass;
+  reloc_pass_initialize (&pass, file, now);
+  reloc_dtrelr (file);
+  if (g_vdl.uffd_reloc && vdl_uffd_reloc (file))
+    {
+      reloc_pass_skip_deferred (&pass, file);
+    }
+  else
+    {
+      reloc_dtrel (file, &pass);
+      reloc_dtrela (file, &pass);
+    }
   if (now)
     {
       // perform full PLT relocs _now_
-      reloc_jmprel (file);
+      reloc_jmprel (file, &pass);
     }
   else
     {
       machine_lazy_reloc (file);
+      reloc_jmprel_tlsdesc (file);
+      reloc_jmprel_hot (file);
+      if (file->context->bind_policy == VDL_BIND_BACKGROUND)
+	{
+	  vdl_bind_worker_add (file);
+	}
     }
+  reloc_pass_finalize (&pass, file);
   if (file->dt_flags & DF_TEXTREL)
     {
       // undo the write access
       void **i;
-      for (i = vdl_list_begin (file->maps); i != vdl_list_end (file->maps); i = vdl_list_next (i))
+      for (i = vdl_list_begin (file->image->maps); 
+	   i != vdl_list_end (file->image->maps); 
+	   i = vdl_list_next (i))
 	{
 	  struct VdlFileMap *map = *i;
-	  system_mprotect ((void*)map->mem_start_align, map->mem_size_align, 
+	  system_mprotect ((void*)(file->load_base + map->mem_start_align), 
+			   map->mem_size_align, 
 			   map->mmap_flags);
 	}
     }
@@ -408,11 +1101,25 @@ void vdl_reloc (struct VdlList *files, int now)
   struct VdlList *sorted = vdl_sort_increasing_depth (files);
   vdl_list_reverse (sorted);
   void **cur;
+  for (cur = vdl_list_begin (sorted);
+       cur != vdl_list_end (sorted);
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFile *file = *cur;
+      vdl_lookup_cache_reserve (file->context, reloc_count (file, now));
+    }
   for (cur = vdl_list_begin (sorted);
        cur != vdl_list_end (sorted);
        cur = vdl_list_next (cur))
     {
       do_reloc (*cur, now);
     }
+  for (cur = vdl_list_begin (sorted);
+       cur != vdl_list_end (sorted);
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFile *file = *cur;
+      vdl_lookup_cache_release (file->context);
+    }
   vdl_list_delete (sorted);
 }
@@ -1,8 +1,64 @@
 #ifndef VDL_RELOC_H
 #define VDL_RELOC_H
 
+#include <link.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "vdl-file.h"
+
 struct VdlList;
-struct VdlFile;
+
+// When the same image is relocated a second time in a scope made of
+// the same images, with the same symbol remaps, every symbol lookup
+// returns the same symbol in the file at the same position of the
+// scope. So, we record during the initial relocation pass of the
+// first file mapped from an image the result of each lookup in a plan
+// stored in the image and replay it for the next files which
+// match the conditions under which it was recorded. Plans can also
+// be saved on disk and read by the next processes: see vdl-resolve-cache.h
+#define VDL_RELOC_PLAN_NOT_FOUND 0xffffffff
+
+struct VdlRelocPlanEntry
+{
+  // the position in the lookup scope of the file which
+  // defines the symbol or VDL_RELOC_PLAN_NOT_FOUND.
+  uint32_t position;
+  // the index of the symbol in the dt_symtab of this file.
+  uint32_t symbol;
+};
+
+struct VdlRelocPlan
+{
+  // the serials of the images of the files which make up the
+  // lookup scope when the plan was recorded.
+  unsigned long *scope;
+  uint32_t scope_size;
+  // the number of files which are part of the first scope
+  uint32_t first_size;
+  enum VdlFileLookupType lookup_type;
+  uint32_t symbol_remaps_signature;
+  // one entry per relocation processed by the initial relocation
+  // pass, in processing order: dt_rel, dt_rela and, if the pass
+  // was not lazy, dt_jmprel.
+  struct VdlRelocPlanEntry *entries;
+  uint32_t n_entries;
+  // if the plan was read by vdl_resolve_cache_load, entries points
+  // within this read-only mapping of the cache file.
+  void *mapping;
+  unsigned long mapping_size;
+};
+
+// the symbol used by a relocation, as resolved by 
+// vdl_reloc_symbol_resolve, and the arguments of machine_reloc
+// which derive from it.
+struct VdlRelocSymbol
+{
+  const struct VdlFile *file;
+  const ElfW(Sym) *symbol;
+  // the value returned by the resolver for IFUNC symbols.
+  unsigned long value;
+  unsigned long type;
+};
 
 void vdl_reloc (struct VdlList *list, int now);
 // offset is in bytes, return value is reloced symbol
@@ -13,4 +69,24 @@ unsigned long vdl_reloc_offset_jmprel (struct VdlFile *file,
 unsigned long vdl_reloc_index_jmprel (struct VdlFile *file, 
 				      unsigned long index);
 
+// apply the DT_RELR packed relative relocations of an object
+// mapped at load_base. Does not use any global data so, it can
+// be used by stage1 to relocate the loader itself.
+void vdl_reloc_relr (unsigned long load_base,
+		     const ElfW(Addr) *relr, unsigned long relrsz);
+// bind the JUMP_SLOT entries of dt_jmprel whose index is in [start,end)
+// and return the index of the first entry which was not processed,
+// which is smaller than end if the end of dt_jmprel was reached.
+// The caller must hold g_vdl.futex.
+unsigned long vdl_reloc_jmprel_range (struct VdlFile *file,
+				      unsigned long start, unsigned long end);
+// find the symbol used by a relocation of file which uses symbol
+// index reloc_sym, as is done when the relocation is processed.
+// Returns false if there is no such symbol, in which case the
+// relocation must not be applied. The caller must hold g_vdl.futex.
+bool vdl_reloc_symbol_resolve (struct VdlFile *file, 
+			       unsigned long reloc_type, unsigned long reloc_sym,
+			       struct VdlRelocSymbol *symbol);
+void vdl_reloc_plan_delete (struct VdlRelocPlan *plan);
+
 #endif /* VDL_RELOC_H */
@@ -0,0 +1,378 @@
+#include "vdl-resolve-cache.h"
+#include "vdl.h"
+#include "vdl-reloc.h"
+#include "vdl-file.h"
+#include "vdl-image.h"
+#include "vdl-context.h"
+#include "vdl-log.h"
+#include "vdl-lookup.h"
+#include "vdl-utils.h"
+#include "vdl-alloc.h"
+#include "vdl-mem.h"
+#include "system.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define VDL_RESOLVE_CACHE_MAGIC 0x52444c56 // "VLDR"
+
+// set in VdlResolveCacheHeader::flags if the plan was recorded
+// with LD_DIRECT_BIND.
+#define VDL_RESOLVE_CACHE_DIRECT_BIND 1
+
+// the identity of a file on disk.
+struct VdlResolveCacheId
+{
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  uint64_t mtime;
+  uint64_t build_id;
+};
+
+// the header of a cache file. It is followed by scope_size
+// VdlResolveCacheId which describe the lookup scope and by
+// n_entries VdlRelocPlanEntry.
+struct VdlResolveCacheHeader
+{
+  uint32_t magic;
+  uint32_t flags;
+  uint32_t lookup_type;
+  uint32_t symbol_remaps_signature;
+  uint32_t scope_size;
+  uint32_t first_size;
+  uint32_t n_entries;
+  uint32_t reserved;
+  struct VdlResolveCacheId self;
+};
+
+static uint64_t
+resolve_cache_build_id (const struct VdlFile *file)
+{
+  uint32_t i;
+  for (i = 0; i < file->phnum; i++)
+    {
+      ElfW(Phdr) *phdr = &file->phdr[i];
+      if (phdr->p_type != PT_NOTE)
+	{
+	  continue;
+	}
+      unsigned long cur = file->load_base + phdr->p_vaddr;
+      unsigned long end = cur + phdr->p_memsz;
+      while (cur + sizeof (ElfW(Nhdr)) <= end)
+	{
+	  ElfW(Nhdr) *note = (ElfW(Nhdr) *)cur;
+	  const char *name = (const char *)(note + 1);
+	  const uint8_t *desc = (const uint8_t *)(name + vdl_utils_align_up (note->n_namesz, 4));
+	  cur = (unsigned long)desc + vdl_utils_align_up (note->n_descsz, 4);
+	  if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+	      vdl_utils_strisequal (name, "GNU") && cur <= end)
+	    {
+	      // FNV-1a
+	      uint64_t hash = 0xcbf29ce484222325ULL;
+	      uint32_t j;
+	      for (j = 0; j < note->n_descsz; j++)
+		{
+		  hash = (hash ^ desc[j]) * 0x100000001b3ULL;
+		}
+	      return hash;
+	    }
+	}
+    }
+  return 0;
+}
+
+// The images which were mapped by someone else, such as the main
+// binary, are not identified by a st_dev/st_ino pair so, we ask
+// the filesystem.
+static bool
+resolve_cache_id (const struct VdlFile *file, struct VdlResolveCacheId *id)
+{
+  struct VdlImage *image = file->image;
+  if (!image->identity_initialized)
+    {
+      if (!image->registered)
+	{
+	  struct stat st_buf;
+	  if (system_fstat (file->filename, &st_buf) == -1)
+	    {
+	      return false;
+	    }
+	  image->st_dev = st_buf.st_dev;
+	  image->st_ino = st_buf.st_ino;
+	  image->size = st_buf.st_size;
+	  image->mtime = st_buf.st_mtime;
+	}
+      image->build_id = resolve_cache_build_id (file);
+      image->identity_initialized = 1;
+    }
+  vdl_memset (id, 0, sizeof (*id));
+  id->dev = image->st_dev;
+  id->ino = image->st_ino;
+  id->size = image->size;
+  id->mtime = image->mtime;
+  id->build_id = image->build_id;
+  return true;
+}
+
+static bool
+resolve_cache_id_equal (const struct VdlResolveCacheId *a,
+			const struct VdlResolveCacheId *b)
+{
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+    a->mtime == b->mtime && a->build_id == b->build_id;
+}
+
+// the identities of the files of the scope or zero if one of
+// them is unknown.
+static struct VdlResolveCacheId *
+resolve_cache_scope_ids (struct VdlFile **scope, uint32_t scope_size)
+{
+  struct VdlResolveCacheId *ids = vdl_alloc_malloc (sizeof (*ids) * (scope_size + 1));
+  uint32_t i;
+  for (i = 0; i < scope_size; i++)
+    {
+      if (!resolve_cache_id (scope[i], &ids[i]))
+	{
+	  vdl_alloc_free (ids);
+	  return 0;
+	}
+    }
+  return ids;
+}
+
+static uint64_t
+resolve_cache_hash (uint64_t hash, const void *buffer, unsigned long size)
+{
+  // FNV-1a
+  const uint8_t *cur = buffer;
+  unsigned long i;
+  for (i = 0; i < size; i++)
+    {
+      hash = (hash ^ cur[i]) * 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+// The plan of a file depends on its whole lookup scope so, the
+// path of its cache file includes a hash of everything the header
+// of the file is checked against: the plans of the same file
+// relocated in different scopes don't overwrite each other.
+static char *
+resolve_cache_path (const struct VdlFile *file,
+		    const struct VdlResolveCacheHeader *header,
+		    const struct VdlResolveCacheId *ids)
+{
+  const char *basename = file->filename;
+  const char *cur;
+  for (cur = file->filename; *cur != 0; cur++)
+    {
+      if (*cur == '/')
+	{
+	  basename = cur + 1;
+	}
+    }
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = resolve_cache_hash (hash, &header->flags, sizeof (header->flags));
+  hash = resolve_cache_hash (hash, &header->lookup_type, sizeof (header->lookup_type));
+  hash = resolve_cache_hash (hash, &header->symbol_remaps_signature, 
+			     sizeof (header->symbol_remaps_signature));
+  hash = resolve_cache_hash (hash, &header->first_size, sizeof (header->first_size));
+  hash = resolve_cache_hash (hash, ids, sizeof (*ids) * header->scope_size);
+  return vdl_utils_sprintf ("%s/%s-%lx-%08x%08x.resolve", g_vdl.resolve_cache,
+			    basename, (unsigned long)header->self.ino,
+			    (uint32_t)(hash >> 32), (uint32_t)hash);
+}
+
+// A cache file which matches the identity of the files of the scope
+// can still be truncated or corrupted: check that every entry can be
+// replayed without reading out of the scope or out of a symbol table.
+static bool
+resolve_cache_entries_valid (const struct VdlRelocPlanEntry *entries,
+			     uint32_t n_entries,
+			     struct VdlFile **scope,
+			     uint32_t scope_size)
+{
+  // the symbol count of each file of the scope, computed on demand.
+  unsigned long *n_symbols = vdl_alloc_malloc (sizeof (unsigned long) * (scope_size + 1));
+  vdl_memset (n_symbols, 0xff, sizeof (unsigned long) * scope_size);
+  bool valid = true;
+  uint32_t i;
+  for (i = 0; valid && i < n_entries; i++)
+    {
+      uint32_t position = entries[i].position;
+      if (position == VDL_RELOC_PLAN_NOT_FOUND)
+	{
+	  continue;
+	}
+      if (position >= scope_size)
+	{
+	  valid = false;
+	  break;
+	}
+      if (n_symbols[position] == ~0UL)
+	{
+	  n_symbols[position] = vdl_lookup_symbol_count (scope[position]);
+	}
+      valid = entries[i].symbol < n_symbols[position];
+    }
+  vdl_alloc_free (n_symbols);
+  return valid;
+}
+
+static uint32_t
+resolve_cache_flags (void)
+{
+  return g_vdl.direct_bind ? VDL_RESOLVE_CACHE_DIRECT_BIND : 0;
+}
+
+struct VdlRelocPlan *
+vdl_resolve_cache_load (struct VdlFile *file,
+			struct VdlFile **scope,
+			uint32_t scope_size,
+			uint32_t first_size)
+{
+  // the header we expect to find.
+  struct VdlResolveCacheHeader expected;
+  vdl_memset (&expected, 0, sizeof (expected));
+  if (!resolve_cache_id (file, &expected.self))
+    {
+      return 0;
+    }
+  struct VdlResolveCacheId *scope_ids = resolve_cache_scope_ids (scope, scope_size);
+  if (scope_ids == 0)
+    {
+      return 0;
+    }
+  expected.magic = VDL_RESOLVE_CACHE_MAGIC;
+  expected.flags = resolve_cache_flags ();
+  expected.lookup_type = file->lookup_type;
+  expected.symbol_remaps_signature = file->context->symbol_remaps_signature;
+  expected.scope_size = scope_size;
+  expected.first_size = first_size;
+  char *path = resolve_cache_path (file, &expected, scope_ids);
+  VDL_LOG_FUNCTION ("path=%s", path);
+  struct stat st_buf;
+  void *mapping = MAP_FAILED;
+  unsigned long size = 0;
+  if (system_fstat (path, &st_buf) != -1 &&
+      st_buf.st_size >= sizeof (struct VdlResolveCacheHeader))
+    {
+      int fd = system_open_ro (path);
+      if (fd != -1)
+	{
+	  size = st_buf.st_size;
+	  mapping = system_mmap (0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	  system_close (fd);
+	}
+    }
+  if (mapping == MAP_FAILED)
+    {
+      vdl_alloc_free (scope_ids);
+      vdl_alloc_free (path);
+      return 0;
+    }
+  const struct VdlResolveCacheHeader *header = mapping;
+  const struct VdlResolveCacheId *ids = (const struct VdlResolveCacheId *)(header + 1);
+  const struct VdlRelocPlanEntry *entries = (const struct VdlRelocPlanEntry *)(ids + scope_size);
+  bool valid =
+    header->magic == expected.magic &&
+    header->flags == expected.flags &&
+    header->lookup_type == expected.lookup_type &&
+    header->symbol_remaps_signature == expected.symbol_remaps_signature &&
+    header->scope_size == expected.scope_size &&
+    header->first_size == expected.first_size &&
+    size == sizeof (*header) + sizeof (*ids) * scope_size +
+    sizeof (*entries) * (unsigned long)header->n_entries &&
+    resolve_cache_id_equal (&header->self, &expected.self);
+  uint32_t i;
+  for (i = 0; valid && i < scope_size; i++)
+    {
+      valid = resolve_cache_id_equal (&ids[i], &scope_ids[i]);
+    }
+  valid = valid && resolve_cache_entries_valid (entries, header->n_entries,
+						 scope, scope_size);
+  vdl_alloc_free (scope_ids);
+  if (!valid)
+    {
+      // a stale cache file: it will be overwritten by the
+      // plan we are going to record.
+      VDL_LOG_DEBUG ("ignore resolve cache %s\n", path);
+      system_munmap (mapping, size);
+      vdl_alloc_free (path);
+      return 0;
+    }
+  VDL_LOG_STATS ("resolve-cache path=%s load entries=%u\n", path, header->n_entries);
+  vdl_alloc_free (path);
+
+  struct VdlRelocPlan *plan = vdl_alloc_new (struct VdlRelocPlan);
+  plan->scope_size = scope_size;
+  plan->first_size = first_size;
+  plan->scope = vdl_alloc_malloc (sizeof (unsigned long) * (scope_size + 1));
+  for (i = 0; i < scope_size; i++)
+    {
+      plan->scope[i] = scope[i]->image->serial;
+    }
+  plan->lookup_type = file->lookup_type;
+  plan->symbol_remaps_signature = file->context->symbol_remaps_signature;
+  plan->entries = (struct VdlRelocPlanEntry *)entries;
+  plan->n_entries = header->n_entries;
+  plan->mapping = mapping;
+  plan->mapping_size = size;
+  return plan;
+}
+
+void
+vdl_resolve_cache_save (struct VdlFile *file,
+			struct VdlFile **scope,
+			const struct VdlRelocPlan *plan)
+{
+  struct VdlResolveCacheHeader header;
+  vdl_memset (&header, 0, sizeof (header));
+  if (!resolve_cache_id (file, &header.self))
+    {
+      return;
+    }
+  struct VdlResolveCacheId *ids = resolve_cache_scope_ids (scope, plan->scope_size);
+  if (ids == 0)
+    {
+      return;
+    }
+  header.magic = VDL_RESOLVE_CACHE_MAGIC;
+  header.flags = resolve_cache_flags ();
+  header.lookup_type = plan->lookup_type;
+  header.symbol_remaps_signature = plan->symbol_remaps_signature;
+  header.scope_size = plan->scope_size;
+  header.first_size = plan->first_size;
+  header.n_entries = plan->n_entries;
+  char *path = resolve_cache_path (file, &header, ids);
+  VDL_LOG_FUNCTION ("path=%s", path);
+  // Other processes might map the cache file while we write it so,
+  // we write a new file next to it and rename it over the old one.
+  char *tmp = vdl_utils_sprintf ("%s.%d.tmp", path, system_getpid ());
+  int fd = system_open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd != -1;
+  if (ok)
+    {
+      ok = vdl_utils_write_all (fd, &header, sizeof (header)) &&
+	vdl_utils_write_all (fd, ids, sizeof (*ids) * plan->scope_size) &&
+	vdl_utils_write_all (fd, plan->entries,
+			     sizeof (struct VdlRelocPlanEntry) * plan->n_entries);
+      system_close (fd);
+      ok = ok && system_rename (tmp, path) != -1;
+      if (!ok)
+	{
+	  system_unlink (tmp);
+	}
+    }
+  if (ok)
+    {
+      VDL_LOG_STATS ("resolve-cache path=%s save entries=%u\n", path, plan->n_entries);
+    }
+  else
+    {
+      VDL_LOG_ERROR ("Could not write resolve cache %s\n", path);
+    }
+  vdl_alloc_free (tmp);
+  vdl_alloc_free (ids);
+  vdl_alloc_free (path);
+}
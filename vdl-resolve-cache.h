@@ -0,0 +1,37 @@
+#ifndef VDL_RESOLVE_CACHE_H
+#define VDL_RESOLVE_CACHE_H
+
+#include <stdint.h>
+
+struct VdlFile;
+struct VdlRelocPlan;
+
+/* When LD_RESOLVE_CACHE is set to a directory, the relocation plan
+ * recorded for each file (see vdl-reloc.h) is saved there, along
+ * with the identity (st_dev, st_ino, size, mtime and build id) of
+ * the file and of each file of its lookup scope. The next processes
+ * which relocate the same file in a scope made of the same files map
+ * the saved plan and replay it instead of looking up the symbols.
+ * A plan is ignored as soon as any of these files changed or if one
+ * of its entries points out of the scope or out of a symbol table.
+ * Each file gets one plan per lookup scope: the name of a plan
+ * carries a hash of the identities of the scope, of the lookup
+ * type, of the symbol remaps and of the flags it was recorded with.
+ * Plans are written to a temporary file which is renamed over the
+ * old one so, readers never see a partial file.
+ * vdl-prelink fills the cache for a program without running it.
+ */
+
+// return a plan for the relocation of file within the scope, 
+// made of scope_size files, the first_size first of which belong to 
+// the first lookup scope, or zero if there is no valid plan on disk.
+struct VdlRelocPlan *vdl_resolve_cache_load (struct VdlFile *file,
+					     struct VdlFile **scope,
+					     uint32_t scope_size,
+					     uint32_t first_size);
+// save a plan recorded during the relocation of file within scope.
+void vdl_resolve_cache_save (struct VdlFile *file,
+			     struct VdlFile **scope,
+			     const struct VdlRelocPlan *plan);
+
+#endif /* VDL_RESOLVE_CACHE_H */
@@ -0,0 +1,44 @@
+#include "vdl-thread.h"
+#include "vdl.h"
+#include "vdl-tls.h"
+#include "glibc.h"
+#include "machine.h"
+#include "system.h"
+#include <sys/mman.h>
+
+#define VDL_THREAD_STACK_SIZE (64*1024)
+
+bool
+vdl_thread_create (void (*fn) (void *), void *arg)
+{
+  void *stack = system_mmap (0, VDL_THREAD_STACK_SIZE, 
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (stack == MAP_FAILED)
+    {
+      return false;
+    }
+  // The thread runs only our code but it calls the IFUNC resolvers
+  // of the binaries so, it gets its own tls area.
+  unsigned long tcb = vdl_tls_tcb_allocate ();
+  vdl_tls_tcb_initialize (tcb, vdl_tls_tcb_get_sysinfo (machine_thread_pointer_get ()));
+  vdl_tls_dtv_allocate (tcb);
+  vdl_tls_dtv_initialize (tcb);
+  // The signal handlers of the application expect to run in
+  // one of its threads: block all signals in the new thread.
+  uint64_t all = ~0ULL;
+  uint64_t old;
+  system_sigprocmask (&all, &old);
+  int status = machine_thread_create ((unsigned long)stack + VDL_THREAD_STACK_SIZE,
+				      tcb, fn, arg);
+  system_sigprocmask (&old, 0);
+  if (status == -1)
+    {
+      vdl_tls_dtv_deallocate (tcb);
+      vdl_tls_tcb_deallocate (tcb);
+      system_munmap ((uint8_t *)stack, VDL_THREAD_STACK_SIZE);
+      return false;
+    }
+  glibc_fork_handlers_enable ();
+  return true;
+}
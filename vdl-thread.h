@@ -0,0 +1,12 @@
+#ifndef VDL_THREAD_H
+#define VDL_THREAD_H
+
+#include <stdbool.h>
+
+// start a thread owned by the loader which runs fn(arg) with
+// all signals blocked, on its own stack and with its own tls
+// area. Returns false if the thread could not be created.
+// The caller must hold g_vdl.futex.
+bool vdl_thread_create (void (*fn) (void *), void *arg);
+
+#endif /* VDL_THREAD_H */
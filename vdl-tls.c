@@ -12,6 +12,115 @@
 #include "vdl-file.h"
 
 #define TLS_EXTRA_STATIC_ALLOC 1000
+// the number of generation changes remembered in g_vdl.tls_changes.
+#define TLS_CHANGES_SIZE 256
+
+// Module indexes are recycled to keep the dtv of each thread small
+// when files with tls blocks are loaded and unloaded repeatedly.
+// A dtv entry left over by the previous owner of an index is
+// detected by vdl_tls_dtv_update because its generation does not
+// match the tls_tmpl_gen of the new owner.
+static unsigned long
+module_index_allocate (void)
+{
+  if (g_vdl.tls_n_free_indexes == 0)
+    {
+      g_vdl.tls_next_index++;
+      g_vdl.tls_n_dtv = g_vdl.tls_next_index - 1;
+      return g_vdl.tls_n_dtv;
+    }
+  // reuse the smallest retired index.
+  unsigned long *free = g_vdl.tls_free_indexes;
+  unsigned long i, min = 0;
+  for (i = 1; i < g_vdl.tls_n_free_indexes; i++)
+    {
+      if (free[i] < free[min])
+	{
+	  min = i;
+	}
+    }
+  unsigned long index = free[min];
+  g_vdl.tls_n_free_indexes--;
+  free[min] = free[g_vdl.tls_n_free_indexes];
+  return index;
+}
+
+static void
+module_index_free (unsigned long index)
+{
+  if (index + 1 == g_vdl.tls_next_index)
+    {
+      // this is the highest index in use so, instead of
+      // retiring it, we shrink the range of indexes in use,
+      // along with the retired indexes at the top of it.
+      g_vdl.tls_next_index--;
+      unsigned long *free = g_vdl.tls_free_indexes;
+      unsigned long i = 0;
+      while (i < g_vdl.tls_n_free_indexes)
+	{
+	  if (free[i] + 1 == g_vdl.tls_next_index)
+	    {
+	      g_vdl.tls_next_index--;
+	      g_vdl.tls_n_free_indexes--;
+	      free[i] = free[g_vdl.tls_n_free_indexes];
+	      i = 0;
+	    }
+	  else
+	    {
+	      i++;
+	    }
+	}
+      g_vdl.tls_n_dtv = g_vdl.tls_next_index - 1;
+      return;
+    }
+  if (g_vdl.tls_n_free_indexes == g_vdl.tls_free_indexes_size)
+    {
+      unsigned long new_size = g_vdl.tls_free_indexes_size * 2 + 4;
+      unsigned long *new_free = vdl_alloc_malloc (sizeof (unsigned long) * new_size);
+      vdl_memcpy (new_free, g_vdl.tls_free_indexes,
+		  sizeof (unsigned long) * g_vdl.tls_n_free_indexes);
+      vdl_alloc_free (g_vdl.tls_free_indexes);
+      g_vdl.tls_free_indexes = new_free;
+      g_vdl.tls_free_indexes_size = new_size;
+    }
+  g_vdl.tls_free_indexes[g_vdl.tls_n_free_indexes] = index;
+  g_vdl.tls_n_free_indexes++;
+}
+
+// Each change of g_vdl.tls_gen records the index of the module
+// which changed so that vdl_tls_dtv_update can look only at these
+// entries of a dtv which is not too far behind.
+static void
+generation_increment (unsigned long module)
+{
+  if (g_vdl.tls_changes == 0)
+    {
+      g_vdl.tls_changes = vdl_alloc_malloc (sizeof (unsigned long) * TLS_CHANGES_SIZE);
+    }
+  g_vdl.tls_changes[g_vdl.tls_gen % TLS_CHANGES_SIZE] = module;
+  g_vdl.tls_gen++;
+}
+
+static void
+module_register (struct VdlFile *file)
+{
+  if (file->tls_index >= g_vdl.tls_modules_size)
+    {
+      unsigned long new_size = g_vdl.tls_modules_size * 2;
+      if (new_size <= file->tls_index)
+	{
+	  new_size = file->tls_index + 16;
+	}
+      struct VdlFile **new_modules = vdl_alloc_malloc (sizeof (struct VdlFile *) * new_size);
+      vdl_memset (new_modules, 0, sizeof (struct VdlFile *) * new_size);
+      vdl_memcpy (new_modules, g_vdl.tls_modules,
+		  sizeof (struct VdlFile *) * g_vdl.tls_modules_size);
+      vdl_alloc_free (g_vdl.tls_modules);
+      g_vdl.tls_modules = new_modules;
+      g_vdl.tls_modules_size = new_size;
+    }
+  g_vdl.tls_modules[file->tls_index] = file;
+}
 
 static void
 file_initialize (struct VdlFile *file)
@@ -36,17 +145,11 @@ file_initialize (struct VdlFile *file)
   file->tls_tmpl_size = pt_tls->p_filesz;
   file->tls_init_zero_size = pt_tls->p_memsz - pt_tls->p_filesz;
   file->tls_align = pt_tls->p_align;
-  file->tls_index = g_vdl.tls_next_index;
+  file->tls_index = module_index_allocate ();
   file->tls_is_static = (dt_flags & DF_STATIC_TLS)?1:0;
   file->tls_tmpl_gen = g_vdl.tls_gen;
-  // XXX: the next_index increment code below is bad for many reasons.
-  // Instead, we should try to reuse tls indexes that are not used anymore
-  // to ensure that the tls index we use is as small as possible to ensure
-  // that the dtv array is as small as possible. we should keep
-  // track of all allocated indexes in a global list.
-  g_vdl.tls_next_index++;
-  g_vdl.tls_gen++;
-  g_vdl.tls_n_dtv++;
+  module_register (file);
+  generation_increment (file->tls_index);
   VDL_LOG_DEBUG ("file=%s tmpl_size=%lu zero_size=%lu\n", 
 		 file->name, file->tls_tmpl_size, 
 		 file->tls_init_zero_size);
@@ -149,8 +252,9 @@ file_deinitialize (struct VdlFile *file)
 
   if (file->has_tls)
     {
-      g_vdl.tls_gen++;
-      g_vdl.tls_n_dtv--;
+      g_vdl.tls_modules[file->tls_index] = 0;
+      generation_increment (file->tls_index);
+      module_index_free (file->tls_index);
     }
 }
 
@@ -202,6 +306,14 @@ vdl_tls_tcb_initialize (unsigned long tcb, unsigned long sysinfo)
   vdl_memcpy ((void*)(tcb+CONFIG_TCB_SYSINFO_OFFSET), &sysinfo, sizeof (sysinfo));
 }
 
+unsigned long
+vdl_tls_tcb_get_sysinfo (unsigned long tcb)
+{
+  unsigned long sysinfo;
+  vdl_memcpy (&sysinfo, (void*)(tcb+CONFIG_TCB_SYSINFO_OFFSET), sizeof (sysinfo));
+  return sysinfo;
+}
+
 // This dtv structure needs to be compatible with the one used by the 
 // glibc loader. Although it's supposed to be opaque to the glibc or 
 // libpthread, it's not. nptl_db reads it to lookup tls variables (it
@@ -210,6 +322,8 @@ vdl_tls_tcb_initialize (unsigned long tcb, unsigned long sysinfo)
 // of the dtv array and be able to memset it to zeros.
 // The only leeway we have is in the glibc static field which we reuse
 // to store a per-dtvi generation counter.
+// The resolv.S files (__tls_get_addr, machine_tlsdesc_dynamic)
+// depend on this layout.
 struct dtv_t
 {
   unsigned long value;
@@ -217,67 +331,248 @@ struct dtv_t
   unsigned long gen : (sizeof(unsigned long) * 8 - 1);
 };
 
-void
-vdl_tls_dtv_allocate (unsigned long tcb)
+static void
+dtv_allocate (unsigned long tcb, unsigned long size)
 {
-  VDL_LOG_FUNCTION ("tcb=%lu", tcb);
-  // allocate a dtv for the set of tls blocks needed now
-  struct dtv_t *dtv = vdl_alloc_malloc ((2+g_vdl.tls_n_dtv) * sizeof (struct dtv_t));
-  dtv[0].value = g_vdl.tls_n_dtv;
-  dtv[0].gen = 0;
+  VDL_LOG_FUNCTION ("tcb=%lu, size=%lu", tcb, size);
+  // dtv[-1].value is the number of entries, excluding dtv[-1] and
+  // dtv[0]. All entries start unallocated.
+  struct dtv_t *dtv = vdl_alloc_malloc ((2+size) * sizeof (struct dtv_t));
+  vdl_memset (dtv, 0, (2+size) * sizeof (struct dtv_t));
+  dtv[0].value = size;
   dtv++;
-  dtv[0].value = 0;
   dtv[0].gen = g_vdl.tls_gen;
   vdl_memcpy ((void*)(tcb+CONFIG_TCB_DTV_OFFSET), &dtv, sizeof (dtv));
 }
 
 void
-vdl_tls_dtv_initialize (unsigned long tcb)
+vdl_tls_dtv_allocate (unsigned long tcb)
 {
-  VDL_LOG_FUNCTION ("tcb=%lu", tcb);
+  dtv_allocate (tcb, g_vdl.tls_n_dtv);
+}
+
+static struct VdlFile *
+find_file_by_module (unsigned long module)
+{
+  if (module >= g_vdl.tls_modules_size)
+    {
+      return 0;
+    }
+  return g_vdl.tls_modules[module];
+}
+
+// The initial content of the static tls area and of the dtv of a
+// new thread. It is rebuilt under g_vdl.futex when g_vdl.tls_gen
+// changes and copied without the lock by vdl_tls_dtv_initialize_fast
+// which uses seq to detect a concurrent rebuild.
+struct VdlTlsImage
+{
+  // odd while the image is rebuilt.
+  uint32_t seq;
+  // the value of g_vdl.tls_gen the image was built for.
+  unsigned long gen;
+  // the content of [tcb-static_size,tcb). Its capacity is
+  // g_vdl.tls_static_total_size which does not change.
+  uint8_t *static_image;
+  unsigned long static_size;
+  // dtv[0] to dtv[n_dtv]. The value of the static entries is the
+  // offset of their block from the tcb.
   struct dtv_t *dtv;
-  vdl_memcpy (&dtv, (void*)(tcb+CONFIG_TCB_DTV_OFFSET), sizeof (dtv));
-  // allocate a dtv for the set of tls blocks needed now
+  unsigned long n_dtv;
+  unsigned long dtv_size;
+  // the dtv arrays replaced by a bigger one: a concurrent reader
+  // might still be copying them so, they are freed only by
+  // vdl_tls_image_delete.
+  struct VdlList *retired;
+};
 
-  struct VdlFile *cur;
-  for (cur = g_vdl.link_map; cur != 0; cur = cur->next)
+static struct VdlTlsImage *
+tls_image_update (void)
+{
+  struct VdlTlsImage *image = g_vdl.tls_image;
+  if (image == 0)
+    {
+      image = vdl_alloc_new (struct VdlTlsImage);
+      image->seq = 0;
+      image->gen = 0;
+      image->static_image = vdl_alloc_malloc (g_vdl.tls_static_total_size);
+      image->static_size = 0;
+      image->dtv = 0;
+      image->n_dtv = 0;
+      image->dtv_size = 0;
+      image->retired = vdl_list_new ();
+      g_vdl.tls_image = image;
+    }
+  if (image->gen == g_vdl.tls_gen)
+    {
+      return image;
+    }
+  VDL_LOG_FUNCTION ("gen=%lu", g_vdl.tls_gen);
+  image->seq++;
+  machine_memory_barrier ();
+  if (g_vdl.tls_n_dtv + 1 > image->dtv_size)
     {
-      if (cur->has_tls)
+      unsigned long size = image->dtv_size * 2;
+      if (size < g_vdl.tls_n_dtv + 1)
 	{
-	  // setup the dtv to point to the tls block
-	  if (cur->tls_is_static)
-	    {
-	      signed long dtvi = tcb + cur->tls_offset;
-	      dtv[cur->tls_index].value = dtvi;
-	      dtv[cur->tls_index].is_static = 1;
-	      // copy the template in the module tls block
-	      vdl_memcpy ((void*)dtvi, (void*)cur->tls_tmpl_start, cur->tls_tmpl_size);
-	      vdl_memset ((void*)(dtvi + cur->tls_tmpl_size), 0, cur->tls_init_zero_size);
-	    }
-	  else
-	    {
-	      dtv[cur->tls_index].value = 0; // unallocated
-	      dtv[cur->tls_index].is_static = 0;
-	    }
-	  dtv[cur->tls_index].gen = cur->tls_tmpl_gen;
+	  size = g_vdl.tls_n_dtv + 1;
 	}
+      if (image->dtv != 0)
+	{
+	  vdl_list_push_back (image->retired, image->dtv);
+	}
+      image->dtv = vdl_alloc_malloc (size * sizeof (struct dtv_t));
+      image->dtv_size = size;
     }
-  // initialize its generation counter
-  dtv[0].gen = g_vdl.tls_gen;
+  image->static_size = g_vdl.tls_static_current_size;
+  image->n_dtv = g_vdl.tls_n_dtv;
+  uint8_t *tcb = image->static_image + image->static_size;
+  vdl_memset (image->static_image, 0, image->static_size);
+  vdl_memset (image->dtv, 0, (image->n_dtv + 1) * sizeof (struct dtv_t));
+  unsigned long module;
+  for (module = 1; module <= image->n_dtv; module++)
+    {
+      struct VdlFile *file = find_file_by_module (module);
+      if (file == 0)
+	{
+	  continue;
+	}
+      if (file->tls_is_static)
+	{
+	  // the zero-initialized part of the block is already zero.
+	  image->dtv[module].value = file->tls_offset;
+	  image->dtv[module].is_static = 1;
+	  vdl_memcpy (tcb + file->tls_offset, (void*)file->tls_tmpl_start,
+		      file->tls_tmpl_size);
+	}
+      image->dtv[module].gen = file->tls_tmpl_gen;
+    }
+  image->dtv[0].gen = g_vdl.tls_gen;
+  image->gen = g_vdl.tls_gen;
+  machine_memory_barrier ();
+  image->seq++;
+  return image;
 }
 
-static struct VdlFile *
-find_file_by_module (unsigned long module)
+// the fields of a VdlTlsImage which are needed to initialize a
+// thread, read once so that a concurrent rebuild cannot change
+// them while we use them.
+struct VdlTlsImageSnapshot
 {
-  struct VdlFile *cur;
-  for (cur = g_vdl.link_map; cur != 0; cur = cur->next)
+  const uint8_t *static_image;
+  unsigned long static_size;
+  const struct dtv_t *dtv;
+  unsigned long n_dtv;
+};
+
+static struct VdlTlsImageSnapshot
+tls_image_snapshot (const struct VdlTlsImage *image)
+{
+  struct VdlTlsImageSnapshot snapshot;
+  snapshot.static_image = image->static_image;
+  snapshot.static_size = image->static_size;
+  snapshot.dtv = image->dtv;
+  snapshot.n_dtv = image->n_dtv;
+  return snapshot;
+}
+
+// dtv must have room for snapshot->n_dtv entries.
+static void
+tls_image_copy (const struct VdlTlsImageSnapshot *snapshot,
+		struct dtv_t *dtv, unsigned long tcb)
+{
+  unsigned long dtv_size = dtv[-1].value;
+  vdl_memcpy ((void*)(tcb - snapshot->static_size), snapshot->static_image,
+	      snapshot->static_size);
+  vdl_memcpy (dtv, snapshot->dtv, (snapshot->n_dtv + 1) * sizeof (struct dtv_t));
+  vdl_memset (&dtv[snapshot->n_dtv + 1], 0,
+	      (dtv_size - snapshot->n_dtv) * sizeof (struct dtv_t));
+  unsigned long module;
+  for (module = 1; module <= snapshot->n_dtv; module++)
     {
-      if (cur->has_tls && cur->tls_index == module)
+      if (dtv[module].is_static)
 	{
-	  return cur;
+	  dtv[module].value += tcb;
 	}
     }
-  return 0;
+}
+
+void
+vdl_tls_dtv_initialize (unsigned long tcb)
+{
+  VDL_LOG_FUNCTION ("tcb=%lu", tcb);
+  struct VdlTlsImage *image = tls_image_update ();
+  struct VdlTlsImageSnapshot snapshot = tls_image_snapshot (image);
+  struct dtv_t *dtv;
+  vdl_memcpy (&dtv, (void*)(tcb+CONFIG_TCB_DTV_OFFSET), sizeof (dtv));
+  if (dtv[-1].value < snapshot.n_dtv)
+    {
+      // this dtv was allocated before the last dlopen.
+      vdl_alloc_free (&dtv[-1]);
+      dtv_allocate (tcb, snapshot.n_dtv);
+      vdl_memcpy (&dtv, (void*)(tcb+CONFIG_TCB_DTV_OFFSET), sizeof (dtv));
+    }
+  tls_image_copy (&snapshot, dtv, tcb);
+}
+
+bool
+vdl_tls_dtv_initialize_fast (unsigned long tcb)
+{
+  struct VdlTlsImage *image = g_vdl.tls_image;
+  if (image == 0)
+    {
+      return false;
+    }
+  uint32_t seq = image->seq;
+  machine_memory_barrier ();
+  if (seq & 1)
+    {
+      return false;
+    }
+  unsigned long gen = image->gen;
+  struct VdlTlsImageSnapshot snapshot = tls_image_snapshot (image);
+  machine_memory_barrier ();
+  if (image->seq != seq || gen != g_vdl.tls_gen)
+    {
+      return false;
+    }
+  // the snapshot is consistent and stays usable even if the image
+  // is rebuilt now: static_image never moves and the dtv arrays
+  // are never freed while the process runs. A rebuild only makes
+  // the content we copy stale, which the last check below detects.
+  struct dtv_t *dtv;
+  vdl_memcpy (&dtv, (void*)(tcb+CONFIG_TCB_DTV_OFFSET), sizeof (dtv));
+  if (dtv[-1].value < snapshot.n_dtv)
+    {
+      return false;
+    }
+  tls_image_copy (&snapshot, dtv, tcb);
+  machine_memory_barrier ();
+  // if the image was rebuilt while we copied it, the caller
+  // takes the lock and starts again.
+  return image->seq == seq;
+}
+
+void
+vdl_tls_image_delete (void)
+{
+  struct VdlTlsImage *image = g_vdl.tls_image;
+  if (image == 0)
+    {
+      return;
+    }
+  void **i;
+  for (i = vdl_list_begin (image->retired);
+       i != vdl_list_end (image->retired);
+       i = vdl_list_next (i))
+    {
+      vdl_alloc_free (*i);
+    }
+  vdl_list_delete (image->retired);
+  vdl_alloc_free (image->dtv);
+  vdl_alloc_free (image->static_image);
+  vdl_alloc_delete (image);
+  g_vdl.tls_image = 0;
 }
 
 void
@@ -326,6 +621,44 @@ get_current_dtv (void)
   vdl_memcpy (&dtv, (void*)(tp+CONFIG_TCB_DTV_OFFSET), sizeof (dtv));
   return dtv;
 }
+// point the dtv entry of a module in the static tls block to its
+// block in the thread tp and initialize the block.
+static void
+dtv_static_initialize (struct dtv_t *dtv, struct VdlFile *file, unsigned long tp)
+{
+  signed long dtvi = tp + file->tls_offset;
+  dtv[file->tls_index].value = dtvi;
+  dtv[file->tls_index].is_static = 1;
+  dtv[file->tls_index].gen = file->tls_tmpl_gen;
+  // copy the template in the module tls block
+  vdl_memcpy ((void*)dtvi, (void*)file->tls_tmpl_start, file->tls_tmpl_size);
+  vdl_memset ((void*)(dtvi + file->tls_tmpl_size), 0, file->tls_init_zero_size);
+}
+static void
+dtv_entry_update (struct dtv_t *dtv, unsigned long module, unsigned long tp)
+{
+  struct VdlFile *file = find_file_by_module (module);
+  if (file != 0 && dtv[module].gen == file->tls_tmpl_gen)
+    {
+      // the entry is uptodate.
+      return;
+    }
+  // module was unloaded or its index was recycled
+  if (dtv[module].value != 0 && !dtv[module].is_static)
+    {
+      // and it was not static so, we free its memory
+      unsigned long *dtvi = (unsigned long *)dtv[module].value;
+      vdl_alloc_free (&dtvi[-1]);
+    }
+  // we clear it so that it is initialized later if needed
+  dtv[module].value = 0;
+  dtv[module].gen = 0;
+  dtv[module].is_static = 0;
+  if (file != 0 && file->tls_is_static)
+    {
+      dtv_static_initialize (dtv, file, tp);
+    }
+}
 void
 vdl_tls_dtv_update (void)
 {
@@ -339,41 +672,28 @@ vdl_tls_dtv_update (void)
     }
 
   // first, we update the currently-available entries of the dtv.
-  {
-      unsigned long module;
-      for (module = 1; module <= dtv_size; module++)
+  if (g_vdl.tls_gen - dtv[0].gen <= TLS_CHANGES_SIZE)
+    {
+      // only the entries of the modules which changed since
+      // the last update.
+      unsigned long gen;
+      for (gen = dtv[0].gen; gen != g_vdl.tls_gen; gen++)
 	{
-	  if (dtv[module].value == 0)
-	    {
-	      // this is an un-initialized entry so, we leave it alone
-	      continue;
-	    }
-	  struct VdlFile *file = find_file_by_module (module);
-	  if (file != 0 && dtv[module].gen == file->tls_tmpl_gen)
-	    {
-	      // the entry is uptodate.
-	      continue;
-	    }
-	  // module was unloaded
-	  if (!dtv[module].is_static)
-	    {
-	      // and it was not static so, we free its memory
-	      unsigned long *dtvi = (unsigned long *)dtv[module].value;
-	      vdl_alloc_free (&dtvi[-1]);
-	      dtv[module].value = 0;
-	    }
-	  if (file == 0)
+	  unsigned long module = g_vdl.tls_changes[gen % TLS_CHANGES_SIZE];
+	  if (module <= dtv_size)
 	    {
-	      // no new module was loaded so, we are good.
-	      continue;
+	      dtv_entry_update (dtv, module, tp);
 	    }
-	  // we have a new module loaded
-	  // we clear it so that it is initialized later if needed
-	  dtv[module].value = 0;
-	  dtv[module].gen = 0;
-	  dtv[module].is_static = 0;
 	}
-  }
+    }
+  else
+    {
+      unsigned long module;
+      for (module = 1; module <= dtv_size; module++)
+	{
+	  dtv_entry_update (dtv, module, tp);
+	}
+    }
 
   // now, check the size of the new dtv
   if (g_vdl.tls_n_dtv <= dtv_size)
@@ -385,8 +705,15 @@ vdl_tls_dtv_update (void)
     }
 
   // the size of the new dtv is bigger than the 
-  // current dtv. We need a newly-sized dtv
-  vdl_tls_dtv_allocate (tp);
+  // current dtv. We need a newly-sized dtv: its size is at least
+  // doubled so that a thread whose dtv keeps growing reallocates
+  // it only a logarithmic number of times.
+  unsigned long size = dtv_size * 2;
+  if (size < g_vdl.tls_n_dtv)
+    {
+      size = g_vdl.tls_n_dtv;
+    }
+  dtv_allocate (tp, size);
   struct dtv_t *new_dtv = get_current_dtv ();
   unsigned long new_dtv_size = new_dtv[-1].value;
   unsigned long module;
@@ -411,14 +738,7 @@ vdl_tls_dtv_update (void)
 	}
       if (file->tls_is_static)
 	{
-	  signed long tcb = machine_thread_pointer_get ();
-	  signed long dtvi = tcb + file->tls_offset;
-	  new_dtv[file->tls_index].value = dtvi;
-	  new_dtv[file->tls_index].is_static = 1;
-	  new_dtv[file->tls_index].gen = file->tls_tmpl_gen;
-	  // copy the template in the module tls block
-	  vdl_memcpy ((void*)dtvi, (void*)file->tls_tmpl_start, file->tls_tmpl_size);
-	  vdl_memset ((void*)(dtvi + file->tls_tmpl_size), 0, file->tls_init_zero_size);
+	  dtv_static_initialize (new_dtv, file, tp);
 	}
     }
   // now that the dtv is updated, update the generation
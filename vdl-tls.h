@@ -11,6 +11,8 @@ void vdl_tls_file_initialize_main (struct VdlList *list);
 unsigned long vdl_tls_tcb_allocate (void);
 // setup the sysinfo field in tcb
 void vdl_tls_tcb_initialize (unsigned long tcb, unsigned long sysinfo);
+// return the sysinfo field of tcb
+unsigned long vdl_tls_tcb_get_sysinfo (unsigned long tcb);
 // allocate a dtv vector and set it in the tcb
 void vdl_tls_dtv_allocate (unsigned long tcb);
 // The job of this function is to:
@@ -20,6 +22,12 @@ void vdl_tls_dtv_allocate (unsigned long tcb);
 //      template
 //    - initialize the dtv generation counter
 void vdl_tls_dtv_initialize (unsigned long tcb);
+// same as vdl_tls_dtv_initialize but does not need the lock held:
+// copies the image of the static tls area and of the dtv built by
+// the last call to vdl_tls_dtv_initialize. Returns false if the
+// image is out of date, in which case vdl_tls_dtv_initialize must
+// be called.
+bool vdl_tls_dtv_initialize_fast (unsigned long tcb);
 // initialize per-file tls information
 bool vdl_tls_file_initialize (struct VdlList *files);
 void vdl_tls_dtv_deallocate (unsigned long tcb);
@@ -33,5 +41,7 @@ unsigned long vdl_tls_get_addr_slow (unsigned long module, unsigned long offset)
 void vdl_tls_dtv_update (void);
 
 void vdl_tls_file_deinitialize (struct VdlList *files);
+// release the image used by vdl_tls_dtv_initialize_fast.
+void vdl_tls_image_delete (void);
 
 #endif /* VDL_TLS_H */
@@ -0,0 +1,709 @@
+#include "vdl-uffd.h"
+#include "vdl.h"
+#include "vdl-file.h"
+#include "vdl-image.h"
+#include "vdl-reloc.h"
+#include "vdl-list.h"
+#include "vdl-log.h"
+#include "vdl-utils.h"
+#include "vdl-alloc.h"
+#include "vdl-mem.h"
+#include "vdl-thread.h"
+#include "futex.h"
+#include "machine.h"
+#include "system.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ioctl.h>
+#include <linux/userfaultfd.h>
+#include <errno.h>
+
+// the entries which describe a relocation of dt_rela
+// have this bit set. The others describe one of dt_rel.
+#define VDL_UFFD_RELA 0x80000000
+
+// the file-backed pages of a writable PT_LOAD entry.
+struct VdlUffdRange
+{
+  unsigned long start;
+  uint32_t n_pages;
+  int prot;
+  // the original pages which were deferred have been moved in
+  // this area, at the same offset. zero if there is none.
+  unsigned long shadow;
+  // one entry per page: zero if the relocations which target this
+  // page are deferred and have not been applied yet.
+  uint8_t *done;
+  // the relocations which target page i are 
+  // entries[first[i]] to entries[first[i+1]-1].
+  uint32_t *first;
+  uint32_t *entries;
+};
+
+struct VdlUffdFile
+{
+  struct VdlFile *file;
+  struct VdlUffdRange *ranges;
+  uint32_t n_ranges;
+  // indexed by symbol index. An entry whose file is zero describes
+  // a symbol which was not found.
+  struct VdlRelocSymbol *symbols;
+};
+
+struct VdlUffd
+{
+  int fd;
+  // protects files and the content of each VdlUffdFile. It is never
+  // held while calling code which might touch a deferred page.
+  struct Futex futex;
+  struct VdlList *files;
+  // a page in which we relocate a copy of the original page 
+  // before handing it to the kernel.
+  unsigned long buffer;
+  uint32_t started : 1;
+  uint32_t failed : 1;
+};
+
+static struct VdlUffd g_uffd = {-1, {0}, 0, 0, 0, 0};
+
+static void
+uffd_apply (const struct VdlUffdFile *ufile, uint32_t entry, unsigned long base)
+{
+  struct VdlFile *file = ufile->file;
+  unsigned long *reloc_addr;
+  unsigned long reloc_type;
+  unsigned long reloc_addend;
+  unsigned long reloc_sym;
+  if (entry & VDL_UFFD_RELA)
+    {
+      ElfW(Rela) *rela = &file->dt_rela[entry & ~VDL_UFFD_RELA];
+      reloc_addr = (unsigned long *)(base + rela->r_offset);
+      reloc_type = ELFW_R_TYPE (rela->r_info);
+      reloc_addend = rela->r_addend;
+      reloc_sym = ELFW_R_SYM (rela->r_info);
+    }
+  else
+    {
+      ElfW(Rel) *rel = &file->dt_rel[entry];
+      reloc_addr = (unsigned long *)(base + rel->r_offset);
+      reloc_type = ELFW_R_TYPE (rel->r_info);
+      reloc_addend = *reloc_addr;
+      reloc_sym = ELFW_R_SYM (rel->r_info);
+    }
+  const struct VdlRelocSymbol *symbol = &ufile->symbols[reloc_sym];
+  if (symbol->file == 0)
+    {
+      return;
+    }
+  machine_reloc (symbol->file, reloc_addr, reloc_type, reloc_addend,
+		 symbol->value, symbol->type);
+}
+
+static struct VdlUffdRange *
+uffd_find_range (const struct VdlUffdFile *ufile, unsigned long addr)
+{
+  unsigned long page_size = system_getpagesize ();
+  uint32_t i;
+  for (i = 0; i < ufile->n_ranges; i++)
+    {
+      struct VdlUffdRange *range = &ufile->ranges[i];
+      if (addr >= range->start && 
+	  addr < range->start + range->n_pages * page_size)
+	{
+	  return range;
+	}
+    }
+  return 0;
+}
+
+// apply the deferred relocations of page i of range in place.
+static void
+uffd_apply_page (const struct VdlUffdFile *ufile, struct VdlUffdRange *range, uint32_t i)
+{
+  uint32_t j;
+  for (j = range->first[i]; j < range->first[i+1]; j++)
+    {
+      uffd_apply (ufile, range->entries[j], ufile->file->load_base);
+    }
+  range->done[i] = 1;
+}
+
+// hand a relocated copy of the original content of page i of
+// range to the kernel. Returns false if the page is still missing.
+// Called with g_uffd.futex held.
+static bool
+uffd_fill (const struct VdlUffdFile *ufile, struct VdlUffdRange *range, uint32_t i)
+{
+  unsigned long page_size = system_getpagesize ();
+  unsigned long page = range->start + i * page_size;
+  vdl_memcpy ((void*)g_uffd.buffer, (void*)(range->shadow + i * page_size), 
+	      page_size);
+  unsigned long base = g_uffd.buffer - (page - ufile->file->load_base);
+  uint32_t j;
+  for (j = range->first[i]; j < range->first[i+1]; j++)
+    {
+      uffd_apply (ufile, range->entries[j], base);
+    }
+  struct uffdio_copy copy;
+  do
+    {
+      copy.dst = page;
+      copy.src = g_uffd.buffer;
+      copy.len = page_size;
+      copy.mode = 0;
+      copy.copy = 0;
+      if (system_ioctl (g_uffd.fd, UFFDIO_COPY, &copy) == 0)
+	{
+	  range->done[i] = 1;
+	  return true;
+	}
+      // the kernel stores the error in copy.copy. EAGAIN means
+      // that the layout of the address space changed under us.
+    }
+  while (copy.copy == -EAGAIN);
+  if (copy.copy == -EEXIST)
+    {
+      range->done[i] = 1;
+      return true;
+    }
+  return false;
+}
+
+// called with g_uffd.futex held.
+static void
+uffd_populate (unsigned long page)
+{
+  unsigned long page_size = system_getpagesize ();
+  void **cur;
+  for (cur = vdl_list_begin (g_uffd.files); 
+       cur != vdl_list_end (g_uffd.files); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlUffdFile *ufile = *cur;
+      struct VdlUffdRange *range = uffd_find_range (ufile, page);
+      if (range == 0)
+	{
+	  continue;
+	}
+      uint32_t i = (page - range->start) / page_size;
+      if (!range->done[i] && uffd_fill (ufile, range, i))
+	{
+	  // UFFDIO_COPY woke up the thread which touched the page.
+	  return;
+	}
+      // the page is already there or we could not fill it: make
+      // sure the thread which touched it does not wait forever.
+      // In the latter case, it faults again and we try again.
+      struct uffdio_range wake;
+      wake.start = page;
+      wake.len = page_size;
+      system_ioctl (g_uffd.fd, UFFDIO_WAKE, &wake);
+      return;
+    }
+}
+
+static void
+uffd_run (void *unused)
+{
+  while (true)
+    {
+      struct uffd_msg msg;
+      if (system_read (g_uffd.fd, &msg, sizeof (msg)) != sizeof (msg) ||
+	  msg.event != UFFD_EVENT_PAGEFAULT)
+	{
+	  continue;
+	}
+      unsigned long page = vdl_utils_align_down (msg.arg.pagefault.address, 
+						 system_getpagesize ());
+      futex_lock (&g_uffd.futex);
+      uffd_populate (page);
+      futex_unlock (&g_uffd.futex);
+    }
+}
+
+static bool
+uffd_start (void)
+{
+  if (g_uffd.started || g_uffd.failed)
+    {
+      return g_uffd.started;
+    }
+  g_uffd.failed = 1;
+  // The kernel touches the deferred pages too, for example when it
+  // reads a buffer passed to write or when it waits on a futex, so,
+  // we must also handle the faults it takes: UFFD_USER_MODE_ONLY
+  // would make these syscalls fail with EFAULT. Unprivileged processes
+  // are allowed to do this only if vm.unprivileged_userfaultfd is 1.
+  int fd = system_userfaultfd (O_CLOEXEC);
+  if (fd == -1)
+    {
+      VDL_LOG_ERROR ("userfaultfd is not available for kernel faults: ignoring LD_UFFD_RELOC\n");
+      return false;
+    }
+  struct uffdio_api api;
+  api.api = UFFD_API;
+  api.features = 0;
+  void *buffer = system_mmap (0, system_getpagesize (), PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (system_ioctl (fd, UFFDIO_API, &api) == -1 || buffer == MAP_FAILED)
+    {
+      VDL_LOG_ERROR ("userfaultfd is not usable: ignoring LD_UFFD_RELOC\n");
+      system_close (fd);
+      return false;
+    }
+  futex_construct (&g_uffd.futex);
+  g_uffd.fd = fd;
+  g_uffd.buffer = (unsigned long)buffer;
+  g_uffd.files = vdl_list_new ();
+  if (!vdl_thread_create (uffd_run, 0))
+    {
+      VDL_LOG_ERROR ("Could not start userfaultfd thread: ignoring LD_UFFD_RELOC\n");
+      vdl_list_delete (g_uffd.files);
+      system_munmap (buffer, system_getpagesize ());
+      system_close (fd);
+      g_uffd.files = 0;
+      return false;
+    }
+  g_uffd.started = 1;
+  g_uffd.failed = 0;
+  return true;
+}
+
+static void
+uffd_file_delete (struct VdlUffdFile *ufile)
+{
+  unsigned long page_size = system_getpagesize ();
+  uint32_t i;
+  for (i = 0; i < ufile->n_ranges; i++)
+    {
+      struct VdlUffdRange *range = &ufile->ranges[i];
+      if (range->shadow != 0)
+	{
+	  system_munmap ((uint8_t *)range->shadow, range->n_pages * page_size);
+	}
+      vdl_alloc_free (range->done);
+      vdl_alloc_free (range->first);
+      vdl_alloc_free (range->entries);
+    }
+  vdl_alloc_free (ufile->ranges);
+  vdl_alloc_free (ufile->symbols);
+  vdl_alloc_delete (ufile);
+}
+
+// mark the pages which intersect [start,start+size) as not deferred.
+static void
+uffd_pin (struct VdlUffdFile *ufile, unsigned long start, unsigned long size)
+{
+  unsigned long page_size = system_getpagesize ();
+  uint32_t i;
+  for (i = 0; i < ufile->n_ranges; i++)
+    {
+      struct VdlUffdRange *range = &ufile->ranges[i];
+      unsigned long end = range->start + range->n_pages * page_size;
+      unsigned long a = vdl_utils_max (start, range->start);
+      unsigned long b = vdl_utils_min (start + size, end);
+      unsigned long page;
+      for (page = vdl_utils_align_down (a, page_size); page < b; page += page_size)
+	{
+	  range->done[(page - range->start) / page_size] = 1;
+	}
+    }
+}
+
+// count the relocation which writes size bytes at addr in 
+// the page it targets.
+static void
+uffd_count (struct VdlUffdFile *ufile, unsigned long addr, unsigned long size)
+{
+  unsigned long page_size = system_getpagesize ();
+  struct VdlUffdRange *range = uffd_find_range (ufile, addr);
+  if (range == 0)
+    {
+      return;
+    }
+  uint32_t i = (addr - range->start) / page_size;
+  if ((addr + size - 1 - range->start) / page_size != i)
+    {
+      // relocations which straddle two pages are never deferred.
+      uffd_pin (ufile, addr, size);
+      return;
+    }
+  range->first[i]++;
+}
+
+// move the pages [a,b) of range to its shadow area and replace them
+// with pages registered with userfaultfd. Returns false if the
+// pages are still in place.
+static bool
+uffd_defer (struct VdlUffdRange *range, uint32_t a, uint32_t b)
+{
+  unsigned long page_size = system_getpagesize ();
+  void *addr = (void*)(range->start + a * page_size);
+  void *shadow = (void*)(range->shadow + a * page_size);
+  unsigned long size = (b - a) * page_size;
+  if (system_mremap_fixed (addr, size, shadow) == MAP_FAILED)
+    {
+      return false;
+    }
+  struct uffdio_register reg;
+  reg.range.start = (unsigned long)addr;
+  reg.range.len = size;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+  if (system_mmap (addr, size, range->prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+		   -1, 0) == MAP_FAILED ||
+      system_ioctl (g_uffd.fd, UFFDIO_REGISTER, &reg) == -1)
+    {
+      // put the original pages back in place.
+      void *status = system_mremap_fixed (shadow, size, addr);
+      VDL_LOG_ASSERT (status != MAP_FAILED, "Could not restore pages");
+      return false;
+    }
+  return true;
+}
+
+bool
+vdl_uffd_reloc (struct VdlFile *file)
+{
+  VDL_LOG_FUNCTION ("file=%s", file->name);
+  unsigned long n_rel = 0;
+  unsigned long n_rela = 0;
+  if (file->dt_rel != 0 && file->dt_relent != 0)
+    {
+      n_rel = file->dt_relsz / file->dt_relent;
+    }
+  if (file->dt_rela != 0 && file->dt_relaent != 0)
+    {
+      n_rela = file->dt_relasz / file->dt_relaent;
+    }
+  if (!g_vdl.uffd_reloc ||
+      file->dt_flags & DF_TEXTREL ||
+      file->dt_strtab == 0 || file->dt_symtab == 0 ||
+      n_rel + n_rela == 0 ||
+      n_rel >= VDL_UFFD_RELA || n_rela >= VDL_UFFD_RELA ||
+      !uffd_start ())
+    {
+      return false;
+    }
+  unsigned long page_size = system_getpagesize ();
+
+  struct VdlUffdFile *ufile = vdl_alloc_new (struct VdlUffdFile);
+  ufile->file = file;
+  ufile->symbols = 0;
+  ufile->n_ranges = 0;
+  void **cur;
+  for (cur = vdl_list_begin (file->image->maps); 
+       cur != vdl_list_end (file->image->maps); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFileMap *map = *cur;
+      if (map->mmap_flags & PROT_WRITE && map->file_size_align != 0)
+	{
+	  ufile->n_ranges++;
+	}
+    }
+  ufile->ranges = vdl_alloc_malloc (sizeof (struct VdlUffdRange) * (ufile->n_ranges + 1));
+  struct VdlUffdRange *range = ufile->ranges;
+  for (cur = vdl_list_begin (file->image->maps); 
+       cur != vdl_list_end (file->image->maps); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlFileMap *map = *cur;
+      if (!(map->mmap_flags & PROT_WRITE && map->file_size_align != 0))
+	{
+	  continue;
+	}
+      range->start = file->load_base + map->mem_start_align;
+      range->n_pages = map->file_size_align / page_size;
+      range->prot = map->mmap_flags;
+      range->shadow = 0;
+      range->done = vdl_alloc_malloc (range->n_pages + 1);
+      vdl_memset (range->done, 0, range->n_pages + 1);
+      range->first = vdl_alloc_malloc (sizeof (uint32_t) * (range->n_pages + 1));
+      vdl_memset (range->first, 0, sizeof (uint32_t) * (range->n_pages + 1));
+      range->entries = 0;
+      range++;
+    }
+
+  // count the relocations which target each page and find out
+  // how many symbols they use.
+  unsigned long n_symbols = 1;
+  unsigned long k;
+  for (k = 0; k < n_rel + n_rela; k++)
+    {
+      unsigned long type, sym, offset;
+      if (k < n_rel)
+	{
+	  type = ELFW_R_TYPE (file->dt_rel[k].r_info);
+	  sym = ELFW_R_SYM (file->dt_rel[k].r_info);
+	  offset = file->dt_rel[k].r_offset;
+	}
+      else
+	{
+	  type = ELFW_R_TYPE (file->dt_rela[k - n_rel].r_info);
+	  sym = ELFW_R_SYM (file->dt_rela[k - n_rel].r_info);
+	  offset = file->dt_rela[k - n_rel].r_offset;
+	}
+      if (machine_reloc_is_copy (type))
+	{
+	  // R_*_COPY read the data of other files.
+	  uffd_file_delete (ufile);
+	  return false;
+	}
+      n_symbols = vdl_utils_max (n_symbols, sym + 1);
+      // TLS descriptors are two words wide.
+      uffd_count (ufile, file->load_base + offset, 
+		  (machine_reloc_is_tlsdesc (type)?2:1) * sizeof (unsigned long));
+    }
+
+  // the pages we touch after relocation are not deferred.
+  uint32_t i;
+  for (i = 0; i < file->phnum; i++)
+    {
+      ElfW(Phdr) *phdr = &file->phdr[i];
+      if (phdr->p_type == PT_DYNAMIC || phdr->p_type == PT_TLS)
+	{
+	  uffd_pin (ufile, file->load_base + phdr->p_vaddr, phdr->p_memsz);
+	}
+    }
+  if (file->dt_pltgot != 0)
+    {
+      uffd_pin (ufile, file->dt_pltgot, 3 * sizeof (unsigned long));
+    }
+  if (file->dt_jmprel != 0 && file->dt_pltrel == DT_REL)
+    {
+      ElfW(Rel) *jmprel = (ElfW(Rel) *)file->dt_jmprel;
+      for (k = 0; k < file->dt_pltrelsz / sizeof (ElfW(Rel)); k++)
+	{
+	  uffd_pin (ufile, file->load_base + jmprel[k].r_offset, sizeof (unsigned long));
+	}
+    }
+  else if (file->dt_jmprel != 0 && file->dt_pltrel == DT_RELA)
+    {
+      ElfW(Rela) *jmprel = (ElfW(Rela) *)file->dt_jmprel;
+      for (k = 0; k < file->dt_pltrelsz / sizeof (ElfW(Rela)); k++)
+	{
+	  uffd_pin (ufile, file->load_base + jmprel[k].r_offset, sizeof (unsigned long));
+	}
+    }
+
+  // turn the per-page counts into the start index of each page
+  // in the entries array.
+  unsigned long n_deferred_pages = 0;
+  unsigned long n_deferred = 0;
+  for (range = ufile->ranges; range != &ufile->ranges[ufile->n_ranges]; range++)
+    {
+      uint32_t total = 0;
+      for (i = 0; i < range->n_pages; i++)
+	{
+	  uint32_t count = range->first[i];
+	  if (count == 0)
+	    {
+	      range->done[i] = 1;
+	    }
+	  if (range->done[i])
+	    {
+	      count = 0;
+	    }
+	  else
+	    {
+	      n_deferred_pages++;
+	    }
+	  range->first[i] = total;
+	  total += count;
+	}
+      range->first[range->n_pages] = total;
+      range->entries = vdl_alloc_malloc (sizeof (uint32_t) * (total + 1));
+      n_deferred += total;
+    }
+  if (n_deferred == 0)
+    {
+      uffd_file_delete (ufile);
+      return false;
+    }
+
+  // Resolve all the symbols now and apply the relocations which
+  // are not deferred.
+  ufile->symbols = vdl_alloc_malloc (sizeof (struct VdlRelocSymbol) * n_symbols);
+  uint8_t *resolved = vdl_alloc_malloc (n_symbols);
+  vdl_memset (resolved, 0, n_symbols);
+  for (k = 0; k < n_rel + n_rela; k++)
+    {
+      unsigned long type, sym, offset;
+      uint32_t entry;
+      if (k < n_rel)
+	{
+	  type = ELFW_R_TYPE (file->dt_rel[k].r_info);
+	  sym = ELFW_R_SYM (file->dt_rel[k].r_info);
+	  offset = file->dt_rel[k].r_offset;
+	  entry = k;
+	}
+      else
+	{
+	  type = ELFW_R_TYPE (file->dt_rela[k - n_rel].r_info);
+	  sym = ELFW_R_SYM (file->dt_rela[k - n_rel].r_info);
+	  offset = file->dt_rela[k - n_rel].r_offset;
+	  entry = (k - n_rel) | VDL_UFFD_RELA;
+	}
+      if (!resolved[sym])
+	{
+	  if (!vdl_reloc_symbol_resolve (file, type, sym, &ufile->symbols[sym]))
+	    {
+	      ufile->symbols[sym].file = 0;
+	    }
+	  resolved[sym] = 1;
+	}
+      range = uffd_find_range (ufile, file->load_base + offset);
+      i = (range == 0)?0:(file->load_base + offset - range->start) / page_size;
+      if (range == 0 || range->done[i])
+	{
+	  uffd_apply (ufile, entry, file->load_base);
+	}
+      else
+	{
+	  // first[i] is used as the cursor of page i until all
+	  // the entries are stored.
+	  range->entries[range->first[i]] = entry;
+	  range->first[i]++;
+	}
+    }
+  vdl_alloc_free (resolved);
+
+  futex_lock (&g_uffd.futex);
+  vdl_list_push_back (g_uffd.files, ufile);
+  for (range = ufile->ranges; range != &ufile->ranges[ufile->n_ranges]; range++)
+    {
+      // undo the cursor increments.
+      for (i = range->n_pages; i > 0; i--)
+	{
+	  range->first[i] = range->first[i-1];
+	}
+      range->first[0] = 0;
+      void *shadow = system_mmap (0, range->n_pages * page_size, PROT_NONE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      range->shadow = (shadow == MAP_FAILED)?0:(unsigned long)shadow;
+      uint32_t a = 0;
+      while (a < range->n_pages)
+	{
+	  if (range->done[a])
+	    {
+	      a++;
+	      continue;
+	    }
+	  uint32_t b = a;
+	  while (b < range->n_pages && !range->done[b])
+	    {
+	      b++;
+	    }
+	  if (range->shadow == 0 || !uffd_defer (range, a, b))
+	    {
+	      for (i = a; i < b; i++)
+		{
+		  uffd_apply_page (ufile, range, i);
+		  n_deferred_pages--;
+		  n_deferred -= range->first[i+1] - range->first[i];
+		}
+	    }
+	  a = b;
+	}
+    }
+  futex_unlock (&g_uffd.futex);
+
+  VDL_LOG_STATS ("uffd file=%s relocs=%lu deferred-relocs=%lu deferred-pages=%lu\n",
+		 file->filename, n_rel + n_rela, n_deferred, n_deferred_pages);
+  return true;
+}
+
+void
+vdl_uffd_remove (struct VdlFile *file)
+{
+  if (!g_uffd.started)
+    {
+      return;
+    }
+  futex_lock (&g_uffd.futex);
+  void **cur;
+  for (cur = vdl_list_begin (g_uffd.files); 
+       cur != vdl_list_end (g_uffd.files); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlUffdFile *ufile = *cur;
+      if (ufile->file == file)
+	{
+	  vdl_list_erase (g_uffd.files, cur);
+	  uffd_file_delete (ufile);
+	  break;
+	}
+    }
+  futex_unlock (&g_uffd.futex);
+}
+
+void
+vdl_uffd_fork_prepare (void)
+{
+  if (!g_uffd.started)
+    {
+      return;
+    }
+  VDL_LOG_FUNCTION ("");
+  futex_lock (&g_uffd.futex);
+  // the child inherits neither our registrations nor our thread:
+  // its missing pages would be zero-filled. So, fill them all now.
+  void **cur;
+  for (cur = vdl_list_begin (g_uffd.files); 
+       cur != vdl_list_end (g_uffd.files); 
+       cur = vdl_list_next (cur))
+    {
+      struct VdlUffdFile *ufile = *cur;
+      uint32_t i, j;
+      for (i = 0; i < ufile->n_ranges; i++)
+	{
+	  struct VdlUffdRange *range = &ufile->ranges[i];
+	  for (j = 0; j < range->n_pages; j++)
+	    {
+	      if (!range->done[j])
+		{
+		  bool ok = uffd_fill (ufile, range, j);
+		  VDL_LOG_ASSERT (ok, "Could not relocate deferred page before fork");
+		}
+	    }
+	}
+    }
+}
+
+void
+vdl_uffd_fork_parent (void)
+{
+  if (!g_uffd.started)
+    {
+      return;
+    }
+  futex_unlock (&g_uffd.futex);
+}
+
+void
+vdl_uffd_fork_child (void)
+{
+  if (!g_uffd.started)
+    {
+      return;
+    }
+  // all the pages are in place and the thread of the parent does
+  // not exist here: forget everything. The files we load from now
+  // on use a userfaultfd and a thread of their own.
+  void **cur;
+  for (cur = vdl_list_begin (g_uffd.files); 
+       cur != vdl_list_end (g_uffd.files); 
+       cur = vdl_list_next (cur))
+    {
+      uffd_file_delete (*cur);
+    }
+  vdl_list_delete (g_uffd.files);
+  system_munmap ((uint8_t *)g_uffd.buffer, system_getpagesize ());
+  system_close (g_uffd.fd);
+  g_uffd.files = 0;
+  g_uffd.buffer = 0;
+  g_uffd.fd = -1;
+  g_uffd.started = 0;
+  g_uffd.failed = 0;
+  futex_construct (&g_uffd.futex);
+}
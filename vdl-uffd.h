@@ -0,0 +1,38 @@
+#ifndef VDL_UFFD_H
+#define VDL_UFFD_H
+
+#include <stdbool.h>
+
+struct VdlFile;
+
+/* When LD_UFFD_RELOC is set, the writable pages of a file which are
+ * the target of dt_rel and dt_rela relocations are replaced with
+ * anonymous pages registered with userfaultfd. The relocations which
+ * target a page are applied by a thread owned by the loader when the
+ * page is first touched. The symbols used by these relocations are
+ * resolved when the file is relocated so, the thread does not need
+ * g_vdl.futex and never calls user code.
+ * The pages which the loader itself writes to or reads from after 
+ * relocation (dynamic section, tls template, start of the GOT and
+ * PLT slots) are relocated immediately.
+ *
+ * Since userfaultfd registrations are not inherited by a child
+ * process, all the deferred pages are filled before fork. See
+ * glibc.c
+ */
+
+// Process the dt_rel and dt_rela relocations of file, deferring
+// those which can be deferred. Returns false if the file
+// cannot use this mode, in which case the caller must process its 
+// relocations as usual. The caller must hold g_vdl.futex.
+bool vdl_uffd_reloc (struct VdlFile *file);
+// forget about the pages of this file. Must be called before
+// they are unmapped. The caller must hold g_vdl.futex.
+void vdl_uffd_remove (struct VdlFile *file);
+// called around fork, with g_vdl.futex held. prepare fills all
+// the deferred pages and the child forgets about them.
+void vdl_uffd_fork_prepare (void);
+void vdl_uffd_fork_parent (void);
+void vdl_uffd_fork_child (void);
+
+#endif /* VDL_UFFD_H */
@@ -4,6 +4,10 @@
 #include "vdl-utils.h"
 #include "vdl-log.h"
 #include "vdl-alloc.h"
+#include "vdl-lookup.h"
+#include "vdl-image.h"
+#include "vdl-bind-worker.h"
+#include "vdl-uffd.h"
 #include "system.h"
 
 
@@ -11,19 +15,23 @@ static void
 file_delete (struct VdlFile *file, bool mapping)
 {
   vdl_context_remove_file (file->context, file);
+  vdl_bind_worker_remove (file);
+  vdl_uffd_remove (file);
 
   if (mapping)
     {
       void **i;
-      for (i = vdl_list_begin (file->maps); i != vdl_list_end (file->maps); i = vdl_list_next (i))
+      for (i = vdl_list_begin (file->image->maps); 
+	   i != vdl_list_end (file->image->maps); 
+	   i = vdl_list_next (i))
 	{
 	  struct VdlFileMap *map = *i;
-	  int status = system_munmap ((void*)map->mem_start_align, 
+	  int status = system_munmap ((void*)(file->load_base + map->mem_start_align), 
 				      map->mem_size_align);
 	  if (status == -1)
 	    {
 	      VDL_LOG_ERROR ("unable to unmap map 0x%lx[0x%lx] for \"%s\"\n", 
-			     map->mem_start_align, map->mem_size_align,
+			     file->load_base + map->mem_start_align, map->mem_size_align,
 			     file->filename);
 	    }
 	}
@@ -39,9 +47,12 @@ file_delete (struct VdlFile *file, bool mapping)
   vdl_list_delete (file->gc_symbols_resolved_in);
   vdl_alloc_free (file->name);
   vdl_alloc_free (file->filename);
-  vdl_alloc_free (file->phdr);
-  vdl_list_iterate (file->maps, vdl_alloc_free);
-  vdl_list_delete (file->maps);
+  vdl_image_unref (file->image);
+  if (file->global_index != 0)
+    {
+      vdl_alloc_free (file->global_index);
+    }
+  vdl_lookup_file_finalize (file);
 
 
   file->deps = 0;
@@ -52,7 +63,9 @@ file_delete (struct VdlFile *file, bool mapping)
   file->context = 0;
   file->phdr = 0;
   file->phnum = 0;
-  file->maps = 0;
+  file->image = 0;
+  file->global_index = 0;
+  file->global_index_size = 0;
 
   vdl_alloc_delete (file);
 }
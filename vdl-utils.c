@@ -107,6 +107,21 @@ int vdl_utils_exists (const char *filename)
   int status = system_fstat (filename, &buf);
   return status == 0;
 }
+bool vdl_utils_write_all (int fd, const void *buf, unsigned long size)
+{
+  const uint8_t *cur = buf;
+  while (size > 0)
+    {
+      int written = system_write (fd, cur, size);
+      if (written <= 0)
+	{
+	  return false;
+	}
+      cur += written;
+      size -= written;
+    }
+  return true;
+}
 const char *vdl_utils_getenv (const char **envp, const char *value)
 {
   VDL_LOG_FUNCTION ("envp=%p, value=%s", envp, value);
@@ -134,6 +149,16 @@ const char *vdl_utils_getenv (const char **envp, const char *value)
     }
   return 0;
 }
+unsigned long vdl_utils_strtoul (const char *str)
+{
+  unsigned long value = 0;
+  while (*str >= '0' && *str <= '9')
+    {
+      value = value * 10 + (*str - '0');
+      str++;
+    }
+  return value;
+}
 void
 vdl_utils_str_list_delete (struct VdlList *list)
 {
@@ -13,9 +13,13 @@ char *vdl_utils_strdup (const char *str);
 char *vdl_utils_strfind (char *str, const char *substr);
 char *vdl_utils_strconcat (const char *str, ...);
 const char *vdl_utils_getenv (const char **envp, const char *value);
+// parse a decimal number. Stops at the first non-digit character.
+unsigned long vdl_utils_strtoul (const char *str);
 
 // convenience function
 int vdl_utils_exists (const char *filename);
+// write the size bytes of buf to fd. Return false on error.
+bool vdl_utils_write_all (int fd, const void *buf, unsigned long size);
 
 // manipulate lists of strings.
 void vdl_utils_str_list_delete (struct VdlList *list);
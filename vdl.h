@@ -21,7 +21,16 @@
 #define ELFW_ST_INFO(bind, type) ELF64_ST_INFO(bind,type)
 #endif
 
+#ifndef DT_RELR
+// packed relative relocations (-z pack-relative-relocs)
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#define DT_RELRENT 37
+#endif
+
 struct Futex;
+struct VdlHashMap;
+struct VdlTlsImage;
 
 // the numbers below must match the declarations from svs4
 enum VdlState {
@@ -65,6 +74,45 @@ struct Vdl
   // both member variables are used exclusively by vdl_dl_iterate_phdr
   unsigned long n_added;
   unsigned long n_removed;
+  // maximum number of entries in the symbol lookup cache of each
+  // context. Zero disables the cache.
+  unsigned long lookup_cache_size;
+  // build gnu hash tables for files which don't have one.
+  uint32_t synth_hash : 1;
+  // the VdlImage instances which can be shared by all the
+  // files which map the same file, keyed by st_dev/st_ino.
+  struct VdlHashMap *images;
+  // share the values returned by IFUNC resolvers among all
+  // the mappings of the same image.
+  uint32_t ifunc_cache : 1;
+  // the directory in which the bind profiles are read and
+  // written or zero. See vdl-bind-profile.h
+  char *bind_profile;
+  // relocate the writable pages of each file when they are
+  // first touched. See vdl-uffd.h
+  uint32_t uffd_reloc : 1;
+  // look up the versioned references of a file in the
+  // dependency which defines their version first.
+  uint32_t direct_bind : 1;
+  // the directory in which the relocation plans are read and
+  // written or zero. See vdl-resolve-cache.h
+  char *resolve_cache;
+  // exit once the main binary and its dependencies are relocated.
+  uint32_t resolve_cache_only : 1;
+  // the tls module indexes below tls_next_index which are
+  // not used by any file anymore. See vdl-tls.c
+  unsigned long *tls_free_indexes;
+  unsigned long tls_n_free_indexes;
+  unsigned long tls_free_indexes_size;
+  // the file which uses each tls module index or zero.
+  struct VdlFile **tls_modules;
+  unsigned long tls_modules_size;
+  // the index of the module which changed for each of the last
+  // generations of tls_gen. See vdl-tls.c
+  unsigned long *tls_changes;
+  // the initial content of the static tls area and of the dtv
+  // of a new thread. See vdl-tls.c
+  struct VdlTlsImage *tls_image;
 };
 
 extern struct Vdl g_vdl;
@@ -6,14 +6,17 @@
 #include "vdl-lookup.h"
 #include "local-elf.h"
 #include "vdl-file.h"
+#include "vdl-image.h"
 #include "vdl-config.h"
+#include "vdl-tls.h"
+#include "futex.h"
+#include <stddef.h>
 #include <sys/syscall.h>
+#include <linux/sched.h> // for CLONE_*
 #include <sys/mman.h>
 #include <sys/mman.h>
 #include <asm/prctl.h> // for ARCH_SET_FS
 
-typedef Elf64_Addr (*IRelativeFunction) (void);
-
 bool machine_reloc_is_relative (unsigned long reloc_type)
 {
   return reloc_type == R_X86_64_RELATIVE;
@@ -22,6 +25,108 @@ bool machine_reloc_is_copy (unsigned long reloc_type)
 {
   return reloc_type == R_X86_64_COPY;
 }
+bool machine_reloc_is_jump_slot (unsigned long reloc_type)
+{
+  return reloc_type == R_X86_64_JUMP_SLOT;
+}
+bool machine_reloc_is_tlsdesc (unsigned long reloc_type)
+{
+  return reloc_type == R_X86_64_TLSDESC;
+}
+
+// the TLS descriptor functions, defined in resolv.S
+extern void machine_tlsdesc_static (void);
+extern void machine_tlsdesc_dynamic (void);
+// resolv.S (machine_tlsdesc_dynamic, __tls_get_addr) hardcodes these.
+#define TLSDESC_MODULE_SHIFT 40
+_Static_assert (offsetof (struct Vdl, tls_gen) == 72, "update VDL_TLS_GEN_OFFSET in resolv.S");
+_Static_assert (CONFIG_TCB_DTV_OFFSET == 8, "update TCB_DTV_OFFSET in resolv.S");
+
+// called by machine_tlsdesc_dynamic when the dtv of the calling 
+// thread is not uptodate or when the tls block of the module 
+// has not been allocated yet.
+unsigned long machine_tlsdesc_dynamic_slow (unsigned long arg);
+unsigned long machine_tlsdesc_dynamic_slow (unsigned long arg)
+{
+  unsigned long module = arg >> TLSDESC_MODULE_SHIFT;
+  unsigned long offset = arg & ((1UL << TLSDESC_MODULE_SHIFT) - 1);
+  futex_lock (g_vdl.futex);
+  unsigned long addr = vdl_tls_get_addr_slow (module, offset);
+  futex_unlock (g_vdl.futex);
+  return addr - machine_thread_pointer_get ();
+}
+void machine_reloc_relative_rel (unsigned long load_base,
+				 const ElfW(Rel) *rel, unsigned long n)
+{
+  // the addend is stored in place: B + A
+  unsigned long i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      *(unsigned long *)(load_base + rel[i].r_offset) += load_base;
+      *(unsigned long *)(load_base + rel[i+1].r_offset) += load_base;
+      *(unsigned long *)(load_base + rel[i+2].r_offset) += load_base;
+      *(unsigned long *)(load_base + rel[i+3].r_offset) += load_base;
+    }
+  for (; i < n; i++)
+    {
+      *(unsigned long *)(load_base + rel[i].r_offset) += load_base;
+    }
+}
+void machine_reloc_relative_rela (unsigned long load_base,
+				  const ElfW(Rela) *rela, unsigned long n)
+{
+  // B + A
+  unsigned long i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      *(unsigned long *)(load_base + rela[i].r_offset) = load_base + rela[i].r_addend;
+      *(unsigned long *)(load_base + rela[i+1].r_offset) = load_base + rela[i+1].r_addend;
+      *(unsigned long *)(load_base + rela[i+2].r_offset) = load_base + rela[i+2].r_addend;
+      *(unsigned long *)(load_base + rela[i+3].r_offset) = load_base + rela[i+3].r_addend;
+    }
+  for (; i < n; i++)
+    {
+      *(unsigned long *)(load_base + rela[i].r_offset) = load_base + rela[i].r_addend;
+    }
+}
+static void
+reloc_address (const struct VdlFile *file, unsigned long *reloc_addr,
+	       unsigned long reloc_addend, unsigned long symbol_value)
+{
+  *reloc_addr = file->load_base + symbol_value + reloc_addend;
+}
+static void
+reloc_tpoff64 (const struct VdlFile *file, unsigned long *reloc_addr,
+	       unsigned long reloc_addend, unsigned long symbol_value)
+{
+  VDL_LOG_ASSERT (file->has_tls,
+		  "Module which contains target symbol does not have a TLS block ??");
+  *reloc_addr = file->tls_offset + symbol_value + reloc_addend;
+}
+static void
+reloc_dtpmod64 (const struct VdlFile *file, unsigned long *reloc_addr,
+		unsigned long reloc_addend, unsigned long symbol_value)
+{
+  VDL_LOG_ASSERT (file->has_tls,
+		  "Module which contains target symbol does not have a TLS block ??");
+  *reloc_addr = file->tls_index;
+}
+MachineRelocFunction machine_reloc_group (unsigned long reloc_type)
+{
+  switch (reloc_type)
+    {
+    case R_X86_64_GLOB_DAT:
+    case R_X86_64_JUMP_SLOT:
+    case R_X86_64_64:
+      return reloc_address;
+    case R_X86_64_TPOFF64:
+      return reloc_tpoff64;
+    case R_X86_64_DTPMOD64:
+      return reloc_dtpmod64;
+    default:
+      return 0;
+    }
+}
 void machine_reloc (const struct VdlFile *file,
 		    unsigned long *reloc_addr,
 		    unsigned long reloc_type,
@@ -40,24 +145,40 @@ void machine_reloc (const struct VdlFile *file,
       *reloc_addr = file->load_base + reloc_addend;
       break;
     case R_X86_64_TPOFF64:
-      VDL_LOG_ASSERT (file->has_tls,
-		      "Module which contains target symbol does not have a TLS block ??");
-      *reloc_addr = file->tls_offset + symbol_value + reloc_addend;
+      reloc_tpoff64 (file, reloc_addr, reloc_addend, symbol_value);
       break;
     case R_X86_64_DTPMOD64:
-      VDL_LOG_ASSERT (file->has_tls,
-		      "Module which contains target symbol does not have a TLS block ??");
-      *reloc_addr = file->tls_index;
+      reloc_dtpmod64 (file, reloc_addr, reloc_addend, symbol_value);
       break;
     case R_X86_64_DTPOFF64:
       VDL_LOG_ASSERT (file->has_tls,
 		      "Module which contains target symbol does not have a TLS block ??");
       *reloc_addr = symbol_value + reloc_addend;
       break;
+    case R_X86_64_TLSDESC:
+      VDL_LOG_ASSERT (file->has_tls,
+		      "Module which contains target symbol does not have a TLS block ??");
+      if (file->tls_is_static)
+	{
+	  // the variable is always at the same offset from the 
+	  // thread pointer.
+	  reloc_addr[0] = (unsigned long) machine_tlsdesc_static;
+	  reloc_addr[1] = file->tls_offset + symbol_value + reloc_addend;
+	}
+      else
+	{
+	  VDL_LOG_ASSERT (symbol_value + reloc_addend < (1UL << TLSDESC_MODULE_SHIFT) &&
+			  file->tls_index < (1UL << (64 - TLSDESC_MODULE_SHIFT)),
+			  "TLS descriptor argument overflow");
+	  reloc_addr[0] = (unsigned long) machine_tlsdesc_dynamic;
+	  reloc_addr[1] = (file->tls_index << TLSDESC_MODULE_SHIFT) | 
+	    (symbol_value + reloc_addend);
+	}
+      break;
     case R_X86_64_GLOB_DAT:
     case R_X86_64_JUMP_SLOT:
     case R_X86_64_64:
-      *reloc_addr = file->load_base + symbol_value + reloc_addend;
+      reloc_address (file, reloc_addr, reloc_addend, symbol_value);
       break;
     case R_X86_64_IRELATIVE:
       /* nop */
@@ -104,6 +225,9 @@ const char *machine_reloc_type_to_str (unsigned long reloc_type)
     ITEM(X86_64_PC64);
     ITEM(X86_64_GOTOFF64);
     ITEM(X86_64_GOTPC32);
+    ITEM(X86_64_GOTPC32_TLSDESC);
+    ITEM(X86_64_TLSDESC_CALL);
+    ITEM(X86_64_TLSDESC);
   default:
     return "XXX";
   }
@@ -142,8 +266,8 @@ void machine_reloc_irelative (struct VdlFile *file)
       switch (reloc_type) {
 	case  R_X86_64_IRELATIVE:
 	  {
-           IRelativeFunction value =  (IRelativeFunction)(file->load_base + reloc_addend);
-           *preloc_addr = value ();
+           *preloc_addr = vdl_image_ifunc_call (file->image, file->load_base,
+                                                reloc_addend);
          }
          break;
        }
@@ -194,6 +318,10 @@ void machine_lazy_reloc (struct VdlFile *file)
 	  /* do nothing here. the actual IRELATIVE relocation 
 	     will be performed within machine_reloc_irelative */
 	  break;
+	case R_X86_64_TLSDESC:
+	  /* do nothing here. TLS descriptors are never resolved 
+	     lazily: vdl_reloc resolves them right after this. */
+	  break;
 	case R_X86_64_JUMP_SLOT:
 	  if (plt == 0)
 	    {
@@ -263,6 +391,44 @@ unsigned long machine_thread_pointer_get (void)
   return value;
 }
 
+int machine_thread_create (unsigned long stack_top, unsigned long tp,
+			   void (*fn) (void *), void *arg)
+{
+  // the child pops fn and arg from its new stack: it cannot
+  // use anything else from our stack frame.
+  unsigned long *stack = (unsigned long *)(stack_top & ~0xfUL);
+  stack -= 2;
+  stack[0] = (unsigned long)fn;
+  stack[1] = (unsigned long)arg;
+  unsigned long flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | 
+    CLONE_THREAD | CLONE_SYSVSEM | CLONE_SETTLS;
+  long int result;
+  register long int _a4 asm ("r10") = 0;
+  register long int _a5 asm ("r8") = tp;
+  __asm__ __volatile__ ("syscall\n\t"
+			"test %%rax,%%rax\n\t"
+			"jnz 1f\n\t"
+			// child
+			"xor %%ebp,%%ebp\n\t"
+			"pop %%rax\n\t"
+			"pop %%rdi\n\t"
+			"call *%%rax\n\t"
+			"mov %[exit],%%eax\n\t"
+			"xor %%edi,%%edi\n\t"
+			"syscall\n\t"
+			"hlt\n\t"
+			"1:\n\t"
+			: "=a" (result)
+			: "0" (__NR_clone), "D" (flags), "S" (stack), "d" (0),
+			  "r" (_a4), "r" (_a5), [exit] "i" (__NR_exit)
+			: "memory", "cc", "r11", "rcx");
+  if (result < 0)
+    {
+      return -1;
+    }
+  return 0;
+}
+
 uint32_t machine_atomic_compare_and_exchange (uint32_t *ptr, uint32_t old, uint32_t new)
 {
   uint32_t prev;
@@ -283,6 +449,11 @@ uint32_t machine_atomic_dec (uint32_t *ptr)
   return prev;
 }
 
+void machine_memory_barrier (void)
+{
+  asm volatile ("mfence" : : : "memory");
+}
+
 
 const char *
 machine_get_system_search_dirs (void)